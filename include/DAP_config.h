@@ -99,7 +99,12 @@ This information includes:
 
 /// Indicate that UART Serial Wire Output (SWO) trace is available.
 /// This information is returned by the command \ref DAP_Info as part of <b>Capabilities</b>.
+/// Only boards that route the target SWO to a GPIO (PROBE_PIN_SWO) support it.
+#ifdef PROBE_PIN_SWO
+#define SWO_UART                1               ///< SWO UART:  1 = available, 0 = not available.
+#else
 #define SWO_UART                0               ///< SWO UART:  1 = available, 0 = not available.
+#endif
 
 /// USART Driver instance number for the UART SWO.
 #define SWO_UART_DRIVER         0               ///< USART Driver instance number (Driver_USART#).
@@ -109,13 +114,22 @@ This information includes:
 
 /// Indicate that Manchester Serial Wire Output (SWO) trace is available.
 /// This information is returned by the command \ref DAP_Info as part of <b>Capabilities</b>.
+#ifdef PROBE_PIN_SWO
+#define SWO_MANCHESTER          1               ///< SWO Manchester:  1 = available, 0 = not available.
+#else
 #define SWO_MANCHESTER          0               ///< SWO Manchester:  1 = available, 0 = not available.
+#endif
 
 /// SWO Trace Buffer Size.
-#define SWO_BUFFER_SIZE         4096U           ///< SWO Trace Buffer Size in bytes (must be 2^n).
+#define SWO_BUFFER_SIZE         16384U          ///< SWO Trace Buffer Size in bytes (must be 2^n).
 
 /// SWO Streaming Trace.
+/// Streaming uses the third endpoint of the CMSIS-DAP v2 interface.
+#if ((SWO_UART != 0) || (SWO_MANCHESTER != 0)) && (PROBE_DEBUG_PROTOCOL == PROTO_DAP_V2)
+#define SWO_STREAM              1               ///< SWO Streaming Trace: 1 = available, 0 = not available.
+#else
 #define SWO_STREAM              0               ///< SWO Streaming Trace: 1 = available, 0 = not available.
+#endif
 
 /// Clock frequency of the Test Domain Timer. Timer value is returned with \ref TIMESTAMP_GET.
 #define TIMESTAMP_CLOCK         1000000U      ///< Timestamp clock in Hz (0 = timestamps not supported).
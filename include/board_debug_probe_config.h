@@ -38,6 +38,9 @@
 #define PROBE_PIN_SWDI (PROBE_PIN_OFFSET + 1)
 #define PROBE_PIN_SWDIO (PROBE_PIN_OFFSET + 2)
 
+// No SWO input on the connectors. A board with the target SWO wired to a
+// spare GPIO can define PROBE_PIN_SWO to enable SWO trace.
+
 // UART config
 #define PROBE_UART_TX 4
 #define PROBE_UART_RX 5
@@ -80,11 +80,22 @@
 #else
 /* Software flow control - RTS and DTR can be omitted if not used */
 #define PROBE_UART_RTS 9
+/* RTS is released when the RX ring is this full (percent) and asserted again
+ * below the low mark. Define PROBE_UART_XONXOFF to send XOFF/XON instead. */
+#define PROBE_UART_RX_HIGH_WATER 75
+#define PROBE_UART_RX_LOW_WATER 25
 #endif
 #define PROBE_UART_DTR 10
 
 #endif
 
+/* Extra UARTs bridged through PIO, each gets its own CDC interface */
+#if false
+#define PROBE_PIO_UART0_TX 20
+#define PROBE_PIO_UART0_RX 21
+#define PROBE_PIO_UART_BAUDRATE 115200
+#endif
+
 /* LED config - some or all of these can be omitted if not used */
 #define PROBE_USB_CONNECTED_LED 2
 #define PROBE_DAP_CONNECTED_LED 15
@@ -39,6 +39,9 @@
 #define PROBE_PIN_RESET 1
 #endif
 
+// SWO trace input
+#define PROBE_PIN_SWO 6
+
 // UART config
 #define PROBE_UART_TX 4
 #define PROBE_UART_RX 5
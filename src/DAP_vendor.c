@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2013-2017 ARM Limited. All rights reserved.
+ * Copyright (c) 2024 DazzlingOkami
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replaces the empty CMSIS-DAP vendor command template with the
+ * Debugprobe specific commands listed in dap_vendor.h.
+ */
+
+#include "DAP_config.h"
+#include "DAP.h"
+#include "dap_vendor.h"
+#include "dap_mem.h"
+#include "swd_capture.h"
+#include "itm.h"
+#include "pc_sample.h"
+#include "mem_sample.h"
+#include "flash_exec.h"
+#include "dap_crc.h"
+#include "flash_diff.h"
+#include "flash_unpack.h"
+#include "bulk_read.h"
+#include "bulk_write.h"
+#include "dap_bench.h"
+#include "dap_stats.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "cdc_uart.h"
+#include "uart_trigger.h"
+#include "uart_autobaud.h"
+
+//**************************************************************************************************
+/**
+\defgroup DAP_Vendor_Adapt_gr Adapt Vendor Commands
+\ingroup DAP_Vendor_gr
+@{
+*/
+
+/** Process DAP Vendor Command and prepare Response Data
+\param request   pointer to request data
+\param response  pointer to response data
+\return          number of bytes in response (lower 16 bits)
+                 number of bytes in request (upper 16 bits)
+*/
+uint32_t DAP_ProcessVendorCommand(const uint8_t *request, uint8_t *response) {
+  uint32_t num = (1U << 16) | 1U;
+
+  *response++ = *request;        // copy Command ID
+
+  switch (*request++) {          // first byte in request is Command ID
+    case ID_DAP_VENDOR_SWD_CAPTURE:
+      num += swd_capture_command(request, response);
+      break;
+#if ((SWO_UART != 0) || (SWO_MANCHESTER != 0))
+    case ID_DAP_VENDOR_ITM:
+      num += itm_command(request, response);
+      break;
+#endif
+    case ID_DAP_VENDOR_PC_SAMPLE:
+      num += pc_sample_command(request, response);
+      break;
+    case ID_DAP_VENDOR_MEM_SAMPLE:
+      num += mem_sample_command(request, response);
+      break;
+    case ID_DAP_VENDOR_FLASH_EXEC:
+      num += flash_exec_command(request, response);
+      break;
+    case ID_DAP_VENDOR_CRC:
+      num += dap_crc_command(request, response);
+      break;
+    case ID_DAP_VENDOR_FLASH_DIFF:
+      num += flash_diff_command(request, response);
+      break;
+    case ID_DAP_VENDOR_FLASH_UNPACK:
+      num += flash_unpack_command(request, response);
+      break;
+    case ID_DAP_VENDOR_BULK_READ:
+      num += bulk_read_command(request, response);
+      break;
+    case ID_DAP_VENDOR_BULK_WRITE:
+      num += bulk_write_command(request, response);
+      break;
+    case ID_DAP_VENDOR_BENCH:
+      num += dap_bench_command(request, response);
+      break;
+    case ID_DAP_VENDOR_STATS:
+      num += dap_stats_command(request, response);
+      break;
+    case ID_DAP_VENDOR_UART:
+      num += cdc_uart_command(request, response);
+      break;
+    case ID_DAP_VENDOR_UART_TRIGGER:
+      num += uart_trigger_command(request, response);
+      break;
+    case ID_DAP_VENDOR_UART_AUTOBAUD:
+      num += uart_autobaud_command(request, response);
+      break;
+    default:
+      *(response-1) = ID_DAP_Invalid;
+      break;
+  }
+
+  // The next command may be a raw transfer in the same packet (DAP_ExecuteCommands)
+  // or come in over HID, which never goes through the DAP thread's release
+  dap_mem_release();
+
+  return (num);
+}
+
+///@}
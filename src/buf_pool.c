@@ -0,0 +1,100 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "buf_pool.h"
+
+#define POOL_UNITS (BUF_POOL_SIZE / BUF_POOL_MIN_BLOCK)
+
+static char pool[BUF_POOL_SIZE] __attribute__((aligned(BUF_POOL_SIZE)));
+static bool unit_used[POOL_UNITS];
+
+// The UART bridge takes its first buffers before the scheduler runs
+static inline void pool_lock(void) {
+    if (xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED)
+        vTaskSuspendAll();
+}
+
+static inline void pool_unlock(void) {
+    if (xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED)
+        xTaskResumeAll();
+}
+
+uint32_t buf_pool_block_size(uint32_t len) {
+    uint32_t size = BUF_POOL_MIN_BLOCK;
+
+    while (size < len && size < BUF_POOL_SIZE)
+        size <<= 1;
+    return size;
+}
+
+// First fit over positions aligned to the block size
+void *buf_pool_alloc(uint32_t size) {
+    uint32_t units, i, j;
+    void *block = NULL;
+
+    if (size < BUF_POOL_MIN_BLOCK || size > BUF_POOL_SIZE || (size & (size - 1)))
+        return NULL;
+    units = size / BUF_POOL_MIN_BLOCK;
+
+    pool_lock();
+    for (i = 0; i < POOL_UNITS && !block; i += units) {
+        for (j = 0; j < units && !unit_used[i + j]; j++)
+            ;
+        if (j < units)
+            continue;
+        for (j = 0; j < units; j++)
+            unit_used[i + j] = true;
+        block = &pool[i * BUF_POOL_MIN_BLOCK];
+    }
+    pool_unlock();
+    return block;
+}
+
+void buf_pool_free(void *block, uint32_t size) {
+    uint32_t first, i;
+
+    if (!block)
+        return;
+    first = ((char *)block - pool) / BUF_POOL_MIN_BLOCK;
+
+    pool_lock();
+    for (i = 0; i < size / BUF_POOL_MIN_BLOCK && first + i < POOL_UNITS; i++)
+        unit_used[first + i] = false;
+    pool_unlock();
+}
+
+uint32_t buf_pool_available(void) {
+    uint32_t i, n = 0;
+
+    for (i = 0; i < POOL_UNITS; i++)
+        n += !unit_used[i];
+    return n * BUF_POOL_MIN_BLOCK;
+}
@@ -0,0 +1,47 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef BUF_POOL_H_
+#define BUF_POOL_H_
+
+#include <stdint.h>
+
+/*
+ * Shared memory for ring buffers whose size is only known at run time. Blocks
+ * are powers of two from BUF_POOL_MIN_BLOCK up to the whole pool, and every
+ * block is aligned to its size so it can back a DMA ring.
+ */
+#define BUF_POOL_SIZE       16384
+#define BUF_POOL_MIN_BLOCK  256
+
+void *buf_pool_alloc(uint32_t size);
+void buf_pool_free(void *block, uint32_t size);
+uint32_t buf_pool_available(void);
+
+// Smallest block size that holds len bytes
+uint32_t buf_pool_block_size(uint32_t len);
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <pico/stdlib.h>
+
+#include "DAP_config.h"
+#include "DAP.h"
+#include "dap_vendor.h"
+#include "dap_mem.h"
+#include "dap_job.h"
+#include "bulk_read.h"
+#include "ringbuf.h"
+#include "tusb_stream.h"
+
+/*
+ * Memory dump over the data stream endpoint. A DAP job reads target memory
+ * straight into the free part of the ring and the USB thread sends it as a
+ * continuous run of IN packets. When the host stops reading, the ring fills
+ * up and the job stops reading until there is room again, so flow control
+ * comes from the endpoint for free.
+ */
+#define BULK_READ_PERIOD_US 20
+#define BULK_READ_CHUNK     1024
+
+RINGBUF_STATIC_ALLOC(bulk_ring, BULK_READ_BUF_SIZE);
+
+static struct {
+    bool active;
+    bool failed;
+    uint8_t ap;
+    uint32_t addr;
+    uint32_t length;
+    uint32_t offset;
+} br;
+
+static void bulk_read_job(void);
+
+static void bulk_read_stop(void) {
+    dap_job_stop(bulk_read_job);
+    br.active = false;
+}
+
+// Pass on the words read before the fault, offset is then the faulting one
+static void bulk_read_fail(void) {
+    uint32_t fault = dap_mem_fault_addr() - br.addr;
+
+    if (fault > br.offset && fault < br.length) {
+        ringbuf_produce(&bulk_ring, fault - br.offset);
+        br.offset = fault;
+    }
+    br.failed = true;
+    bulk_read_stop();
+}
+
+static void bulk_read_job(void) {
+    char *ptr;
+    int room;
+    uint32_t n;
+
+    ptr = ringbuf_puts_ptr(&bulk_ring, &room);
+    n = br.length - br.offset;
+    if (n > BULK_READ_CHUNK)
+        n = BULK_READ_CHUNK;
+    if (n > (uint32_t)room)
+        n = room & ~3;
+    if (n == 0)
+        return;
+
+    if (!dap_mem_acquire(br.ap)) {
+        br.failed = true;
+        bulk_read_stop();
+        return;
+    }
+    if (!dap_mem_read_block(br.addr + br.offset, (uint8_t *)ptr, n)) {
+        bulk_read_fail();
+        return;
+    }
+    ringbuf_produce(&bulk_ring, n);
+    br.offset += n;
+    if (br.offset == br.length)
+        bulk_read_stop();
+}
+
+static bool bulk_read_start(uint8_t ap, uint32_t addr, uint32_t length) {
+    bulk_read_stop();
+    stream_detach(&bulk_ring);
+    ringbuf_reset(&bulk_ring);
+
+    br.ap = ap;
+    br.addr = addr;
+    br.length = length;
+    br.offset = 0;
+    br.failed = false;
+    if ((addr | length) & 3 || length == 0)
+        return false;
+    if (!stream_attach(&bulk_ring))
+        return false;
+
+    br.active = dap_job_start(bulk_read_job, BULK_READ_PERIOD_US);
+    return br.active;
+}
+
+// Vendor command: request  [sub-command][parameters]
+//                 response [status][data]
+uint32_t bulk_read_command(const uint8_t *request, uint8_t *response) {
+    uint8_t *resp = response + 1;
+    uint32_t req_len = 1;
+    bool ok = true;
+
+    switch (*request) {
+    case BULK_READ_START:
+        // [ap][address u32][length u32], both word aligned
+        req_len += 9;
+        ok = bulk_read_start(request[1], get_u32(&request[2]), get_u32(&request[6]));
+        break;
+    case BULK_READ_ABORT:
+        bulk_read_stop();
+        stream_detach(&bulk_ring);
+        break;
+    case BULK_READ_STATUS:
+        // Bytes read from the target, after an error the offset of the
+        // word that failed, and how many of them are still queued for USB
+        *resp++ = br.active;
+        *resp++ = br.failed;
+        resp = put_u32(resp, br.offset);
+        resp = put_u32(resp, ringbuf_elements(&bulk_ring));
+        break;
+    default:
+        ok = false;
+        break;
+    }
+
+    *response = ok ? DAP_OK : DAP_ERROR;
+    return (req_len << 16) | (uint32_t)(resp - response);
+}
@@ -0,0 +1,146 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <pico/stdlib.h>
+
+#include "DAP_config.h"
+#include "DAP.h"
+#include "dap_vendor.h"
+#include "dap_mem.h"
+#include "probe_config.h"
+#include "bulk_write.h"
+
+/*
+ * RAM image loading without a DAP_TransferBlock header on every 14 words.
+ * After the open command the host sends the raw image on the DAP OUT
+ * endpoint. The packets land in the request slot ring like commands do, and
+ * the ring is the credit window: once all DAP_PACKET_COUNT slots are taken
+ * the endpoint NAKs until the probe has written a slot to the target. There
+ * is no response per packet, only a single one at the end with the result.
+ */
+static struct {
+    bool active;
+    bool failed;
+    uint8_t ap;
+    uint32_t addr;
+    uint32_t length;
+    uint32_t received;
+    uint32_t offset;
+} bw;
+
+// Offset of the first word the target did not take
+static void bulk_write_fail(void) {
+    uint32_t fault = dap_mem_fault_addr() - bw.addr;
+
+    if (fault >= bw.offset && fault < bw.length)
+        bw.offset = fault;
+    bw.failed = true;
+}
+
+bool bulk_write_active(void) {
+    return bw.active;
+}
+
+void bulk_write_packet(const uint8_t *buf) {
+    uint32_t n = bw.length - bw.received;
+
+    if (n > DAP_PACKET_SIZE)
+        n = DAP_PACKET_SIZE;
+
+    // After an error the rest of the data is only drained, offset marks the failure
+    if (!bw.failed) {
+        if (!dap_mem_acquire(bw.ap))
+            bw.failed = true;
+        else if (dap_mem_write_block(bw.addr + bw.offset, buf, n))
+            bw.offset += n;
+        else
+            bulk_write_fail();
+    }
+
+    bw.received += n;
+    if (bw.received == bw.length) {
+        // Nothing may be left posted behind the result, check the sticky error once more
+        if (!bw.failed && !dap_mem_sync()) {
+            bw.failed = true;
+            bw.offset = bw.length - 4;
+        }
+        bw.active = false;
+    }
+}
+
+uint32_t bulk_write_result(uint8_t *response) {
+    uint8_t *resp = response;
+
+    *resp++ = ID_DAP_VENDOR_BULK_WRITE;
+    *resp++ = bw.failed ? DAP_ERROR : DAP_OK;
+    resp = put_u32(resp, bw.offset);
+    return (uint32_t)(resp - response);
+}
+
+void bulk_write_cancel(void) {
+    bw.active = false;
+}
+
+// Vendor command: request  [sub-command][parameters]
+//                 response [status][data]
+uint32_t bulk_write_command(const uint8_t *request, uint8_t *response) {
+    uint8_t *resp = response + 1;
+    uint32_t req_len = 1;
+    bool ok = true;
+
+    switch (*request) {
+    case BULK_WRITE_OPEN:
+        // [ap][address u32][length u32], both word aligned -> [window][packet size u16]
+        req_len += 9;
+        bw.ap = request[1];
+        bw.addr = get_u32(&request[2]);
+        bw.length = get_u32(&request[6]);
+        bw.received = 0;
+        bw.offset = 0;
+        bw.failed = false;
+        ok = bw.length != 0 && ((bw.addr | bw.length) & 3) == 0;
+#if (PROBE_DEBUG_PROTOCOL != PROTO_DAP_V2)
+        // HID reports are not routed through the request slot ring
+        ok = false;
+#endif
+        bw.active = ok;
+        *resp++ = DAP_PACKET_COUNT;
+        resp = put_u16(resp, DAP_PACKET_SIZE);
+        break;
+    case BULK_WRITE_STATUS:
+        // Result of the last write, offset is where it failed
+        *resp++ = bw.active;
+        *resp++ = bw.failed;
+        resp = put_u32(resp, bw.offset);
+        break;
+    default:
+        ok = false;
+        break;
+    }
+
+    *response = ok ? DAP_OK : DAP_ERROR;
+    return (req_len << 16) | (uint32_t)(resp - response);
+}
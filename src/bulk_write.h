@@ -0,0 +1,49 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef BULK_WRITE_H_
+#define BULK_WRITE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Vendor command sub-commands
+#define BULK_WRITE_STATUS   0
+#define BULK_WRITE_OPEN     1
+
+/*
+ * While a write is open, the DAP thread passes OUT packets to
+ * bulk_write_packet() instead of executing them. Every packet but the last
+ * must be full. The response to the last one comes from bulk_write_result().
+ */
+bool bulk_write_active(void);
+void bulk_write_packet(const uint8_t *buf);
+uint32_t bulk_write_result(uint8_t *response);
+void bulk_write_cancel(void);
+
+uint32_t bulk_write_command(const uint8_t *request, uint8_t *response);
+
+#endif
@@ -32,4 +32,13 @@ bool cdc_task(void);
 
 extern TaskHandle_t uart_taskhandle;
 
+// UART vendor command sub-commands
+#define UART_STATS_READ     0
+#define UART_STATS_RESET    1
+#define UART_CAPTURE_START  2
+#define UART_CAPTURE_STOP   3
+#define UART_CAPTURE_STATUS 4
+
+uint32_t cdc_uart_command(const uint8_t *request, uint8_t *response);
+
 #endif
\ No newline at end of file
@@ -24,36 +24,145 @@
  *
  */
 
+#include <string.h>
 #include <pico/stdlib.h>
 #include "FreeRTOS.h"
 #include "task.h"
 #include "tusb.h"
 #include "probe_config.h"
 #include "ringbuf.h"
+#include "buf_pool.h"
+#include "pio_uart.h"
+#include "cdc_uart.h"
+#include "DAP.h"
+#include "dap_vendor.h"
+#include "tusb_stream.h"
+#include "uart_trigger.h"
+#include "uart_autobaud.h"
+#include "uart_capture.h"
 #include "hardware/dma.h"
+#include "hardware/gpio.h"
 
-#define RX_RINGBUF_SIZE (256)
-#define TX_RINGBUF_SIZE (1024)
-
-RINGBUF_STATIC_ALLOC(rx_ringbuf, RX_RINGBUF_SIZE);
-RINGBUF_STATIC_ALLOC(tx_ringbuf, TX_RINGBUF_SIZE);
+/*
+ * Ring sizes follow the line rate: RX holds UART_RX_BUFFER_MS of data at the
+ * current baud rate and TX half of that. Both come from the shared buffer
+ * pool, which is aligned for the RX DMA ring, and together stay within
+ * UART_POOL_BUDGET so the rest of the pool is left for other users.
+ */
+#define UART_RX_BUFFER_MS   20
+#define UART_RX_RING_MIN    256
+#define UART_TX_RING_MIN    1024
+#define UART_POOL_BUDGET    12288
+
+static struct ringbuf rx_ringbuf;
+static struct ringbuf tx_ringbuf;
+
+// Bridge counters, read and cleared with the UART DAP vendor command
+static struct {
+    uint32_t rx_bytes;
+    uint32_t tx_bytes;
+    uint32_t rx_high_water;
+    uint32_t tx_high_water;
+    uint32_t rx_overruns;       // RX ring lapped before the host read it
+    uint32_t fifo_overruns;     // PL011 FIFO overrun
+    uint32_t framing_errors;
+    uint32_t parity_errors;
+    uint32_t breaks;
+    uint32_t dma_restarts;
+} stats;
+
+#define UART_ERROR_BITS (UART_UARTRIS_FERIS_BITS | UART_UARTRIS_PERIS_BITS | \
+                         UART_UARTRIS_BERIS_BITS | UART_UARTRIS_OERIS_BITS)
+
+// Takes the error bits in UARTRIS layout
+static inline void uart_count_errors(uint32_t err) {
+    if (err & UART_UARTRIS_FERIS_BITS)
+        stats.framing_errors++;
+    if (err & UART_UARTRIS_PERIS_BITS)
+        stats.parity_errors++;
+    if (err & UART_UARTRIS_BERIS_BITS)
+        stats.breaks++;
+    if (err & UART_UARTRIS_OERIS_BITS)
+        stats.fifo_overruns++;
+}
 
 TaskHandle_t uart_taskhandle;
 
-TickType_t last_wake, interval = 100;
+/*
+ * The bridge sleeps until the RX line, the USB side or the TX DMA notify it.
+ * The timeout only bounds the cost of a missed wakeup and lets the LEDs go
+ * out.
+ */
+#define UART_BACKSTOP_MS 20
+
+#define DEBOUNCE_MS 25
+
+/*
+ * Without hardware flow control the bridge throttles the target itself: RTS
+ * is released (or XOFF sent, with PROBE_UART_XONXOFF) once the RX ring fills
+ * past the high watermark, and asserted again (XON) when the host has drained
+ * it below the low one. Both are percentages of the ring.
+ */
+#if !defined(PROBE_UART_HWFC) && (defined(PROBE_UART_RTS) || defined(PROBE_UART_XONXOFF))
+#define UART_SW_FLOW 1
+#ifndef PROBE_UART_RX_HIGH_WATER
+#define PROBE_UART_RX_HIGH_WATER 75
+#endif
+#ifndef PROBE_UART_RX_LOW_WATER
+#define PROBE_UART_RX_LOW_WATER 25
+#endif
+#define UART_XON  0x11
+#define UART_XOFF 0x13
+#else
+#define UART_SW_FLOW 0
+#endif
 
-// Actually s^-1 so 25ms
-#define DEBOUNCE_MS 40
-static uint debounce_ticks = 5;
+// Longest wait for queued TX data before a line coding change drops it
+#define UART_DRAIN_TIMEOUT_MS 500
 
 #ifdef PROBE_UART_TX_LED
-static volatile uint tx_led_debounce;
+static volatile uint32_t tx_led_debounce;
 #endif
 
 #ifdef PROBE_UART_RX_LED
-static uint rx_led_debounce;
+static uint32_t rx_led_debounce;
 #endif
 
+#if UART_SW_FLOW
+static bool rx_throttled;
+static bool host_rts;
+
+static void rx_flow_apply(void) {
+#ifdef PROBE_UART_XONXOFF
+    // In-band, behind whatever is already in the TX FIFO
+    uart_putc_raw(PROBE_UART_INTERFACE, rx_throttled ? UART_XOFF : UART_XON);
+#else
+    gpio_put(PROBE_UART_RTS, rx_throttled || !host_rts);
+#endif
+}
+
+static void rx_flow_update(void) {
+    int level = ringbuf_elements(&rx_ringbuf) * 100 / ringbuf_size(&rx_ringbuf);
+
+    if(!rx_throttled && level >= PROBE_UART_RX_HIGH_WATER){
+        rx_throttled = true;
+        rx_flow_apply();
+    } else if(rx_throttled && level <= PROBE_UART_RX_LOW_WATER){
+        rx_throttled = false;
+        rx_flow_apply();
+    }
+}
+#endif
+
+static inline void uart_bridge_notify_from_isr(void) {
+    BaseType_t woken = pdFALSE;
+
+    if (uart_taskhandle) {
+        vTaskNotifyGiveFromISR(uart_taskhandle, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
+
 #define CDC_INTERFACE 0
 
 #define DMA_OR_IRQ 1    // 1:DMA 0:IRQ
@@ -61,15 +170,110 @@ static uint rx_led_debounce;
 #if DMA_OR_IRQ
 static int uart_tx_dma_ch;
 static int uart_rx_dma_ch;
+static int uart_rx_ctrl_ch;
 
 static volatile int tx_dma_total = 0;
-static volatile int rx_dma_total = 0;
+
+/*
+ * RX never stops: the channel's write address wraps round rx_ringbuf in
+ * hardware, and when its transfer count runs out it chains to a control
+ * channel that reloads the count and retriggers it. The bridge publishes
+ * new bytes by reading back the write address. A power of two reload keeps
+ * the byte count exact across a reload, which 0xFFFFFFFF would be one off.
+ */
+static const uint32_t rx_dma_reload = 1u << 31;
+static uint32_t rx_dma_count;
+static dma_channel_config rx_config;
+
+/*
+ * The PL011 receive timeout never fires while DMA keeps its FIFO empty, so
+ * an idle line is detected on the RX pin instead. A falling edge after the
+ * bridge went quiet wakes it. Until the line has been idle for two
+ * characters the bridge sleeps between passes on a one-shot alarm rather
+ * than spinning, which still flushes the tail of a burst within two
+ * characters. At the top rates the alarm is held to UART_RX_POLL_MIN_US,
+ * well inside what the RX ring buffers.
+ */
+#define UART_RX_POLL_MIN_US 100
+
+static volatile uint32_t rx_last_activity;
+static uint32_t rx_idle_us = (2 * 10 * 1000 * 1000) / PROBE_UART_BAUDRATE;
+static volatile bool rx_poll_pending;
+
+static void rx_set_char_time(uint32_t baudrate) {
+    rx_idle_us = MAX(1, (2 * 10 * 1000 * 1000) / MAX(baudrate, 1));
+    uart_capture_set_char_time((10 * 1000 * 1000 * 1000ull) / MAX(baudrate, 1));
+}
+
+// Receive into rx_ringbuf from its current put position
+static void rx_dma_start(void) {
+    stats.dma_restarts++;
+    rx_dma_count = rx_dma_reload;
+    channel_config_set_ring(&rx_config, true, __builtin_ctz(ringbuf_size(&rx_ringbuf)));
+    channel_config_set_chain_to(&rx_config, uart_rx_ctrl_ch);
+    dma_channel_configure(uart_rx_dma_ch, &rx_config, &rx_ringbuf.data[rx_ringbuf.put_ptr],
+                          &(uart_get_hw(PROBE_UART_INTERFACE)->dr), rx_dma_reload, true);
+}
+
+static void rx_dma_stop(void) {
+    // Unchain first, an aborted channel can still fire its chain trigger
+    channel_config_set_chain_to(&rx_config, uart_rx_dma_ch);
+    dma_channel_set_config(uart_rx_dma_ch, &rx_config, false);
+    dma_channel_abort(uart_rx_dma_ch);
+    dma_channel_abort(uart_rx_ctrl_ch);
+}
+
+// Publish whatever the RX channel wrote since the last call, returns the number of new bytes
+static int rx_dma_sync(void) {
+    uint32_t put = ringbuf_dma_put(&rx_ringbuf, dma_channel_hw_addr(uart_rx_dma_ch)->write_addr);
+    uint32_t count = dma_channel_hw_addr(uart_rx_dma_ch)->transfer_count;
+    uint32_t received = ringbuf_dma_received(rx_dma_count, count, rx_dma_reload);
+    uint32_t intact;
+
+    rx_dma_count = count;
+    // After a lap only the newest bytes are still there to be looked at
+    intact = MIN(received, rx_ringbuf.mask);
+    if (received > 0)
+        uart_capture_feed(&rx_ringbuf, put - intact, intact, received - intact, time_us_32());
+    uart_trigger_feed(&rx_ringbuf, put - intact, intact);
+    if (ringbuf_dma_produce(&rx_ringbuf, put, received))
+        stats.rx_overruns++;
+    stats.rx_bytes += received;
+    return received;
+}
+
+static int64_t rx_poll_alarm_cb(alarm_id_t id, void *user_data) {
+    rx_poll_pending = false;
+    uart_bridge_notify_from_isr();
+    return 0;
+}
+
+// Wake the bridge for the next look at the RX ring, unless a wakeup is already due
+static void rx_poll_arm(void) {
+    if (rx_poll_pending)
+        return;
+    // Set first, the callback may run before add_alarm_in_us() returns
+    rx_poll_pending = true;
+    if (add_alarm_in_us(MAX(rx_idle_us, UART_RX_POLL_MIN_US), rx_poll_alarm_cb, NULL, true) < 0)
+        rx_poll_pending = false;
+}
+
+static void rx_edge_irq_handler(void) {
+    if (!(gpio_get_irq_event_mask(PROBE_UART_RX) & GPIO_IRQ_EDGE_FALL))
+        return;
+    gpio_acknowledge_irq(PROBE_UART_RX, GPIO_IRQ_EDGE_FALL);
+    // One shot, re-armed by the bridge when it goes idle again
+    gpio_set_irq_enabled(PROBE_UART_RX, GPIO_IRQ_EDGE_FALL, false);
+    rx_last_activity = time_us_32();
+    uart_bridge_notify_from_isr();
+}
 
 static void dma_irq0_handler() {
     if(dma_channel_get_irq0_status(uart_tx_dma_ch)) {
         dma_channel_acknowledge_irq0(uart_tx_dma_ch);
 
         ringbuf_consume(&tx_ringbuf, tx_dma_total);
+        stats.tx_bytes += tx_dma_total;
 
         int tx_len = 0;
         const char *tx_buf = ringbuf_get_ptr(&tx_ringbuf, &tx_len);
@@ -77,17 +281,17 @@ static void dma_irq0_handler() {
             tx_dma_total = tx_len;
             dma_channel_transfer_from_buffer_now(uart_tx_dma_ch, tx_buf, tx_len);
         }
+        // Room in the TX ring, more can be taken from the host
+        uart_bridge_notify_from_isr();
     }
+}
 
-    if(dma_channel_get_irq0_status(uart_rx_dma_ch)) {
-        dma_channel_acknowledge_irq0(uart_rx_dma_ch);
-
-        int dma_xfer_len = rx_dma_total - dma_channel_hw_addr(uart_rx_dma_ch)->transfer_count;
-        ringbuf_produce(&rx_ringbuf, dma_xfer_len);
+// Line errors aren't visible to the RX DMA, only their interrupts are enabled
+static void uart_error_irq_handler(void) {
+    uint32_t mis = uart_get_hw(PROBE_UART_INTERFACE)->mis & UART_ERROR_BITS;
 
-        char* rx_buf = ringbuf_puts_ptr(&rx_ringbuf, (int*)&rx_dma_total);
-        dma_channel_transfer_to_buffer_now(uart_rx_dma_ch, rx_buf, rx_dma_total);
-    }
+    uart_count_errors(mis);
+    uart_get_hw(PROBE_UART_INTERFACE)->icr = mis;
 }
 #else
 static void cdc_uart_irq_handler(void){
@@ -98,19 +302,104 @@ static void cdc_uart_irq_handler(void){
             if(c < 0)
                 break;
             uart_get_hw(PROBE_UART_INTERFACE)->dr = (char)c;
+            stats.tx_bytes++;
         }
     }
     if(uart_get_hw(PROBE_UART_INTERFACE)->ris & (UART_UARTRIS_RXRIS_BITS | UART_UARTRIS_RTRIS_BITS)){
         while(uart_is_readable(PROBE_UART_INTERFACE)){
-            ringbuf_put(&rx_ringbuf, (char)uart_get_hw(PROBE_UART_INTERFACE)->dr);
+            uint32_t c = uart_get_hw(PROBE_UART_INTERFACE)->dr;
+            // DR carries the errors of each character one bit above the UARTRIS layout
+            uart_count_errors((c >> 1) & UART_ERROR_BITS);
+            if(ringbuf_put(&rx_ringbuf, (char)c) < 0)
+                stats.rx_overruns++;
+            else
+                stats.rx_bytes++;
         }
         uart_get_hw(PROBE_UART_INTERFACE)->icr |= (UART_UARTICR_RTIC_BITS | UART_UARTICR_RXIC_BITS);
     }
     if(uart_get_hw(PROBE_UART_INTERFACE)->ris){
         uart_get_hw(PROBE_UART_INTERFACE)->icr |= 0xFFFFFFFF;
     }
+    uart_bridge_notify_from_isr();
+}
+#endif
+
+static void uart_rings_size(uint32_t baud, uint32_t *rx_size, uint32_t *tx_size) {
+    uint32_t bytes = baud / 10 * UART_RX_BUFFER_MS / 1000;
+
+    *rx_size = buf_pool_block_size(MAX(bytes, UART_RX_RING_MIN));
+    *tx_size = buf_pool_block_size(MAX(bytes / 2, UART_TX_RING_MIN));
+    while (*rx_size + *tx_size > UART_POOL_BUDGET) {
+        if (*rx_size >= *tx_size)
+            *rx_size >>= 1;
+        else
+            *tx_size >>= 1;
+    }
 }
+
+// Largest block up to size the pool can still give, 0 if none
+static uint32_t uart_ring_alloc(char **buf, uint32_t size) {
+    for (; size >= BUF_POOL_MIN_BLOCK; size >>= 1) {
+        *buf = buf_pool_alloc(size);
+        if (*buf)
+            return size;
+    }
+    return 0;
+}
+
+// Move the RX ring to a new block, keeping the unread data
+static void rx_ring_move(char *buf, uint32_t size) {
+    struct ringbuf old;
+    int n;
+
+#if DMA_OR_IRQ
+    if (rx_ringbuf.data) {
+        rx_dma_stop();
+        rx_dma_sync();
+    }
+#else
+    irq_set_enabled(UART1_IRQ, false);
 #endif
+    old = rx_ringbuf;
+    ringbuf_init(&rx_ringbuf, buf, size);
+    if (old.data) {
+        n = MIN(ringbuf_elements(&old), (int)size - 1);
+        ringbuf_consume(&old, ringbuf_elements(&old) - n);
+        ringbuf_gets(&old, buf, n);
+        rx_ringbuf.put_ptr = n;
+        buf_pool_free(old.data, ringbuf_size(&old));
+    }
+#if DMA_OR_IRQ
+    rx_dma_start();
+#else
+    irq_set_enabled(UART1_IRQ, true);
+#endif
+}
+
+/* Only called with the TX ring drained. RX is allocated first so the old TX
+ * block can't fragment the space it needs. */
+static void uart_rings_resize(uint32_t baud) {
+    uint32_t rx_size, tx_size, size;
+    char *buf;
+
+    uart_rings_size(baud, &rx_size, &tx_size);
+
+    if (tx_ringbuf.data)
+        buf_pool_free(tx_ringbuf.data, ringbuf_size(&tx_ringbuf));
+    tx_ringbuf.data = NULL;
+
+    if (!rx_ringbuf.data || rx_size != (uint32_t)ringbuf_size(&rx_ringbuf)) {
+        size = uart_ring_alloc(&buf, rx_size);
+        if (size)
+            rx_ring_move(buf, size);
+    }
+
+    size = uart_ring_alloc(&buf, tx_size);
+    if (!size)
+        panic("UART ring buffers don't fit in the pool\n");
+    ringbuf_init(&tx_ringbuf, buf, size);
+    probe_info("UART rings rx %d tx %d\n", ringbuf_size(&rx_ringbuf), ringbuf_size(&tx_ringbuf));
+}
 
 void cdc_uart_init(void) {
     gpio_set_function(PROBE_UART_TX, GPIO_FUNC_UART);
@@ -160,12 +449,14 @@ void cdc_uart_init(void) {
 #endif
 
 #if DMA_OR_IRQ == 0
+    uart_rings_resize(PROBE_UART_BAUDRATE);
     uart_set_irq_enables(PROBE_UART_INTERFACE, true, true);
     irq_set_exclusive_handler(UART1_IRQ, cdc_uart_irq_handler);
     irq_set_enabled(UART1_IRQ, true);
 #else
     uart_tx_dma_ch = dma_claim_unused_channel(true);
     uart_rx_dma_ch = dma_claim_unused_channel(true);
+    uart_rx_ctrl_ch = dma_claim_unused_channel(true);
 
     dma_channel_config tx_config = dma_channel_get_default_config(uart_tx_dma_ch);
     channel_config_set_transfer_data_size(&tx_config, DMA_SIZE_8);
@@ -176,21 +467,32 @@ void cdc_uart_init(void) {
     dma_channel_set_config(uart_tx_dma_ch, &tx_config, false);
     dma_channel_set_irq0_enabled(uart_tx_dma_ch, true);
 
-    dma_channel_config rx_config = dma_channel_get_default_config(uart_rx_dma_ch);
+    rx_config = dma_channel_get_default_config(uart_rx_dma_ch);
     channel_config_set_transfer_data_size(&rx_config, DMA_SIZE_8);
     channel_config_set_read_increment(&rx_config, false);
     channel_config_set_write_increment(&rx_config, true);
     channel_config_set_dreq(&rx_config, uart_get_dreq_num(PROBE_UART_INTERFACE, false));
-    dma_channel_set_read_addr(uart_rx_dma_ch, &(uart_get_hw(PROBE_UART_INTERFACE)->dr), false);
-    dma_channel_set_config(uart_rx_dma_ch, &rx_config, false);
-    dma_channel_set_irq0_enabled(uart_rx_dma_ch, true);
+
+    /* The control channel writes the reload count to the RX channel's count trigger alias */
+    dma_channel_config ctrl_config = dma_channel_get_default_config(uart_rx_ctrl_ch);
+    channel_config_set_transfer_data_size(&ctrl_config, DMA_SIZE_32);
+    channel_config_set_read_increment(&ctrl_config, false);
+    channel_config_set_write_increment(&ctrl_config, false);
+    dma_channel_configure(uart_rx_ctrl_ch, &ctrl_config, &dma_hw->ch[uart_rx_dma_ch].al1_transfer_count_trig,
+                          &rx_dma_reload, 1, false);
 
     irq_set_exclusive_handler(DMA_IRQ_0, dma_irq0_handler);
     irq_set_enabled(DMA_IRQ_0, true);
 
+    gpio_add_raw_irq_handler(PROBE_UART_RX, rx_edge_irq_handler);
+    irq_set_enabled(IO_IRQ_BANK0, true);
+
     /* start dma recv */
-    char* rx_buf = ringbuf_puts_ptr(&rx_ringbuf, (int*)&rx_dma_total);
-    dma_channel_transfer_to_buffer_now(uart_rx_dma_ch, rx_buf, rx_dma_total);
+    uart_rings_resize(PROBE_UART_BAUDRATE);
+
+    uart_get_hw(PROBE_UART_INTERFACE)->imsc = UART_ERROR_BITS;
+    irq_set_exclusive_handler(UART1_IRQ, uart_error_irq_handler);
+    irq_set_enabled(UART1_IRQ, true);
 #endif
 }
 
@@ -198,15 +500,11 @@ bool cdc_task(void){
     bool keep_alive = false;
 
 #ifdef PROBE_UART_TX_LED
-    if (tx_led_debounce)
-        tx_led_debounce--;
-    else
+    if (time_us_32() - tx_led_debounce > DEBOUNCE_MS * 1000)
         gpio_put(PROBE_UART_TX_LED, 0);
 #endif
 #ifdef PROBE_UART_RX_LED
-    if (rx_led_debounce)
-        rx_led_debounce--;
-    else
+    if (time_us_32() - rx_led_debounce > DEBOUNCE_MS * 1000)
         gpio_put(PROBE_UART_RX_LED, 0);
 #endif
 
@@ -220,13 +518,16 @@ bool cdc_task(void){
 
 #if DMA_OR_IRQ == 0
             ringbuf_produce(&tx_ringbuf, xfer_len);
+            stats.tx_high_water = MAX(stats.tx_high_water, (uint32_t)ringbuf_elements(&tx_ringbuf));
             while(uart_is_writable(PROBE_UART_INTERFACE) && ringbuf_elements(&tx_ringbuf) > 0){
                 char c = ringbuf_get(&tx_ringbuf);
                 uart_get_hw(PROBE_UART_INTERFACE)->dr = c;
+                stats.tx_bytes++;
             }
 #else
             irq_set_enabled(DMA_IRQ_0, false);
             ringbuf_produce(&tx_ringbuf, xfer_len);
+            stats.tx_high_water = MAX(stats.tx_high_water, (uint32_t)ringbuf_elements(&tx_ringbuf));
             if(dma_channel_is_busy(uart_tx_dma_ch) == false &&
                dma_channel_get_irq0_status(uart_tx_dma_ch) == false){
                 int tx_len = 0;
@@ -238,25 +539,29 @@ bool cdc_task(void){
             }
             irq_set_enabled(DMA_IRQ_0, true);
 #endif
-        }
-        keep_alive = true;
+            keep_alive = true;
 
 #ifdef PROBE_UART_TX_LED
-        gpio_put(PROBE_UART_TX_LED, 1);
-        tx_led_debounce = debounce_ticks;
+            gpio_put(PROBE_UART_TX_LED, 1);
+            tx_led_debounce = time_us_32();
 #endif
+        }
+        /* With the TX ring full the data stays in the CDC FIFO and USB NAKs the
+         * host, the TX completion notification brings us back */
     }
 
-    if(tud_cdc_n_write_available(CDC_INTERFACE)){
 #if DMA_OR_IRQ
-        irq_set_enabled(DMA_IRQ_0, false);
-        int dma_xfer_len = rx_dma_total - dma_channel_hw_addr(uart_rx_dma_ch)->transfer_count;
-        if(dma_xfer_len > 0){
-            ringbuf_produce(&rx_ringbuf, dma_xfer_len);
-            rx_dma_total -= dma_xfer_len;
-        }
-        irq_set_enabled(DMA_IRQ_0, true);
+    if(uart_capture_pending())
+        uart_capture_apply();
+    if(uart_trigger_pending())
+        uart_trigger_apply();
+    if(rx_dma_sync() > 0)
+        rx_last_activity = time_us_32();
+    uart_capture_poll(time_us_32());
 #endif
+    stats.rx_high_water = MAX(stats.rx_high_water, (uint32_t)ringbuf_elements(&rx_ringbuf));
+
+    if(tud_cdc_n_write_available(CDC_INTERFACE)){
         const char* rx_buf;
         int rx_buf_len;
         rx_buf = ringbuf_get_ptr(&rx_ringbuf, &rx_buf_len);
@@ -264,113 +569,129 @@ bool cdc_task(void){
         if(xfer_len > 0){
             tud_cdc_n_write(CDC_INTERFACE, rx_buf, xfer_len);
             tud_cdc_n_write_flush(CDC_INTERFACE);
-#if DMA_OR_IRQ
-            irq_set_enabled(DMA_IRQ_0, false);
-            ringbuf_consume(&rx_ringbuf, xfer_len);
-            irq_set_enabled(DMA_IRQ_0, true);
-#else
             ringbuf_consume(&rx_ringbuf, xfer_len);
-#endif
             keep_alive = true;
 
 #ifdef PROBE_UART_RX_LED
             gpio_put(PROBE_UART_RX_LED, 1);
-            rx_led_debounce = debounce_ticks;
+            rx_led_debounce = time_us_32();
 #endif
         }
     }
 
+#if UART_SW_FLOW
+    rx_flow_update();
+#endif
+
+#if DMA_OR_IRQ
+    /* Only data moved keeps the bridge running. While the line is busy it
+     * sleeps until the poll alarm, once idle the next start bit wakes it. */
+    if(!keep_alive){
+        if(time_us_32() - rx_last_activity < rx_idle_us){
+            rx_poll_arm();
+        } else {
+            uart_capture_flush();
+            gpio_set_irq_enabled(PROBE_UART_RX, GPIO_IRQ_EDGE_FALL, true);
+        }
+    }
+#endif
+
     return keep_alive;
 }
 
 static int uart_resetting;
-static uint32_t new_baudrate;
-static uint32_t new_data_bits;
-static uint32_t new_stop_bits;
-static uart_parity_t new_parity;
+static uint32_t new_baudrate = PROBE_UART_BAUDRATE;
+static uint32_t new_data_bits = 8;
+static uint32_t new_stop_bits = 1;
+static uart_parity_t new_parity = UART_PARITY_NONE;
+
+/*
+ * Switch line settings in place. Data the host already sent goes out at the
+ * old settings, then the divider and frame format are reprogrammed once the
+ * shifter is idle. RX DMA keeps running throughout, so the line is only dead
+ * for the LCR_H update itself.
+ */
+static void uart_reconfigure(void)
+{
+    uint32_t start = time_us_32();
+
+    while(ringbuf_elements(&tx_ringbuf) > 0){
+        if(time_us_32() - start > UART_DRAIN_TIMEOUT_MS * 1000){
+            /* Stuck, e.g. on CTS, drop what is left */
+#if DMA_OR_IRQ
+            irq_set_enabled(DMA_IRQ_0, false);
+            dma_channel_abort(uart_tx_dma_ch);
+            dma_channel_acknowledge_irq0(uart_tx_dma_ch);
+            tx_dma_total = 0;
+            ringbuf_reset(&tx_ringbuf);
+            irq_set_enabled(DMA_IRQ_0, true);
+#else
+            ringbuf_reset(&tx_ringbuf);
+#endif
+            break;
+        }
+        vTaskDelay(1);
+    }
+    while(uart_get_hw(PROBE_UART_INTERFACE)->fr & UART_UARTFR_BUSY_BITS){
+        if(time_us_32() - start > UART_DRAIN_TIMEOUT_MS * 1000)
+            break;
+        tight_loop_contents();
+    }
+
+    uart_rings_resize(new_baudrate);
+    uart_set_baudrate(PROBE_UART_INTERFACE, new_baudrate);
+    uart_set_format(PROBE_UART_INTERFACE, new_data_bits, new_stop_bits, new_parity);
+}
 
 void cdc_thread(void *ptr)
 {
-    BaseType_t delayed;
-    last_wake = xTaskGetTickCount();
     bool keep_alive;
+    uint32_t baudrate;
 
 #if (configNUMBER_OF_CORES > 1)
     vTaskCoreAffinitySet(NULL, 1 << 0);
 #endif
 
-    /* Threaded with a polling interval that scales according to linerate */
+    /* Run while there is data to move, otherwise wait for a notification */
     while (1) {
         keep_alive = cdc_task();
-        if (!keep_alive) {
-            delayed = xTaskDelayUntil(&last_wake, interval);
-            if (delayed == pdFALSE)
-                last_wake = xTaskGetTickCount();
-        }
+        if (!keep_alive)
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(UART_BACKSTOP_MS));
 
         if(uart_resetting){
-            vTaskDelay(pdMS_TO_TICKS(50));
             uart_resetting = 0;
+            uart_reconfigure();
+        }
 
-            /* Abort UART transfer */
-#if DMA_OR_IRQ == 1
-            irq_set_enabled(DMA_IRQ_0, false);
-            dma_channel_set_irq0_enabled(uart_rx_dma_ch, false);
-            dma_channel_abort(uart_rx_dma_ch);
-            dma_channel_acknowledge_irq0(uart_rx_dma_ch);
-            dma_channel_set_irq0_enabled(uart_tx_dma_ch, false);
-            dma_channel_abort(uart_tx_dma_ch);
-            dma_channel_acknowledge_irq0(uart_tx_dma_ch);
-#else
-            uart_set_irq_enables(PROBE_UART_INTERFACE, true, true);
-#endif
-
-            /* Disable the UART */
-            uart_deinit(PROBE_UART_INTERFACE);
-
-            /* Clear ringbuffers */
-            ringbuf_reset(&rx_ringbuf);
-            ringbuf_reset(&tx_ringbuf);
-            tud_cdc_n_write_clear(CDC_INTERFACE);
-            tud_cdc_n_read_flush(CDC_INTERFACE);
-
-            /* Reinitialize the UART */
-            uart_init(PROBE_UART_INTERFACE, new_baudrate);
-            uart_set_format(PROBE_UART_INTERFACE, new_data_bits, new_stop_bits, new_parity);
-            while(uart_is_readable(PROBE_UART_INTERFACE)){
-                uart_getc(PROBE_UART_INTERFACE);
-            }
-
-            /* Enable the UART IRQ */
-#if DMA_OR_IRQ == 1
-            dma_channel_set_irq0_enabled(uart_rx_dma_ch, true);
-            dma_channel_set_irq0_enabled(uart_tx_dma_ch, true);
-            irq_set_enabled(DMA_IRQ_0, true);
-            char* rx_buf = ringbuf_puts_ptr(&rx_ringbuf, (int*)&rx_dma_total);
-            dma_channel_transfer_to_buffer_now(uart_rx_dma_ch, rx_buf, rx_dma_total);
-#else
-            uart_set_irq_enables(PROBE_UART_INTERFACE, true, true);
+        /* Auto-baud only changes the rate, the frame format stays as the host set it */
+        baudrate = uart_autobaud_poll();
+        if(baudrate){
+            probe_info("Auto-baud rate %ld\n", baudrate);
+#if DMA_OR_IRQ
+            rx_set_char_time(baudrate);
 #endif
+            new_baudrate = baudrate;
+            uart_reconfigure();
         }
     }
 }
 
 void tud_cdc_line_coding_cb(uint8_t itf, cdc_line_coding_t const* line_coding)
 {
+#if PROBE_PIO_UART_COUNT
+    if(pio_uart_line_coding(itf, line_coding))
+        return;
+#endif
     if(itf != CDC_INTERFACE)
         return;
     uart_parity_t parity;
     uint data_bits, stop_bits;
-    /* Set the tick thread interval to the amount of time it takes to
-     * fill up half a FIFO. Millis is too coarse for integer divide.
-     */
-    uint32_t micros = (1000 * 1000 * 16 * 10) / MAX(line_coding->bit_rate, 1);
     /* Modifying state, so park the thread before changing it. */
     vTaskSuspend(uart_taskhandle);
-    interval = MAX(1, micros / ((1000 * 1000) / configTICK_RATE_HZ));
-    debounce_ticks = MAX(1, configTICK_RATE_HZ / (interval * DEBOUNCE_MS));
-    probe_info("New baud rate %ld micros %ld interval %lu\n",
-                                    line_coding->bit_rate, micros, interval);
+#if DMA_OR_IRQ
+    rx_set_char_time(line_coding->bit_rate);
+#endif
+    probe_info("New baud rate %ld\n", line_coding->bit_rate);
 
     new_baudrate = line_coding->bit_rate;
 
@@ -429,7 +750,12 @@ void tud_cdc_line_state_cb(uint8_t itf, bool dtr, bool rts)
 {
     if(itf != CDC_INTERFACE)
         return;
-#ifdef PROBE_UART_RTS
+#if UART_SW_FLOW
+    host_rts = rts;
+#endif
+#if UART_SW_FLOW && !defined(PROBE_UART_XONXOFF)
+    gpio_put(PROBE_UART_RTS, rx_throttled || !rts);
+#elif defined(PROBE_UART_RTS)
     gpio_put(PROBE_UART_RTS, !rts);
 #endif
 #ifdef PROBE_UART_DTR
@@ -451,3 +777,62 @@ void tud_cdc_line_state_cb(uint8_t itf, bool dtr, bool rts)
     } else
         vTaskResume(uart_taskhandle);
 }
+
+void tud_cdc_rx_cb(uint8_t itf)
+{
+    if(itf == CDC_INTERFACE && uart_taskhandle)
+        xTaskNotifyGive(uart_taskhandle);
+#if PROBE_PIO_UART_COUNT
+    else
+        pio_uart_notify(itf);
+#endif
+}
+
+void tud_cdc_tx_complete_cb(uint8_t itf)
+{
+    /* The host took a packet, there may be room for more RX data */
+    if(itf == CDC_INTERFACE && uart_taskhandle)
+        xTaskNotifyGive(uart_taskhandle);
+#if PROBE_PIO_UART_COUNT
+    else
+        pio_uart_notify(itf);
+#endif
+}
+
+// Vendor command: request  [sub-command]
+//                 response [status][data]
+uint32_t cdc_uart_command(const uint8_t *request, uint8_t *response) {
+    uint8_t *resp = response + 1;
+    uint32_t req_len = 1;
+    const uint32_t *counter = (const uint32_t *)&stats;
+    bool ok = true;
+    unsigned int i;
+
+    switch (*request) {
+    case UART_STATS_READ:
+        for (i = 0; i < sizeof(stats) / sizeof(uint32_t); i++)
+            resp = put_u32(resp, counter[i]);
+        break;
+    case UART_STATS_RESET:
+        memset(&stats, 0, sizeof(stats));
+        break;
+#if DMA_OR_IRQ
+    case UART_CAPTURE_START:
+    case UART_CAPTURE_STOP:
+        // The bridge thread takes the stream endpoint once the port is open
+        uart_capture_request(*request == UART_CAPTURE_START);
+        if (uart_taskhandle)
+            xTaskNotifyGive(uart_taskhandle);
+        break;
+    case UART_CAPTURE_STATUS:
+        resp = uart_capture_status(resp);
+        break;
+#endif
+    default:
+        ok = false;
+        break;
+    }
+
+    *response = ok ? DAP_OK : DAP_ERROR;
+    return (req_len << 16) | (uint32_t)(resp - response);
+}
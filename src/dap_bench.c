@@ -0,0 +1,95 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <pico/stdlib.h>
+
+#include "DAP_config.h"
+#include "DAP.h"
+#include "dap_vendor.h"
+#include "dap_mem.h"
+#include "dap_bench.h"
+
+/*
+ * Times back-to-back reads of one target word. Each read is a DRW/RDBUFF
+ * pair through SWD_Transfer(), so the spread between the fastest and slowest
+ * read shows how much the SWD engine stalls, e.g. on XIP cache misses while
+ * the UART is busy. Build with and without PROBE_HOT_PATH_IN_RAM to compare.
+ */
+static inline int bench_bucket(uint32_t us) {
+    int b = 0;
+
+    while (us && b < DAP_BENCH_BUCKETS - 1) {
+        us >>= 1;
+        b++;
+    }
+    return b;
+}
+
+// Vendor command: request  [sub-command][parameters]
+//                 response [status][data]
+uint32_t dap_bench_command(const uint8_t *request, uint8_t *response) {
+    uint8_t *resp = response + 1;
+    uint32_t req_len = 1;
+    uint16_t hist[DAP_BENCH_BUCKETS] = { 0 };
+    uint32_t min = 0xFFFFFFFFu, max = 0, total, start, t, val;
+    uint32_t addr, i, count;
+    bool ok = true;
+
+    switch (*request) {
+    case DAP_BENCH_READ:
+        // [ap][address u32][count u16] -> [in RAM][done u16][min][max][total us][histogram u16...]
+        req_len += 7;
+        addr = get_u32(&request[2]);
+        count = get_u16(&request[6]);
+        ok = dap_mem_acquire(request[1]);
+        total = time_us_32();
+        for (i = 0; ok && i < count; i++) {
+            start = time_us_32();
+            ok = dap_mem_read(addr, 4, &val);
+            t = time_us_32() - start;
+            if (t < min)
+                min = t;
+            if (t > max)
+                max = t;
+            hist[bench_bucket(t)]++;
+        }
+        total = time_us_32() - total;
+        *resp++ = PROBE_HOT_PATH_IN_RAM;
+        resp = put_u16(resp, i);
+        resp = put_u32(resp, min);
+        resp = put_u32(resp, max);
+        resp = put_u32(resp, total);
+        for (i = 0; i < DAP_BENCH_BUCKETS; i++)
+            resp = put_u16(resp, hist[i]);
+        break;
+    default:
+        ok = false;
+        break;
+    }
+
+    *response = ok ? DAP_OK : DAP_ERROR;
+    return (req_len << 16) | (uint32_t)(resp - response);
+}
@@ -0,0 +1,147 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <pico/stdlib.h>
+
+#include "DAP_config.h"
+#include "DAP.h"
+#include "dap_vendor.h"
+#include "dap_mem.h"
+#include "dap_crc.h"
+
+/*
+ * Target memory is read in blocks and hashed on the probe, so a verify
+ * only returns the digest instead of the data. The table lookup costs a
+ * few cycles per byte, far less than SWD takes to fetch it.
+ */
+#define CRC_CHUNK   1024
+#define CRC_POLY    0x04C11DB7U
+
+static uint32_t crc_table[256];
+static uint8_t crc_buf[CRC_CHUNK];
+
+static void crc_table_init(void) {
+    uint32_t c;
+    int i, j;
+
+    for (i = 0; i < 256; i++) {
+        c = (uint32_t)i << 24;
+        for (j = 0; j < 8; j++)
+            c = (c & 0x80000000u) ? (c << 1) ^ CRC_POLY : (c << 1);
+        crc_table[i] = c;
+    }
+}
+
+uint32_t dap_crc32(uint32_t crc, const uint8_t *buf, uint32_t len) {
+    if (crc_table[1] == 0)
+        crc_table_init();
+
+    while (len--)
+        crc = (crc << 8) ^ crc_table[((crc >> 24) ^ *buf++) & 0xFF];
+    return crc;
+}
+
+bool dap_crc_target(uint32_t addr, uint32_t len, uint32_t *crc) {
+    uint32_t c = *crc;
+    uint32_t n, val;
+    uint8_t b;
+
+    // Unaligned head and tail go byte by byte, the rest in word blocks
+    while (len && ((addr & 3) || len < 4)) {
+        if (!dap_mem_read(addr, 1, &val))
+            return false;
+        b = (uint8_t)val;
+        c = dap_crc32(c, &b, 1);
+        addr++;
+        len--;
+    }
+    while (len >= 4) {
+        n = len & ~3u;
+        if (n > CRC_CHUNK)
+            n = CRC_CHUNK;
+        if (!dap_mem_read_block(addr, crc_buf, n))
+            return false;
+        c = dap_crc32(c, crc_buf, n);
+        addr += n;
+        len -= n;
+    }
+    while (len) {
+        if (!dap_mem_read(addr, 1, &val))
+            return false;
+        b = (uint8_t)val;
+        c = dap_crc32(c, &b, 1);
+        addr++;
+        len--;
+    }
+
+    *crc = c;
+    return true;
+}
+
+// Vendor command: request  [sub-command][parameters]
+//                 response [status][data]
+uint32_t dap_crc_command(const uint8_t *request, uint8_t *response) {
+    uint8_t *resp = response + 1;
+    uint32_t req_len = 1;
+    uint32_t addr, len, crc;
+    bool ok = true;
+    int n;
+
+    switch (*request) {
+    case DAP_CRC_RANGE:
+        // [ap][address u32][length u32] -> [crc u32]
+        req_len += 9;
+        addr = get_u32(&request[2]);
+        len = get_u32(&request[6]);
+        crc = DAP_CRC_INIT;
+        ok = dap_mem_acquire(request[1]) && dap_crc_target(addr, len, &crc);
+        resp = put_u32(resp, crc);
+        break;
+    case DAP_CRC_SECTORS:
+        // [ap][address u32][sector size u32][count] -> [count][crc u32]...
+        req_len += 10;
+        addr = get_u32(&request[2]);
+        len = get_u32(&request[6]);
+        n = request[10];
+        if (n > (DAP_PACKET_SIZE - 3) / 4)
+            n = (DAP_PACKET_SIZE - 3) / 4;
+        ok = dap_mem_acquire(request[1]);
+        *resp++ = n;
+        while (ok && n--) {
+            crc = DAP_CRC_INIT;
+            ok = dap_crc_target(addr, len, &crc);
+            resp = put_u32(resp, crc);
+            addr += len;
+        }
+        break;
+    default:
+        ok = false;
+        break;
+    }
+
+    *response = ok ? DAP_OK : DAP_ERROR;
+    return (req_len << 16) | (uint32_t)(resp - response);
+}
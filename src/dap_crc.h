@@ -0,0 +1,50 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef DAP_CRC_H_
+#define DAP_CRC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Vendor command sub-commands
+#define DAP_CRC_RANGE       0
+#define DAP_CRC_SECTORS     1
+
+/*
+ * CRC-32 as GDB's qCRC and Black Magic compute it: polynomial 0x04C11DB7,
+ * MSB first, initial value 0xFFFFFFFF, no final inversion.
+ */
+#define DAP_CRC_INIT        0xFFFFFFFFU
+
+uint32_t dap_crc32(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+// CRC of target memory read through the MEM-AP, which must be acquired
+bool dap_crc_target(uint32_t addr, uint32_t len, uint32_t *crc);
+
+uint32_t dap_crc_command(const uint8_t *request, uint8_t *response);
+
+#endif
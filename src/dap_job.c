@@ -0,0 +1,145 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <pico/stdlib.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "probe_config.h"
+#include "dap_job.h"
+#include "tusb_edpt_handler.h"
+
+static struct dap_job {
+    dap_job_fn fn;
+    volatile bool due;
+    repeating_timer_t timer;
+} jobs[DAP_JOB_MAX];
+
+static bool dap_job_timer(repeating_timer_t *rt) {
+    struct dap_job *job = rt->user_data;
+    BaseType_t yield;
+
+    job->due = true;
+    yield = xTaskResumeFromISR(dap_taskhandle);
+    portYIELD_FROM_ISR(yield);
+    return true;
+}
+
+bool dap_job_start(dap_job_fn fn, uint32_t period_us) {
+    struct dap_job *job = NULL;
+    int i;
+
+#if (PROBE_DEBUG_PROTOCOL != PROTO_DAP_V2)
+    // HID reports are handled on the USB thread, a job would race them for the bus
+    return false;
+#endif
+
+    dap_job_stop(fn);
+    for (i = 0; i < DAP_JOB_MAX; i++) {
+        if (!jobs[i].fn) {
+            job = &jobs[i];
+            break;
+        }
+    }
+    if (!job)
+        return false;
+
+    job->due = false;
+    job->fn = fn;
+    job->timer.alarm_id = 0;
+    if (period_us == 0)
+        return true;
+
+    if (period_us < DAP_JOB_MIN_PERIOD_US)
+        period_us = DAP_JOB_MIN_PERIOD_US;
+
+    // Negative delay: period is measured start to start
+    if (!add_repeating_timer_us(-(int64_t)period_us, dap_job_timer, job, &job->timer)) {
+        job->fn = NULL;
+        return false;
+    }
+    return true;
+}
+
+void dap_job_stop(dap_job_fn fn) {
+    int i;
+
+    for (i = 0; i < DAP_JOB_MAX; i++) {
+        if (jobs[i].fn == fn) {
+            if (jobs[i].timer.alarm_id)
+                cancel_repeating_timer(&jobs[i].timer);
+            jobs[i].fn = NULL;
+            jobs[i].due = false;
+        }
+    }
+}
+
+void dap_job_stop_all(void) {
+    int i;
+
+    for (i = 0; i < DAP_JOB_MAX; i++) {
+        if (jobs[i].fn)
+            dap_job_stop(jobs[i].fn);
+    }
+}
+
+void dap_job_kick(dap_job_fn fn) {
+    int i;
+
+    for (i = 0; i < DAP_JOB_MAX; i++) {
+        if (jobs[i].fn == fn) {
+            jobs[i].due = true;
+            vTaskResume(dap_taskhandle);
+        }
+    }
+}
+
+void dap_job_kick_from_isr(dap_job_fn fn) {
+    BaseType_t yield = pdFALSE;
+    int i;
+
+    for (i = 0; i < DAP_JOB_MAX; i++) {
+        if (jobs[i].fn == fn) {
+            jobs[i].due = true;
+            yield = xTaskResumeFromISR(dap_taskhandle);
+        }
+    }
+    portYIELD_FROM_ISR(yield);
+}
+
+void dap_job_run(void) {
+    dap_job_fn fn;
+    int i;
+
+    for (i = 0; i < DAP_JOB_MAX; i++) {
+        fn = jobs[i].fn;
+        if (fn && jobs[i].due) {
+            jobs[i].due = false;
+            fn();
+        }
+    }
+}
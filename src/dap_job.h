@@ -0,0 +1,56 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef DAP_JOB_H_
+#define DAP_JOB_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Background work that needs the debug port. A job is run by the DAP thread
+ * once per period, between host commands, so it never races a DAP transfer.
+ * The period comes from a hardware timer, which wakes the DAP thread. A job
+ * started with a period of 0 only runs when another thread kicks it.
+ */
+#define DAP_JOB_MAX             4
+#define DAP_JOB_MIN_PERIOD_US   20
+
+typedef void (*dap_job_fn)(void);
+
+bool dap_job_start(dap_job_fn fn, uint32_t period_us);
+void dap_job_stop(dap_job_fn fn);
+void dap_job_stop_all(void);
+
+// Run the job on the DAP thread's next pass, from task context
+void dap_job_kick(dap_job_fn fn);
+// The same from an interrupt handler or alarm callback
+void dap_job_kick_from_isr(dap_job_fn fn);
+
+// Called from the DAP thread, runs every job that is due
+void dap_job_run(void);
+
+#endif
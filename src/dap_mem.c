@@ -0,0 +1,264 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "DAP_config.h"
+#include "DAP.h"
+#include "dap_mem.h"
+#include "dap_vendor.h"
+
+// MEM-AP registers in bank 0
+#define MEM_AP_CSW  0x00U
+#define MEM_AP_TAR  0x04U
+#define MEM_AP_DRW  0x0CU
+
+#define CSW_SIZE_MASK   0x07U
+#define CSW_ADDRINC     0x30U
+#define CSW_ADDRINC_SINGLE 0x10U
+
+// TAR auto-increment is only guaranteed within a 1 KiB block
+#define TAR_WRAP        0x400U
+
+// STKCMPCLR | STKERRCLR | WDERRCLR | ORUNERRCLR
+#define DP_ABORT_CLEAR  0x1EU
+
+uint32_t swd_dp_select;
+
+static struct {
+    bool owned;
+    uint8_t ap;
+    // Host state to put back on release
+    uint32_t select;
+    uint32_t csw;
+    uint32_t tar;
+    // What the AP is currently set to
+    uint32_t cur_csw;
+    uint32_t cur_tar;
+    bool tar_valid;
+    // First address a failed write did not reach or a failed block read did not return
+    uint32_t fault_addr;
+} mem;
+
+static uint8_t mem_xfer(uint32_t request, uint32_t *data) {
+    uint32_t retry = DAP_Data.transfer.retry_count;
+    uint8_t ack;
+
+    do {
+        ack = SWD_Transfer(request, data);
+    } while (ack == DAP_TRANSFER_WAIT && retry-- && !DAP_TransferAbort);
+
+    if (ack == DAP_TRANSFER_FAULT) {
+        uint32_t clear = DP_ABORT_CLEAR;
+        SWD_Transfer(DP_ABORT, &clear);
+        // Whatever was in flight may or may not have updated TAR
+        mem.tar_valid = false;
+    }
+    return ack;
+}
+
+static bool dp_write(uint32_t reg, uint32_t val) {
+    return mem_xfer(reg, &val) == DAP_TRANSFER_OK;
+}
+
+static bool ap_write(uint32_t reg, uint32_t val) {
+    return mem_xfer(DAP_TRANSFER_APnDP | reg, &val) == DAP_TRANSFER_OK;
+}
+
+// AP reads are posted, the value comes back with the RDBUFF read
+static bool ap_read(uint32_t reg, uint32_t *val) {
+    if (mem_xfer(DAP_TRANSFER_APnDP | DAP_TRANSFER_RnW | reg, NULL) != DAP_TRANSFER_OK)
+        return false;
+    return mem_xfer(DAP_TRANSFER_RnW | DP_RDBUFF, val) == DAP_TRANSFER_OK;
+}
+
+bool dap_mem_acquire(uint8_t ap) {
+    if (mem.owned && mem.ap == ap)
+        return true;
+    dap_mem_release();
+
+    if (DAP_Data.debug_port != DAP_PORT_SWD)
+        return false;
+
+    mem.select = swd_dp_select;
+    if (!dp_write(DP_SELECT, (uint32_t)ap << 24) ||
+        !ap_read(MEM_AP_CSW, &mem.csw) ||
+        !ap_read(MEM_AP_TAR, &mem.tar)) {
+        dp_write(DP_SELECT, mem.select);
+        return false;
+    }
+
+    mem.owned = true;
+    mem.ap = ap;
+    mem.cur_csw = mem.csw;
+    mem.cur_tar = mem.tar;
+    mem.tar_valid = true;
+    return true;
+}
+
+void dap_mem_release(void) {
+    if (!mem.owned)
+        return;
+    mem.owned = false;
+
+    if (mem.cur_csw != mem.csw)
+        ap_write(MEM_AP_CSW, mem.csw);
+    if (!mem.tar_valid || mem.cur_tar != mem.tar)
+        ap_write(MEM_AP_TAR, mem.tar);
+    dp_write(DP_SELECT, mem.select);
+}
+
+// Single transfers run with auto-increment off, so TAR can be left pointing
+// at a location that is polled over and over
+static bool mem_setup(uint32_t addr, uint8_t size, uint32_t inc) {
+    uint32_t csw = (mem.csw & ~(CSW_SIZE_MASK | CSW_ADDRINC)) | inc | (size >> 1);
+
+    if (!mem.owned || (addr & (size - 1)) != 0)
+        return false;
+
+    if (csw != mem.cur_csw) {
+        if (!ap_write(MEM_AP_CSW, csw))
+            return false;
+        mem.cur_csw = csw;
+    }
+    if (!mem.tar_valid || addr != mem.cur_tar) {
+        if (!ap_write(MEM_AP_TAR, addr))
+            return false;
+        mem.cur_tar = addr;
+        mem.tar_valid = true;
+    }
+    return true;
+}
+
+bool dap_mem_read(uint32_t addr, uint8_t size, uint32_t *val) {
+    uint32_t data;
+
+    if (!mem_setup(addr, size, 0) || !ap_read(MEM_AP_DRW, &data))
+        return false;
+
+    // Narrow accesses come back on their byte lanes
+    data >>= (addr & 3) * 8;
+    if (size < 4)
+        data &= (1u << (size * 8)) - 1;
+    *val = data;
+    return true;
+}
+
+bool dap_mem_sync(void) {
+    return mem_xfer(DAP_TRANSFER_RnW | DP_RDBUFF, NULL) == DAP_TRANSFER_OK;
+}
+
+uint32_t dap_mem_fault_addr(void) {
+    return mem.fault_addr;
+}
+
+bool dap_mem_write(uint32_t addr, uint8_t size, uint32_t val) {
+    mem.fault_addr = addr;
+    if (!mem_setup(addr, size, 0))
+        return false;
+    // The write is posted, only the RDBUFF read after it shows whether it faulted
+    return ap_write(MEM_AP_DRW, val << ((addr & 3) * 8)) && dap_mem_sync();
+}
+
+static inline uint32_t block_chunk(uint32_t addr, uint32_t len) {
+    uint32_t room = TAR_WRAP - (addr & (TAR_WRAP - 1));
+    return len < room ? len : room;
+}
+
+bool dap_mem_read_block(uint32_t addr, uint8_t *buf, uint32_t len) {
+    uint32_t chunk, data, n;
+
+    mem.fault_addr = addr;
+    if ((addr | len) & 3)
+        return false;
+
+    while (len) {
+        mem.fault_addr = addr;
+        chunk = block_chunk(addr, len);
+        if (!mem_setup(addr, 4, CSW_ADDRINC_SINGLE))
+            return false;
+        // TAR moves on with every access
+        mem.tar_valid = false;
+
+        // Reads are posted: each DRW read returns the previous word, RDBUFF the last one
+        if (mem_xfer(DAP_TRANSFER_APnDP | DAP_TRANSFER_RnW | MEM_AP_DRW, NULL) != DAP_TRANSFER_OK)
+            return false;
+        for (n = 4; n < chunk; n += 4) {
+            if (mem_xfer(DAP_TRANSFER_APnDP | DAP_TRANSFER_RnW | MEM_AP_DRW, &data) != DAP_TRANSFER_OK) {
+                // It would have returned the word before, which is where a FAULT belongs
+                mem.fault_addr = addr + n - 4;
+                return false;
+            }
+            buf = put_u32(buf, data);
+        }
+        if (mem_xfer(DAP_TRANSFER_RnW | DP_RDBUFF, &data) != DAP_TRANSFER_OK) {
+            mem.fault_addr = addr + chunk - 4;
+            return false;
+        }
+        buf = put_u32(buf, data);
+
+        addr += chunk;
+        len -= chunk;
+    }
+    return true;
+}
+
+bool dap_mem_write_block(uint32_t addr, const uint8_t *buf, uint32_t len) {
+    uint32_t chunk, data, n;
+    uint8_t ack;
+
+    mem.fault_addr = addr;
+    if ((addr | len) & 3)
+        return false;
+
+    while (len) {
+        mem.fault_addr = addr;
+        chunk = block_chunk(addr, len);
+        if (!mem_setup(addr, 4, CSW_ADDRINC_SINGLE))
+            return false;
+        mem.tar_valid = false;
+
+        for (n = 0; n < chunk; n += 4) {
+            data = get_u32(buf);
+            ack = mem_xfer(DAP_TRANSFER_APnDP | MEM_AP_DRW, &data);
+            if (ack != DAP_TRANSFER_OK) {
+                // Writes are posted, a FAULT belongs to the word before
+                if (ack == DAP_TRANSFER_FAULT && n)
+                    n -= 4;
+                mem.fault_addr = addr + n;
+                return false;
+            }
+            buf += 4;
+        }
+        // Check the last word of the chunk before moving on
+        if (!dap_mem_sync()) {
+            mem.fault_addr = addr + chunk - 4;
+            return false;
+        }
+
+        addr += chunk;
+        len -= chunk;
+    }
+    return true;
+}
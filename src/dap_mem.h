@@ -0,0 +1,69 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef DAP_MEM_H_
+#define DAP_MEM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Target memory access through a MEM-AP, for work the probe does on its own
+ * between host commands. The AP state the host relies on (SELECT, CSW and
+ * TAR) is saved when the bus is acquired and put back by dap_mem_release(),
+ * which runs at the end of every vendor command and before the DAP thread
+ * runs the next host command. As long as the host stays quiet the bus
+ * remains set up between background jobs, so repeated accesses only cost
+ * the DRW/RDBUFF pair.
+ *
+ * Only SWD is supported, and only from the DAP thread.
+ */
+
+// Last value the host wrote to DP SELECT, kept up to date by SWD_Transfer()
+extern uint32_t swd_dp_select;
+
+bool dap_mem_acquire(uint8_t ap);
+void dap_mem_release(void);
+
+// size is 1, 2 or 4 bytes, the address must be aligned to it
+bool dap_mem_read(uint32_t addr, uint8_t size, uint32_t *val);
+bool dap_mem_write(uint32_t addr, uint8_t size, uint32_t val);
+
+// Word accesses with auto-increment, address and length must be word aligned
+bool dap_mem_read_block(uint32_t addr, uint8_t *buf, uint32_t len);
+bool dap_mem_write_block(uint32_t addr, const uint8_t *buf, uint32_t len);
+
+/*
+ * AP writes are posted and only report a fault on the access after them.
+ * The write functions check RDBUFF before they return, dap_mem_sync() does
+ * the same on its own. After a failed write, dap_mem_fault_addr() is the
+ * first address that was not written, after a failed dap_mem_read_block()
+ * the first word that was not read into buf.
+ */
+bool dap_mem_sync(void);
+uint32_t dap_mem_fault_addr(void);
+
+#endif
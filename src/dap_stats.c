@@ -0,0 +1,116 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "DAP_config.h"
+#include "DAP.h"
+#include "dap_vendor.h"
+#include "dap_stats.h"
+
+/*
+ * Every command named in dap_cmd_string gets its own histograms, vendor
+ * commands share one set and anything else lands in slot 0. Recording is a
+ * table lookup, a clz and an increment, cheap enough to leave on.
+ */
+#define STATS_SLOT_OTHER    0
+#define STATS_SLOT_VENDOR   1
+#define STATS_SLOTS         32
+
+extern char *dap_cmd_string[ID_DAP_ExecuteCommands + 1];
+
+static uint8_t stats_slot[ID_DAP_ExecuteCommands + 1];
+static bool stats_slot_ready;
+static uint32_t stats[STATS_SLOTS][DAP_STATS_STAGES][DAP_STATS_BUCKETS];
+
+static void stats_slot_init(void) {
+    uint8_t next = STATS_SLOT_VENDOR + 1;
+    int i;
+
+    for (i = 0; i <= ID_DAP_ExecuteCommands; i++) {
+        if (dap_cmd_string[i] && next < STATS_SLOTS)
+            stats_slot[i] = next++;
+        else
+            stats_slot[i] = STATS_SLOT_OTHER;
+    }
+    stats_slot_ready = true;
+}
+
+static inline uint8_t stats_slot_of(uint8_t cmd) {
+    if (cmd <= ID_DAP_ExecuteCommands)
+        return stats_slot[cmd];
+    if (cmd >= ID_DAP_Vendor0 && cmd <= ID_DAP_Vendor31)
+        return STATS_SLOT_VENDOR;
+    return STATS_SLOT_OTHER;
+}
+
+void __probe_hot_func(dap_stats_record)(uint8_t cmd, uint8_t stage, uint32_t us) {
+    uint32_t b;
+
+    if (!stats_slot_ready)
+        stats_slot_init();
+
+    b = us ? 32 - __builtin_clz(us) : 0;
+    if (b >= DAP_STATS_BUCKETS)
+        b = DAP_STATS_BUCKETS - 1;
+    stats[stats_slot_of(cmd)][stage][b]++;
+}
+
+// Vendor command: request  [sub-command][parameters]
+//                 response [status][data]
+uint32_t dap_stats_command(const uint8_t *request, uint8_t *response) {
+    uint8_t *resp = response + 1;
+    uint32_t req_len = 1;
+    uint32_t *hist;
+    bool ok = true;
+    int i;
+
+    if (!stats_slot_ready)
+        stats_slot_init();
+
+    switch (*request) {
+    case DAP_STATS_READ:
+        // [command id][stage] -> [bucket u32]...
+        req_len += 2;
+        ok = request[2] < DAP_STATS_STAGES;
+        if (!ok)
+            break;
+        hist = stats[stats_slot_of(request[1])][request[2]];
+        for (i = 0; i < DAP_STATS_BUCKETS; i++)
+            resp = put_u32(resp, hist[i]);
+        break;
+    case DAP_STATS_RESET:
+        memset(stats, 0, sizeof(stats));
+        break;
+    default:
+        ok = false;
+        break;
+    }
+
+    *response = ok ? DAP_OK : DAP_ERROR;
+    return (req_len << 16) | (uint32_t)(resp - response);
+}
@@ -0,0 +1,53 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef DAP_STATS_H_
+#define DAP_STATS_H_
+
+#include <stdint.h>
+
+/*
+ * Per command latency histograms. Bucket 0 counts times under 1 us, bucket
+ * n times from 2^(n-1) up to 2^n us, the last bucket everything longer.
+ */
+#define DAP_STATS_BUCKETS   12
+
+enum dap_stats_stage {
+    DAP_STATS_QUEUE = 0,    // USB receipt to execution start
+    DAP_STATS_EXEC,         // Execution
+    DAP_STATS_REPLY,        // Execution end to IN completion
+    DAP_STATS_STAGES,
+};
+
+// Vendor command sub-commands
+#define DAP_STATS_READ      0
+#define DAP_STATS_RESET     1
+
+void dap_stats_record(uint8_t cmd, uint8_t stage, uint32_t us);
+
+uint32_t dap_stats_command(const uint8_t *request, uint8_t *response);
+
+#endif
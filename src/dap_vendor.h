@@ -0,0 +1,79 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef DAP_VENDOR_H_
+#define DAP_VENDOR_H_
+
+#include "DAP.h"
+
+/*
+ * Debugprobe specific vendor commands. Every command is
+ *   request:  [ID][sub-command][parameters]
+ *   response: [ID][DAP_OK/DAP_ERROR][data]
+ */
+#define ID_DAP_VENDOR_SWD_CAPTURE   ID_DAP_Vendor0
+#define ID_DAP_VENDOR_ITM           ID_DAP_Vendor1
+#define ID_DAP_VENDOR_PC_SAMPLE     ID_DAP_Vendor2
+#define ID_DAP_VENDOR_MEM_SAMPLE    ID_DAP_Vendor3
+#define ID_DAP_VENDOR_FLASH_EXEC    ID_DAP_Vendor4
+#define ID_DAP_VENDOR_CRC           ID_DAP_Vendor5
+#define ID_DAP_VENDOR_FLASH_DIFF    ID_DAP_Vendor6
+#define ID_DAP_VENDOR_FLASH_UNPACK  ID_DAP_Vendor7
+#define ID_DAP_VENDOR_BULK_READ     ID_DAP_Vendor8
+#define ID_DAP_VENDOR_BULK_WRITE    ID_DAP_Vendor9
+#define ID_DAP_VENDOR_BENCH         ID_DAP_Vendor10
+#define ID_DAP_VENDOR_STATS         ID_DAP_Vendor11
+#define ID_DAP_VENDOR_UART          ID_DAP_Vendor12
+#define ID_DAP_VENDOR_UART_TRIGGER  ID_DAP_Vendor13
+#define ID_DAP_VENDOR_UART_AUTOBAUD ID_DAP_Vendor14
+
+// Little endian field helpers for vendor command payloads
+static inline uint16_t get_u16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)(p[0] <<  0) |
+           (uint32_t)(p[1] <<  8) |
+           (uint32_t)(p[2] << 16) |
+           (uint32_t)(p[3] << 24);
+}
+
+static inline uint8_t *put_u16(uint8_t *p, uint16_t v) {
+    *p++ = (uint8_t)(v >> 0);
+    *p++ = (uint8_t)(v >> 8);
+    return p;
+}
+
+static inline uint8_t *put_u32(uint8_t *p, uint32_t v) {
+    *p++ = (uint8_t)(v >>  0);
+    *p++ = (uint8_t)(v >>  8);
+    *p++ = (uint8_t)(v >> 16);
+    *p++ = (uint8_t)(v >> 24);
+    return p;
+}
+
+#endif
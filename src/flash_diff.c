@@ -0,0 +1,170 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "DAP_config.h"
+#include "DAP.h"
+#include "dap_vendor.h"
+#include "dap_mem.h"
+#include "dap_crc.h"
+#include "flash_diff.h"
+
+/*
+ * Sector manifest for incremental flashing. The host sends the address and
+ * expected CRC-32 of every sector in the new image. The probe hashes what is
+ * in the target flash now and keeps a bitmap of the sectors that differ, so
+ * the host only erases and programs those.
+ */
+static struct {
+    uint32_t addr;
+    uint32_t crc;
+} sectors[FLASH_DIFF_MAX_SECTORS];
+
+static uint8_t dirty[FLASH_DIFF_MAX_SECTORS / 8];
+// Sectors hashed at least once since the manifest was configured
+static uint8_t checked[FLASH_DIFF_MAX_SECTORS / 8];
+
+static struct {
+    uint8_t ap;
+    uint16_t count;
+    uint16_t checked;
+    uint16_t dirty;
+    uint32_t sector_size;
+} diff;
+
+static inline bool test_bit(const uint8_t *map, int i) {
+    return map[i / 8] & (1u << (i % 8));
+}
+
+static inline void set_bit(uint8_t *map, int i) {
+    map[i / 8] |= 1u << (i % 8);
+}
+
+static inline void clear_bit(uint8_t *map, int i) {
+    map[i / 8] &= ~(1u << (i % 8));
+}
+
+static bool flash_diff_check(uint16_t first, uint16_t n) {
+    uint32_t crc;
+    int i;
+
+    if (!dap_mem_acquire(diff.ap))
+        return false;
+
+    for (i = first; i < first + n && i < diff.count; i++) {
+        crc = DAP_CRC_INIT;
+        if (!dap_crc_target(sectors[i].addr, diff.sector_size, &crc))
+            return false;
+        // A range can be checked again after programming, the counts follow the bitmaps
+        if (crc != sectors[i].crc && !test_bit(dirty, i)) {
+            set_bit(dirty, i);
+            diff.dirty++;
+        } else if (crc == sectors[i].crc && test_bit(dirty, i)) {
+            clear_bit(dirty, i);
+            diff.dirty--;
+        }
+        if (!test_bit(checked, i)) {
+            set_bit(checked, i);
+            diff.checked++;
+        }
+    }
+    return true;
+}
+
+// Vendor command: request  [sub-command][parameters]
+//                 response [status][data]
+uint32_t flash_diff_command(const uint8_t *request, uint8_t *response) {
+    uint8_t *resp = response + 1;
+    uint32_t req_len = 1;
+    uint16_t first;
+    bool ok = true;
+    int i, n;
+
+    switch (*request) {
+    case FLASH_DIFF_CONFIG:
+        // [ap][sector size u32], empties the manifest
+        req_len += 5;
+        memset(dirty, 0, sizeof(dirty));
+        memset(checked, 0, sizeof(checked));
+        memset(&diff, 0, sizeof(diff));
+        diff.ap = request[1];
+        diff.sector_size = get_u32(&request[2]);
+        ok = diff.sector_size != 0;
+        break;
+    case FLASH_DIFF_ADD:
+        // [count][address u32, crc u32]..., at most FLASH_DIFF_ADD_MAX entries
+        n = request[1];
+        if (n > FLASH_DIFF_ADD_MAX)
+            n = 0;
+        req_len += 1 + n * 8;
+        ok = n > 0 && diff.count + n <= FLASH_DIFF_MAX_SECTORS;
+        for (i = 0; ok && i < n; i++) {
+            sectors[diff.count].addr = get_u32(&request[2 + i * 8]);
+            sectors[diff.count].crc = get_u32(&request[6 + i * 8]);
+            diff.count++;
+        }
+        resp = put_u16(resp, diff.count);
+        break;
+    case FLASH_DIFF_CHECK:
+        // [first u16][count u16], lets the host split a big image over several commands
+        req_len += 4;
+        ok = diff.sector_size != 0 &&
+             flash_diff_check(get_u16(&request[1]), get_u16(&request[3]));
+        resp = put_u16(resp, diff.checked);
+        resp = put_u16(resp, diff.dirty);
+        break;
+    case FLASH_DIFF_READ:
+        // [first u16], first must be a multiple of 8 -> [count u16][dirty bitmap]
+        req_len += 2;
+        first = get_u16(&request[1]);
+        ok = (first % 8) == 0;
+        n = 0;
+        if (ok && first < diff.count) {
+            n = (diff.count - first + 7) / 8;
+            if (n > DAP_PACKET_SIZE - 4)
+                n = DAP_PACKET_SIZE - 4;
+        }
+        resp = put_u16(resp, diff.count);
+        if (n > 0)
+            memcpy(resp, &dirty[first / 8], n);
+        resp += n;
+        break;
+    case FLASH_DIFF_STATUS:
+        resp = put_u32(resp, diff.sector_size);
+        resp = put_u16(resp, diff.count);
+        resp = put_u16(resp, diff.checked);
+        resp = put_u16(resp, diff.dirty);
+        break;
+    default:
+        ok = false;
+        break;
+    }
+
+    *response = ok ? DAP_OK : DAP_ERROR;
+    return (req_len << 16) | (uint32_t)(resp - response);
+}
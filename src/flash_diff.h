@@ -0,0 +1,46 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef FLASH_DIFF_H_
+#define FLASH_DIFF_H_
+
+#include <stdint.h>
+
+#define FLASH_DIFF_MAX_SECTORS  512
+
+// Manifest entries per add command: ID, sub-command and count, then 8 bytes each
+#define FLASH_DIFF_ADD_MAX      ((DAP_PACKET_SIZE - 3) / 8)
+
+// Vendor command sub-commands
+#define FLASH_DIFF_STATUS   0
+#define FLASH_DIFF_CONFIG   1
+#define FLASH_DIFF_ADD      2
+#define FLASH_DIFF_CHECK    3
+#define FLASH_DIFF_READ     4
+
+uint32_t flash_diff_command(const uint8_t *request, uint8_t *response);
+
+#endif
@@ -0,0 +1,350 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "DAP_config.h"
+#include "DAP.h"
+#include "dap_vendor.h"
+#include "dap_mem.h"
+#include "flash_exec.h"
+
+/*
+ * Runs the ProgramPage() entry of a CMSIS flash algorithm the host has
+ * already loaded into target RAM. Page data arrives in vendor packets and
+ * is gathered on the probe. A full page is copied to one of two target RAM
+ * buffers while the target is still programming the previous page from the
+ * other buffer, and then the core is pointed at ProgramPage() again. The
+ * host only sends data and never polls the core itself.
+ */
+#define DCB_DHCSR       0xE000EDF0U
+#define DCB_DCRSR       0xE000EDF4U
+#define DCB_DCRDR       0xE000EDF8U
+
+#define DHCSR_DBGKEY    (0xA05Fu << 16)
+#define DHCSR_C_DEBUGEN (1u << 0)
+#define DHCSR_C_HALT    (1u << 1)
+#define DHCSR_CTRL_MASK 0xFFFFu
+#define DHCSR_S_REGRDY  (1u << 16)
+#define DHCSR_S_HALT    (1u << 17)
+#define DCRSR_REGWnR    (1u << 16)
+
+#define REG_R0      0
+#define REG_R1      1
+#define REG_R2      2
+#define REG_R9      9
+#define REG_SP      13
+#define REG_LR      14
+#define REG_PC      15
+#define REG_XPSR    16
+
+#define XPSR_THUMB  (1u << 24)
+
+#define REGRDY_RETRIES  100
+
+#define FLASH_EXEC_DEFAULT_TIMEOUT_MS   1000
+
+static uint8_t page_buf[FLASH_EXEC_MAX_PAGE] __attribute__((aligned(4)));
+
+static struct {
+    bool configured;
+    bool busy;
+    bool failed;
+    uint8_t ap;
+    uint8_t cur;
+    uint32_t program_page;
+    uint32_t breakpoint;
+    uint32_t static_base;
+    uint32_t stack;
+    uint32_t buf[2];
+    uint32_t page_size;
+    uint32_t timeout_us;
+    uint8_t erased;
+    // Page being gathered on the probe
+    uint32_t page_addr;
+    uint32_t fill;
+    // Page the target is programming
+    uint32_t busy_addr;
+    uint32_t started;
+    uint32_t pages;
+    uint32_t skipped;
+    uint32_t result;
+    uint32_t error_addr;
+} fx;
+
+static bool core_write_reg(uint32_t reg, uint32_t val) {
+    uint32_t dhcsr;
+    int i;
+
+    if (!dap_mem_write(DCB_DCRDR, 4, val) ||
+        !dap_mem_write(DCB_DCRSR, 4, reg | DCRSR_REGWnR))
+        return false;
+    for (i = 0; i < REGRDY_RETRIES; i++) {
+        if (!dap_mem_read(DCB_DHCSR, 4, &dhcsr))
+            return false;
+        if (dhcsr & DHCSR_S_REGRDY)
+            return true;
+    }
+    return false;
+}
+
+static bool core_read_reg(uint32_t reg, uint32_t *val) {
+    uint32_t dhcsr;
+    int i;
+
+    if (!dap_mem_write(DCB_DCRSR, 4, reg))
+        return false;
+    for (i = 0; i < REGRDY_RETRIES; i++) {
+        if (!dap_mem_read(DCB_DHCSR, 4, &dhcsr))
+            return false;
+        if (dhcsr & DHCSR_S_REGRDY)
+            return dap_mem_read(DCB_DCRDR, 4, val);
+    }
+    return false;
+}
+
+static void flash_exec_fail(uint32_t addr, uint32_t result) {
+    fx.failed = true;
+    fx.error_addr = addr;
+    fx.result = result;
+}
+
+// Wait for the page on the target to finish, true if it was programmed
+static bool flash_exec_wait(void) {
+    uint32_t dhcsr, r0 = 0xFFFFFFFFu;
+
+    if (!fx.busy)
+        return !fx.failed;
+
+    do {
+        if (!dap_mem_acquire(fx.ap) || !dap_mem_read(DCB_DHCSR, 4, &dhcsr)) {
+            fx.busy = false;
+            flash_exec_fail(fx.busy_addr, 0xFFFFFFFFu);
+            return false;
+        }
+        if (dhcsr & DHCSR_S_HALT)
+            break;
+        if (time_us_32() - fx.started > fx.timeout_us) {
+            // Stop the runaway algorithm so the host finds the core halted
+            dap_mem_write(DCB_DHCSR, 4, DHCSR_DBGKEY | DHCSR_C_DEBUGEN | DHCSR_C_HALT);
+            fx.busy = false;
+            flash_exec_fail(fx.busy_addr, 0xFFFFFFFFu);
+            return false;
+        }
+    } while (1);
+
+    fx.busy = false;
+    if (!core_read_reg(REG_R0, &r0) || r0 != 0) {
+        flash_exec_fail(fx.busy_addr, r0);
+        return false;
+    }
+    fx.pages++;
+    return true;
+}
+
+static bool flash_exec_run(uint32_t addr, uint32_t buf) {
+    uint32_t dhcsr;
+
+    if (!core_write_reg(REG_R0, addr) ||
+        !core_write_reg(REG_R1, fx.page_size) ||
+        !core_write_reg(REG_R2, buf) ||
+        !core_write_reg(REG_R9, fx.static_base) ||
+        !core_write_reg(REG_SP, fx.stack) ||
+        !core_write_reg(REG_LR, fx.breakpoint) ||
+        !core_write_reg(REG_PC, fx.program_page) ||
+        !core_write_reg(REG_XPSR, XPSR_THUMB))
+        return false;
+
+    // Only drop C_HALT, the host may have set C_MASKINTS for the algorithm
+    if (!dap_mem_read(DCB_DHCSR, 4, &dhcsr))
+        return false;
+    fx.busy_addr = addr;
+    fx.started = time_us_32();
+    fx.busy = true;
+    return dap_mem_write(DCB_DHCSR, 4, DHCSR_DBGKEY | (dhcsr & DHCSR_CTRL_MASK & ~DHCSR_C_HALT));
+}
+
+static bool page_is_erased(uint32_t len) {
+    const uint32_t *p = (const uint32_t *)page_buf;
+    uint32_t erased = fx.erased * 0x01010101u;
+    uint32_t i;
+
+    for (i = 0; i < len / 4; i++) {
+        if (p[i] != erased)
+            return false;
+    }
+    return true;
+}
+
+// Hand the gathered page to the target
+static bool flash_exec_commit(void) {
+    uint32_t buf = fx.buf[fx.cur];
+    uint32_t len = (fx.page_size + 3) & ~3u;
+
+    // Pad a partial page, and the last word of an odd-sized one
+    if (fx.fill < len)
+        memset(&page_buf[fx.fill], fx.erased, len - fx.fill);
+
+    // ProgramPage() runs on erased flash, blank pages would not change a bit
+    if (page_is_erased(len)) {
+        fx.skipped++;
+        fx.page_addr += fx.page_size;
+        fx.fill = 0;
+        return true;
+    }
+
+    // The other buffer may still be in use, this one is free
+    if (!dap_mem_acquire(fx.ap) || !dap_mem_write_block(buf, page_buf, len)) {
+        flash_exec_fail(fx.page_addr, 0xFFFFFFFFu);
+        return false;
+    }
+    if (!flash_exec_wait())
+        return false;
+    if (!flash_exec_run(fx.page_addr, buf)) {
+        fx.busy = false;
+        flash_exec_fail(fx.page_addr, 0xFFFFFFFFu);
+        return false;
+    }
+
+    fx.cur ^= 1;
+    fx.page_addr += fx.page_size;
+    fx.fill = 0;
+    return true;
+}
+
+static bool flash_exec_config(const uint8_t *p) {
+    uint32_t dhcsr;
+
+    // Never lose track of a page that is still being programmed
+    flash_exec_wait();
+    memset(&fx, 0, sizeof(fx));
+    fx.ap = p[0];
+    fx.program_page = get_u32(&p[1]);
+    fx.breakpoint = get_u32(&p[5]);
+    fx.static_base = get_u32(&p[9]);
+    fx.stack = get_u32(&p[13]);
+    fx.buf[0] = get_u32(&p[17]);
+    fx.buf[1] = get_u32(&p[21]);
+    fx.page_size = get_u16(&p[25]);
+    fx.timeout_us = get_u16(&p[27]) * 1000u;
+    fx.erased = p[29];
+    if (fx.timeout_us == 0)
+        fx.timeout_us = FLASH_EXEC_DEFAULT_TIMEOUT_MS * 1000u;
+
+    if (fx.page_size == 0 || fx.page_size > FLASH_EXEC_MAX_PAGE)
+        return false;
+    // Registers can only be set up on a halted core
+    if (!dap_mem_acquire(fx.ap) || !dap_mem_read(DCB_DHCSR, 4, &dhcsr) || !(dhcsr & DHCSR_S_HALT))
+        return false;
+
+    fx.configured = true;
+    return true;
+}
+
+bool flash_exec_ready(void) {
+    return fx.configured && !fx.failed;
+}
+
+bool flash_exec_write(const uint8_t *data, uint32_t len) {
+    uint32_t n;
+
+    if (!flash_exec_ready())
+        return false;
+
+    while (len) {
+        n = fx.page_size - fx.fill;
+        if (n > len)
+            n = len;
+        memcpy(&page_buf[fx.fill], data, n);
+        fx.fill += n;
+        data += n;
+        len -= n;
+        if (fx.fill == fx.page_size && !flash_exec_commit())
+            return false;
+    }
+    return true;
+}
+
+// Vendor command: request  [sub-command][parameters]
+//                 response [status][data]
+uint32_t flash_exec_command(const uint8_t *request, uint8_t *response) {
+    uint8_t *resp = response + 1;
+    uint32_t req_len = 1;
+    uint32_t len;
+    bool ok = true;
+
+    switch (*request) {
+    case FLASH_EXEC_CONFIG:
+        // [ap][ProgramPage u32][breakpoint u32][static base u32][stack u32]
+        // [buffer 0 u32][buffer 1 u32][page size u16][page timeout ms u16]
+        // [erased value], the algorithm's FlashDevice.valEmpty
+        req_len += 30;
+        ok = flash_exec_config(&request[1]);
+        break;
+    case FLASH_EXEC_PAGE:
+        // [flash address u32], following data is programmed from here on
+        req_len += 4;
+        ok = fx.configured && !fx.failed && fx.fill == 0;
+        if (ok)
+            fx.page_addr = get_u32(&request[1]);
+        break;
+    case FLASH_EXEC_DATA:
+        // [length][data], a page is started every time one fills up
+        len = request[1];
+        if (len > DAP_PACKET_SIZE - 3)
+            len = DAP_PACKET_SIZE - 3;
+        req_len += 1 + len;
+        ok = flash_exec_write(&request[2], len);
+        break;
+    case FLASH_EXEC_FLUSH:
+        // Program a partial page padded as erased, then wait for the target
+        ok = fx.configured;
+        if (ok && fx.fill && !fx.failed)
+            flash_exec_commit();
+        if (ok)
+            ok = flash_exec_wait();
+        resp = put_u32(resp, fx.pages);
+        resp = put_u32(resp, fx.result);
+        resp = put_u32(resp, fx.error_addr);
+        break;
+    case FLASH_EXEC_STATUS:
+        *resp++ = fx.configured;
+        *resp++ = fx.busy;
+        *resp++ = fx.failed;
+        resp = put_u32(resp, fx.pages);
+        resp = put_u32(resp, fx.skipped);
+        resp = put_u32(resp, fx.result);
+        resp = put_u32(resp, fx.error_addr);
+        break;
+    default:
+        ok = false;
+        break;
+    }
+
+    *response = ok ? DAP_OK : DAP_ERROR;
+    return (req_len << 16) | (uint32_t)(resp - response);
+}
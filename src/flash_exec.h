@@ -0,0 +1,48 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef FLASH_EXEC_H_
+#define FLASH_EXEC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define FLASH_EXEC_MAX_PAGE     4096
+
+// Vendor command sub-commands
+#define FLASH_EXEC_STATUS   0
+#define FLASH_EXEC_CONFIG   1
+#define FLASH_EXEC_PAGE     2
+#define FLASH_EXEC_DATA     3
+#define FLASH_EXEC_FLUSH    4
+
+// Feed page data from another producer, e.g. the decompressor
+bool flash_exec_ready(void);
+bool flash_exec_write(const uint8_t *data, uint32_t len);
+
+uint32_t flash_exec_command(const uint8_t *request, uint8_t *response);
+
+#endif
@@ -0,0 +1,186 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "DAP_config.h"
+#include "DAP.h"
+#include "dap_vendor.h"
+#include "flash_exec.h"
+#include "flash_unpack.h"
+
+/*
+ * heatshrink decoder in front of the flash executor. Images are mostly
+ * padding and tables, so they shrink 2-4x and USB full speed is what limits
+ * flashing. The decoded bytes go through flash_exec_write(), which also skips
+ * pages that come out fully erased.
+ *
+ * Stream format (heatshrink, MSB first): a 1 tag bit is followed by an 8 bit
+ * literal, a 0 tag bit by a back-reference of window_bits index and
+ * lookahead_bits count, both stored minus one.
+ */
+#define UNPACK_OUT_SIZE 256
+
+enum unpack_state {
+    UNPACK_TAG = 0,
+    UNPACK_LITERAL,
+    UNPACK_INDEX,
+    UNPACK_COUNT,
+};
+
+static uint8_t window[1u << FLASH_UNPACK_MAX_WINDOW];
+static uint8_t out_buf[UNPACK_OUT_SIZE];
+
+static struct {
+    bool active;
+    bool failed;
+    uint8_t state;
+    uint8_t window_bits;
+    uint8_t lookahead_bits;
+    uint8_t nbits;
+    uint32_t acc;
+    uint32_t index;
+    uint32_t head;
+    uint32_t out_len;
+    uint32_t bytes_in;
+    uint32_t bytes_out;
+} un;
+
+static inline uint32_t take_bits(uint8_t n) {
+    un.nbits -= n;
+    return (un.acc >> un.nbits) & ((1u << n) - 1);
+}
+
+static void unpack_flush(void) {
+    if (un.out_len && !un.failed && !flash_exec_write(out_buf, un.out_len))
+        un.failed = true;
+    un.out_len = 0;
+}
+
+static inline void unpack_emit(uint8_t c) {
+    window[un.head++ & ((1u << un.window_bits) - 1)] = c;
+    out_buf[un.out_len++] = c;
+    un.bytes_out++;
+    if (un.out_len == UNPACK_OUT_SIZE)
+        unpack_flush();
+}
+
+static void unpack_byte(uint8_t in) {
+    uint32_t mask = (1u << un.window_bits) - 1;
+    uint32_t count;
+
+    un.acc = (un.acc << 8) | in;
+    un.nbits += 8;
+
+    while (1) {
+        switch (un.state) {
+        case UNPACK_TAG:
+            if (un.nbits < 1)
+                return;
+            un.state = take_bits(1) ? UNPACK_LITERAL : UNPACK_INDEX;
+            break;
+        case UNPACK_LITERAL:
+            if (un.nbits < 8)
+                return;
+            unpack_emit(take_bits(8));
+            un.state = UNPACK_TAG;
+            break;
+        case UNPACK_INDEX:
+            if (un.nbits < un.window_bits)
+                return;
+            un.index = take_bits(un.window_bits) + 1;
+            un.state = UNPACK_COUNT;
+            break;
+        case UNPACK_COUNT:
+            if (un.nbits < un.lookahead_bits)
+                return;
+            count = take_bits(un.lookahead_bits) + 1;
+            while (count--)
+                unpack_emit(window[(un.head - un.index) & mask]);
+            un.state = UNPACK_TAG;
+            break;
+        }
+    }
+}
+
+static bool unpack_start(uint8_t window_bits, uint8_t lookahead_bits) {
+    memset(&un, 0, sizeof(un));
+    if (window_bits < 4 || window_bits > FLASH_UNPACK_MAX_WINDOW ||
+        lookahead_bits < 3 || lookahead_bits >= window_bits)
+        return false;
+
+    // heatshrink starts from a zeroed history
+    memset(window, 0, sizeof(window));
+    un.window_bits = window_bits;
+    un.lookahead_bits = lookahead_bits;
+    un.active = flash_exec_ready();
+    return un.active;
+}
+
+// Vendor command: request  [sub-command][parameters]
+//                 response [status][data]
+uint32_t flash_unpack_command(const uint8_t *request, uint8_t *response) {
+    uint8_t *resp = response + 1;
+    uint32_t req_len = 1;
+    bool ok = true;
+    int i, len;
+
+    switch (*request) {
+    case FLASH_UNPACK_START:
+        // [window bits][lookahead bits], the flash executor must be configured with a start page
+        req_len += 2;
+        ok = unpack_start(request[1], request[2]);
+        break;
+    case FLASH_UNPACK_DATA:
+        // [length][compressed data], end with the flash executor's flush
+        len = request[1];
+        if (len > DAP_PACKET_SIZE - 3)
+            len = DAP_PACKET_SIZE - 3;
+        req_len += 1 + len;
+        ok = un.active && !un.failed;
+        for (i = 0; ok && i < len; i++)
+            unpack_byte(request[2 + i]);
+        if (ok) {
+            un.bytes_in += len;
+            unpack_flush();
+            ok = !un.failed;
+        }
+        break;
+    case FLASH_UNPACK_STATUS:
+        *resp++ = un.active;
+        *resp++ = un.failed;
+        resp = put_u32(resp, un.bytes_in);
+        resp = put_u32(resp, un.bytes_out);
+        break;
+    default:
+        ok = false;
+        break;
+    }
+
+    *response = ok ? DAP_OK : DAP_ERROR;
+    return (req_len << 16) | (uint32_t)(resp - response);
+}
@@ -0,0 +1,324 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "DAP_config.h"
+#include "DAP.h"
+#include "dap_vendor.h"
+#include "itm.h"
+#include "ringbuf.h"
+#include "swo_pio.h"
+#include "tusb.h"
+#include "tusb_stream.h"
+
+#if ((SWO_UART != 0) || (SWO_MANCHESTER != 0))
+
+/*
+ * ITM/DWT packet decoder running on the captured SWO trace. It reads the
+ * trace buffer with its own index, so it works next to SWO_Data or SWO
+ * streaming. Stimulus port payloads are demultiplexed into one ring per port,
+ * everything else is copied into the event ring with its header.
+ */
+
+enum itm_state {
+    ITM_STATE_HEADER = 0,
+    ITM_STATE_PAYLOAD,
+    ITM_STATE_CONTINUATION,
+};
+
+// Longest packet is a 7 byte global timestamp (header + 6)
+#define ITM_PACKET_MAX 8
+
+static char itm_port_data[ITM_PORT_COUNT][ITM_PORT_BUF_SIZE];
+static struct ringbuf itm_port[ITM_PORT_COUNT];
+RINGBUF_STATIC_ALLOC(itm_events, ITM_EVENT_BUF_SIZE);
+
+static struct {
+    bool initted;
+    bool enabled;
+    // Requests from the DAP thread, applied by itm_task()
+    volatile bool reset;
+    volatile bool enable;
+    volatile uint32_t port_mask;
+    uint8_t stream_port;
+    // Read index into the SWO trace buffer
+    uint32_t index;
+    // Packet being decoded
+    uint8_t state;
+    uint8_t len;
+    uint8_t pos;
+    uint8_t zeros;
+    uint8_t packet[ITM_PACKET_MAX];
+    struct {
+        uint32_t sync;
+        uint32_t overflow;
+        uint32_t error;
+        uint32_t lost;
+        uint32_t event_dropped;
+        uint32_t dropped[ITM_PORT_COUNT];
+    } stats;
+} itm = {
+    .stream_port = ITM_STREAM_NONE,
+};
+
+static void itm_event(void) {
+    if (ringbuf_puts(&itm_events, (const char *)itm.packet, itm.pos) < 0)
+        itm.stats.event_dropped++;
+}
+
+static void itm_source(void) {
+    uint8_t header = itm.packet[0];
+    uint8_t port = header >> 3;
+
+    if (header & 0x04) {
+        // Hardware source (DWT)
+        itm_event();
+    } else if (port < ITM_PORT_COUNT && (itm.port_mask & (1u << port))) {
+        if (ringbuf_puts(&itm_port[port], (const char *)&itm.packet[1], itm.len) < 0)
+            itm.stats.dropped[port] += itm.len;
+    }
+}
+
+static void itm_decode(uint8_t c) {
+    switch (itm.state) {
+    case ITM_STATE_HEADER:
+        // Synchronisation is at least 47 zero bits followed by a one
+        if (c == 0x00) {
+            // Saturate, so a long run of zeros doesn't wrap below the five needed
+            if (itm.zeros < 5)
+                itm.zeros++;
+            break;
+        }
+        if (c == 0x80 && itm.zeros >= 5) {
+            itm.stats.sync++;
+            itm.zeros = 0;
+            break;
+        }
+        itm.zeros = 0;
+        itm.packet[0] = c;
+        itm.pos = 1;
+
+        if (c & 0x03) {
+            // Instrumentation or hardware source packet, 1, 2 or 4 bytes
+            itm.len = (c & 0x03) == 0x03 ? 4 : (c & 0x03);
+            itm.state = ITM_STATE_PAYLOAD;
+        } else if (c == 0x70) {
+            itm.stats.overflow++;
+            itm_event();
+        } else if ((c & 0x8F) == 0x00) {
+            // Local timestamp format 2, no payload
+            itm_event();
+        } else if ((c & 0xCF) == 0xC0 || (c & 0xDF) == 0x94) {
+            // Local timestamp format 1 or global timestamp
+            itm.state = ITM_STATE_CONTINUATION;
+        } else if ((c & 0x0B) == 0x08) {
+            // Extension
+            if (c & 0x80)
+                itm.state = ITM_STATE_CONTINUATION;
+            else
+                itm_event();
+        } else {
+            itm.stats.error++;
+        }
+        break;
+
+    case ITM_STATE_PAYLOAD:
+        itm.packet[itm.pos++] = c;
+        if (itm.pos > itm.len) {
+            itm_source();
+            itm.state = ITM_STATE_HEADER;
+        }
+        break;
+
+    case ITM_STATE_CONTINUATION:
+        if (itm.pos == ITM_PACKET_MAX) {
+            itm.stats.error++;
+            itm.state = ITM_STATE_HEADER;
+            break;
+        }
+        itm.packet[itm.pos++] = c;
+        if (!(c & 0x80)) {
+            itm_event();
+            itm.state = ITM_STATE_HEADER;
+        }
+        break;
+    }
+}
+
+static void itm_apply_config(void) {
+    int i;
+
+    if (!itm.initted) {
+        for (i = 0; i < ITM_PORT_COUNT; i++)
+            ringbuf_init(&itm_port[i], itm_port_data[i], ITM_PORT_BUF_SIZE);
+        itm.initted = true;
+    }
+    for (i = 0; i < ITM_PORT_COUNT; i++)
+        ringbuf_reset(&itm_port[i]);
+    ringbuf_reset(&itm_events);
+    memset(&itm.stats, 0, sizeof(itm.stats));
+
+    itm.state = ITM_STATE_HEADER;
+    itm.zeros = 0;
+    itm.index = SWO_TraceHead();
+    itm.enabled = itm.enable;
+}
+
+// Port 0 goes to the ITM CDC interface while a terminal has it open
+static void itm_cdc_task(void) {
+    const char *ptr;
+    int len;
+    uint32_t n;
+
+    if (itm.stream_port == 0 || !tud_cdc_n_connected(ITM_USB_PORT))
+        return;
+
+    // The interface is output only, drop anything the terminal sends
+    tud_cdc_n_read_flush(ITM_USB_PORT);
+
+    ptr = ringbuf_get_ptr(&itm_port[0], &len);
+    while (len > 0) {
+        n = tud_cdc_n_write(ITM_USB_PORT, ptr, len);
+        ringbuf_consume(&itm_port[0], n);
+        if (n < (uint32_t)len)
+            break;
+        ptr = ringbuf_get_ptr(&itm_port[0], &len);
+    }
+    tud_cdc_n_write_flush(ITM_USB_PORT);
+}
+
+void itm_task(void) {
+    uint8_t buf[64];
+    uint32_t lost;
+    uint32_t n, i;
+
+    if (itm.reset) {
+        itm.reset = false;
+        itm_apply_config();
+    }
+    if (!itm.enabled)
+        return;
+
+    do {
+        lost = itm.stats.lost;
+        n = SWO_TraceRead(&itm.index, buf, sizeof(buf), &itm.stats.lost);
+        // Don't glue the halves of two packets together
+        if (itm.stats.lost != lost)
+            itm.state = ITM_STATE_HEADER;
+        for (i = 0; i < n; i++)
+            itm_decode(buf[i]);
+    } while (n == sizeof(buf));
+
+    itm_cdc_task();
+}
+
+static struct ringbuf *itm_ring(uint8_t port) {
+    if (port == ITM_EVENT_PORT)
+        return &itm_events;
+    if (port < ITM_PORT_COUNT)
+        return &itm_port[port];
+    return NULL;
+}
+
+// Vendor command: request  [sub-command][parameters]
+//                 response [status][data]
+uint32_t itm_command(const uint8_t *request, uint8_t *response) {
+    uint8_t *resp = response + 1;
+    uint32_t req_len = 1;
+    struct ringbuf *ring;
+    bool ok = true;
+    int i, n;
+
+    switch (*request) {
+    case ITM_CONFIG:
+        // [enable][port mask u32], resets rings and counters
+        req_len += 5;
+        if (itm.stream_port != ITM_STREAM_NONE) {
+            stream_detach(itm_ring(itm.stream_port));
+            itm.stream_port = ITM_STREAM_NONE;
+        }
+        itm.port_mask = get_u32(&request[2]);
+        itm.enable = request[1] != 0;
+        itm.reset = true;
+        break;
+    case ITM_READ:
+        // [port][max length]
+        req_len += 2;
+        ring = itm_ring(request[1]);
+        n = request[2];
+        if (n > DAP_PACKET_SIZE - 3)
+            n = DAP_PACKET_SIZE - 3;
+        // The ring has a single consumer, which may already be the CDC or stream endpoint
+        ok = ring != NULL && itm.initted && request[1] != itm.stream_port &&
+             !(request[1] == 0 && tud_cdc_n_connected(ITM_USB_PORT));
+        if (!ok)
+            n = 0;
+        if (n > 0) {
+            i = ringbuf_elements(ring);
+            if (n > i)
+                n = i;
+            ringbuf_gets(ring, (char *)resp + 1, n);
+        }
+        *resp++ = n;
+        resp += n;
+        break;
+    case ITM_STREAM:
+        // [port], ITM_STREAM_NONE to detach
+        req_len += 1;
+        if (itm.stream_port != ITM_STREAM_NONE) {
+            stream_detach(itm_ring(itm.stream_port));
+            itm.stream_port = ITM_STREAM_NONE;
+        }
+        if (request[1] != ITM_STREAM_NONE) {
+            ring = itm_ring(request[1]);
+            ok = ring != NULL && itm.initted && stream_attach(ring);
+            if (ok)
+                itm.stream_port = request[1];
+        }
+        break;
+    case ITM_STATUS:
+        *resp++ = itm.enabled;
+        resp = put_u32(resp, itm.port_mask);
+        resp = put_u32(resp, itm.stats.sync);
+        resp = put_u32(resp, itm.stats.overflow);
+        resp = put_u32(resp, itm.stats.error);
+        resp = put_u32(resp, itm.stats.lost);
+        resp = put_u32(resp, itm.stats.event_dropped);
+        for (i = 0; i < ITM_PORT_COUNT; i++)
+            resp = put_u32(resp, itm.stats.dropped[i]);
+        break;
+    default:
+        ok = false;
+        break;
+    }
+
+    *response = ok ? DAP_OK : DAP_ERROR;
+    return (req_len << 16) | (uint32_t)(resp - response);
+}
+
+#endif
@@ -0,0 +1,55 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef ITM_H_
+#define ITM_H_
+
+#include <stdint.h>
+
+// Stimulus ports 0..ITM_PORT_COUNT-1 get their own ring buffer
+#define ITM_PORT_COUNT      8
+#define ITM_PORT_BUF_SIZE   1024
+// Non-stimulus packets (hardware source, timestamps, overflow) are kept
+// verbatim, header byte first, in the event ring
+#define ITM_EVENT_BUF_SIZE  2048
+#define ITM_EVENT_PORT      0xFF
+#define ITM_STREAM_NONE     0xFE
+
+// Stimulus port 0 is also sent to this CDC interface while it is open
+#define ITM_USB_PORT        2
+
+// Vendor command sub-commands
+#define ITM_STATUS  0
+#define ITM_CONFIG  1
+#define ITM_READ    2
+#define ITM_STREAM  3
+
+// Called from the SWO thread to decode newly captured trace
+void itm_task(void);
+
+uint32_t itm_command(const uint8_t *request, uint8_t *response);
+
+#endif
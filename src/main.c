@@ -42,8 +42,11 @@
 #include "probe_config.h"
 #include "probe.h"
 #include "cdc_uart.h"
+#include "pio_uart.h"
 #include "get_serial.h"
 #include "tusb_edpt_handler.h"
+#include "tusb_stream.h"
+#include "swo_pio.h"
 #include "DAP.h"
 #include "bmp_main.h"
 #include "hardware/structs/usb.h"
@@ -60,6 +63,7 @@ static uint8_t RxDataBuffer[CFG_TUD_HID_EP_BUFSIZE];
 #define TUD_TASK_PRIO  (tskIDLE_PRIORITY + 2)
 #define DAP_TASK_PRIO  (tskIDLE_PRIORITY + 1)
 #define BMP_TASK_PRIO  (tskIDLE_PRIORITY + 1)
+#define SWO_TASK_PRIO  (tskIDLE_PRIORITY + 2)
 
 TaskHandle_t bmp_taskhandle;
 TaskHandle_t dap_taskhandle, tud_taskhandle, mon_taskhandle;
@@ -103,6 +107,7 @@ void usb_thread(void *ptr)
     wake = xTaskGetTickCount();
     do {
         tud_task();
+        stream_task();
 #ifdef PROBE_USB_CONNECTED_LED
         if (!gpio_get(PROBE_USB_CONNECTED_LED) && tud_ready())
             gpio_put(PROBE_USB_CONNECTED_LED, 1);
@@ -128,8 +133,14 @@ int main(void) {
     bi_decl_config();
 
     board_init();
+    /* probe.c drives PROBE_SM without claiming it, keep the PIO users that
+     * pick a free state machine at run time off it */
+    pio_sm_claim(pio0, PROBE_SM);
     usb_serial_init();
     cdc_uart_init();
+#if PROBE_PIO_UART_COUNT
+    pio_uart_init();
+#endif
     tusb_init();
     stdio_uart_init();
 
@@ -146,6 +157,10 @@ int main(void) {
         /* BMP thread need more STACK size */
         xTaskCreate(bmp_main, "BMP", 1024, NULL, BMP_TASK_PRIO, &bmp_taskhandle);
 
+#if ((SWO_UART != 0) || (SWO_MANCHESTER != 0))
+        xTaskCreate(SWO_Thread, "SWO", configMINIMAL_STACK_SIZE, NULL, SWO_TASK_PRIO, &swo_taskhandle);
+#endif
+
 #if PICO_RP2040
         xTaskCreate(dev_mon, "WDOG", configMINIMAL_STACK_SIZE, NULL, TUD_TASK_PRIO, &mon_taskhandle);
 #endif
@@ -238,6 +253,9 @@ void tud_suspend_cb(bool remote_wakeup_en)
   /* Join DAP and UART threads? Or just suspend them, for transparency */
   vTaskSuspend(uart_taskhandle);
   vTaskSuspend(dap_taskhandle);
+#if PROBE_PIO_UART_COUNT
+  vTaskSuspend(pio_uart_taskhandle);
+#endif
   /* slow down clk_sys for power saving ? */
 }
 
@@ -246,6 +264,9 @@ void tud_resume_cb(void)
   probe_info("Resumed\n");
   vTaskResume(uart_taskhandle);
   vTaskResume(dap_taskhandle);
+#if PROBE_PIO_UART_COUNT
+  vTaskResume(pio_uart_taskhandle);
+#endif
 }
 
 void tud_unmount_cb(void)
@@ -255,6 +276,12 @@ void tud_unmount_cb(void)
   vTaskSuspend(dap_taskhandle);
   vTaskDelete(uart_taskhandle);
   vTaskDelete(dap_taskhandle);
+  /* The UART interrupts notify the bridge task through this handle */
+  uart_taskhandle = NULL;
+#if PROBE_PIO_UART_COUNT
+  vTaskDelete(pio_uart_taskhandle);
+  pio_uart_taskhandle = NULL;
+#endif
 }
 
 void tud_mount_cb(void)
@@ -262,6 +289,9 @@ void tud_mount_cb(void)
   probe_info("Connected, Configured\n");
   /* UART needs to preempt USB as if we don't, characters get lost */
   xTaskCreate(cdc_thread, "UART", configMINIMAL_STACK_SIZE, NULL, UART_TASK_PRIO, &uart_taskhandle);
+#if PROBE_PIO_UART_COUNT
+  xTaskCreate(pio_uart_thread, "PIOUART", configMINIMAL_STACK_SIZE, NULL, UART_TASK_PRIO, &pio_uart_taskhandle);
+#endif
   /* Lowest priority thread is debug - need to shuffle buffers before we can toggle swd... */
   xTaskCreate(dap_thread, "DAP", configMINIMAL_STACK_SIZE, NULL, DAP_TASK_PRIO, &dap_taskhandle);
 }
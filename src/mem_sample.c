@@ -0,0 +1,195 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <pico/stdlib.h>
+
+#include "DAP_config.h"
+#include "DAP.h"
+#include "dap_vendor.h"
+#include "dap_mem.h"
+#include "dap_job.h"
+#include "mem_sample.h"
+#include "ringbuf.h"
+#include "tusb_stream.h"
+
+/*
+ * Live variable logger. A DAP job reads a list of target addresses once per
+ * period and queues a timestamped record for the data stream endpoint, so
+ * the sample rate is set by the probe's timer instead of USB round trips.
+ */
+RINGBUF_STATIC_ALLOC(mem_ring, MEM_SAMPLE_BUF_SIZE);
+
+static struct {
+    uint32_t addr;
+    uint8_t size;
+} vars[MEM_SAMPLE_MAX_VARS];
+
+static struct {
+    bool running;
+    bool gap;
+    uint8_t ap;
+    uint8_t count;
+    uint8_t record_len;
+    uint16_t seq;
+    uint32_t period;
+    uint32_t records;
+    uint32_t overflow;
+    uint32_t errors;
+} ms = {
+    .record_len = MEM_SAMPLE_HDR_LEN,
+};
+
+static void mem_sample_job(void) {
+    uint8_t record[MEM_SAMPLE_HDR_LEN + MEM_SAMPLE_MAX_VARS * 4];
+    uint8_t *p = &record[MEM_SAMPLE_HDR_LEN];
+    uint32_t now = time_us_32();
+    uint8_t flags = 0;
+    uint32_t val;
+    bool ok;
+    int i, b;
+
+    ok = dap_mem_acquire(ms.ap);
+    for (i = 0; i < ms.count; i++) {
+        val = 0;
+        if (!ok || !dap_mem_read(vars[i].addr, vars[i].size, &val))
+            flags |= MEM_SAMPLE_FLAG_ERROR;
+        for (b = 0; b < vars[i].size; b++)
+            *p++ = (uint8_t)(val >> (b * 8));
+    }
+    if (flags & MEM_SAMPLE_FLAG_ERROR)
+        ms.errors++;
+    if (ms.gap)
+        flags |= MEM_SAMPLE_FLAG_GAP;
+
+    record[0] = MEM_SAMPLE_SYNC;
+    record[1] = flags;
+    put_u16(&record[2], ms.seq++);
+    put_u32(&record[4], now);
+
+    if (ringbuf_puts(&mem_ring, (const char *)record, ms.record_len) < 0) {
+        ms.overflow++;
+        ms.gap = true;
+        return;
+    }
+    ms.gap = false;
+    ms.records++;
+}
+
+static void mem_sample_stop(void) {
+    dap_job_stop(mem_sample_job);
+    ms.running = false;
+}
+
+static bool mem_sample_add(uint32_t addr, uint8_t size) {
+    if (ms.count == MEM_SAMPLE_MAX_VARS)
+        return false;
+    if ((size != 1 && size != 2 && size != 4) || (addr & (size - 1)))
+        return false;
+    vars[ms.count].addr = addr;
+    vars[ms.count].size = size;
+    ms.count++;
+    ms.record_len += size;
+    return true;
+}
+
+static bool mem_sample_start(void) {
+    if (ms.count == 0)
+        return false;
+
+    // Start from an empty ring so the stream begins on a record boundary
+    stream_detach(&mem_ring);
+    ringbuf_reset(&mem_ring);
+    if (!stream_attach(&mem_ring))
+        return false;
+
+    ms.seq = 0;
+    ms.gap = false;
+    ms.records = 0;
+    ms.overflow = 0;
+    ms.errors = 0;
+    ms.running = dap_job_start(mem_sample_job, ms.period);
+    return ms.running;
+}
+
+// Vendor command: request  [sub-command][parameters]
+//                 response [status][data]
+uint32_t mem_sample_command(const uint8_t *request, uint8_t *response) {
+    uint8_t *resp = response + 1;
+    uint32_t req_len = 1;
+    bool ok = true;
+    int i, n;
+
+    switch (*request) {
+    case MEM_SAMPLE_CONFIG:
+        // [ap][period us u32], drops the variable list and releases the endpoint
+        req_len += 5;
+        mem_sample_stop();
+        stream_detach(&mem_ring);
+        ms.ap = request[1];
+        ms.period = get_u32(&request[2]);
+        if (ms.period < DAP_JOB_MIN_PERIOD_US)
+            ms.period = DAP_JOB_MIN_PERIOD_US;
+        ms.count = 0;
+        ms.record_len = MEM_SAMPLE_HDR_LEN;
+        resp = put_u32(resp, ms.period);
+        break;
+    case MEM_SAMPLE_ADD:
+        // [count][address u32, size]...
+        n = request[1];
+        if (2 + n * 5 > DAP_PACKET_SIZE)
+            n = 0;
+        req_len += 1 + n * 5;
+        ok = !ms.running && n > 0;
+        for (i = 0; ok && i < n; i++)
+            ok = mem_sample_add(get_u32(&request[2 + i * 5]), request[6 + i * 5]);
+        *resp++ = ms.count;
+        *resp++ = ms.record_len;
+        break;
+    case MEM_SAMPLE_START:
+        mem_sample_stop();
+        ok = mem_sample_start();
+        break;
+    case MEM_SAMPLE_STOP:
+        // The endpoint stays attached so queued records still reach the host
+        mem_sample_stop();
+        break;
+    case MEM_SAMPLE_STATUS:
+        *resp++ = ms.running;
+        *resp++ = ms.count;
+        *resp++ = ms.record_len;
+        resp = put_u32(resp, ms.period);
+        resp = put_u32(resp, ms.records);
+        resp = put_u32(resp, ms.overflow);
+        resp = put_u32(resp, ms.errors);
+        break;
+    default:
+        ok = false;
+        break;
+    }
+
+    *response = ok ? DAP_OK : DAP_ERROR;
+    return (req_len << 16) | (uint32_t)(resp - response);
+}
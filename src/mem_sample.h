@@ -0,0 +1,56 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef MEM_SAMPLE_H_
+#define MEM_SAMPLE_H_
+
+#include <stdint.h>
+
+#define MEM_SAMPLE_MAX_VARS     16
+#define MEM_SAMPLE_BUF_SIZE     8192
+
+/*
+ * Record sent on the data stream endpoint for every sample period:
+ *   [MEM_SAMPLE_SYNC][flags][sequence u16][timestamp us u32][values]
+ * Values follow in the order they were added, each as wide as its access.
+ */
+#define MEM_SAMPLE_SYNC         0xA5
+#define MEM_SAMPLE_HDR_LEN      8
+
+// Record flags
+#define MEM_SAMPLE_FLAG_ERROR   (1u << 0)  // At least one read failed, its value is 0
+#define MEM_SAMPLE_FLAG_GAP     (1u << 1)  // Records were dropped before this one
+
+// Vendor command sub-commands
+#define MEM_SAMPLE_STATUS   0
+#define MEM_SAMPLE_CONFIG   1
+#define MEM_SAMPLE_ADD      2
+#define MEM_SAMPLE_START    3
+#define MEM_SAMPLE_STOP     4
+
+uint32_t mem_sample_command(const uint8_t *request, uint8_t *response);
+
+#endif
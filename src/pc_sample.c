@@ -0,0 +1,206 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "DAP_config.h"
+#include "DAP.h"
+#include "dap_vendor.h"
+#include "dap_mem.h"
+#include "dap_job.h"
+#include "pc_sample.h"
+
+/*
+ * Statistical profiler. DWT_PCSR holds a recent PC of the running core and
+ * can be read over the AP without halting it, so a DAP job reads it once per
+ * period and counts the value in a hash table. Only the histogram travels to
+ * the host, when it asks for it.
+ */
+#define DWT_PCSR        0xE000101CU
+#define DCB_DEMCR       0xE000EDFCU
+#define DEMCR_TRCENA    (1u << 24)
+
+// PCSR reads as all ones while the core is halted or sleeping in debug state
+#define PCSR_NO_SAMPLE  0xFFFFFFFFU
+
+#define PC_SAMPLE_HASH_SIZE (1u << PC_SAMPLE_HASH_BITS)
+#define PC_SAMPLE_NIL       0xFFFF
+
+struct pc_entry {
+    uint32_t pc;
+    uint32_t count;
+    uint16_t next;
+};
+
+static uint16_t pc_hash[PC_SAMPLE_HASH_SIZE];
+static struct pc_entry pc_entries[PC_SAMPLE_ENTRIES];
+
+static struct {
+    bool running;
+    uint8_t ap;
+    uint32_t period;
+    uint16_t used;
+    uint32_t samples;
+    uint32_t halted;
+    uint32_t dropped;
+    uint32_t errors;
+} pcs;
+
+static inline uint32_t pc_hash_index(uint32_t pc) {
+    // Thumb PCs are halfword aligned, bit 0 carries no information
+    return ((pc >> 1) * 2654435761u) >> (32 - PC_SAMPLE_HASH_BITS);
+}
+
+static void pc_sample_clear(void) {
+    memset(pc_hash, 0xFF, sizeof(pc_hash));
+    pcs.used = 0;
+    pcs.samples = 0;
+    pcs.halted = 0;
+    pcs.dropped = 0;
+    pcs.errors = 0;
+}
+
+static void pc_sample_count(uint32_t pc) {
+    uint16_t *link = &pc_hash[pc_hash_index(pc)];
+    struct pc_entry *e;
+
+    while (*link != PC_SAMPLE_NIL) {
+        e = &pc_entries[*link];
+        if (e->pc == pc) {
+            e->count++;
+            return;
+        }
+        link = &e->next;
+    }
+
+    if (pcs.used == PC_SAMPLE_ENTRIES) {
+        pcs.dropped++;
+        return;
+    }
+    e = &pc_entries[pcs.used];
+    e->pc = pc;
+    e->count = 1;
+    e->next = PC_SAMPLE_NIL;
+    *link = pcs.used++;
+}
+
+static void pc_sample_job(void) {
+    uint32_t pc;
+
+    if (!dap_mem_acquire(pcs.ap) || !dap_mem_read(DWT_PCSR, 4, &pc)) {
+        pcs.errors++;
+        return;
+    }
+
+    if (pc == PCSR_NO_SAMPLE) {
+        pcs.halted++;
+        return;
+    }
+    pcs.samples++;
+    pc_sample_count(pc);
+}
+
+static bool pc_sample_start(uint8_t ap, uint32_t period) {
+    uint32_t demcr;
+
+    // DWT registers are only accessible with trace enabled
+    if (!dap_mem_acquire(ap) || !dap_mem_read(DCB_DEMCR, 4, &demcr))
+        return false;
+    if (!(demcr & DEMCR_TRCENA) && !dap_mem_write(DCB_DEMCR, 4, demcr | DEMCR_TRCENA))
+        return false;
+
+    if (period < DAP_JOB_MIN_PERIOD_US)
+        period = DAP_JOB_MIN_PERIOD_US;
+    pcs.ap = ap;
+    pcs.period = period;
+    pcs.running = dap_job_start(pc_sample_job, period);
+    return pcs.running;
+}
+
+static void pc_sample_stop(void) {
+    dap_job_stop(pc_sample_job);
+    pcs.running = false;
+}
+
+// Vendor command: request  [sub-command][parameters]
+//                 response [status][data]
+uint32_t pc_sample_command(const uint8_t *request, uint8_t *response) {
+    uint8_t *resp = response + 1;
+    uint32_t req_len = 1;
+    uint32_t index;
+    bool ok = true;
+    int n;
+
+    switch (*request) {
+    case PC_SAMPLE_START:
+        // [ap][period us u32][clear]
+        req_len += 6;
+        pc_sample_stop();
+        if (request[6] || pcs.used == 0)
+            pc_sample_clear();
+        ok = pc_sample_start(request[1], get_u32(&request[2]));
+        break;
+    case PC_SAMPLE_STOP:
+        pc_sample_stop();
+        break;
+    case PC_SAMPLE_CLEAR:
+        pc_sample_clear();
+        break;
+    case PC_SAMPLE_READ:
+        // [first entry u16] -> [total entries u16][count][pc u32, hits u32]...
+        req_len += 2;
+        index = get_u16(&request[1]);
+        n = (DAP_PACKET_SIZE - 2 - 3) / 8;
+        if (index >= pcs.used)
+            n = 0;
+        else if (n > pcs.used - index)
+            n = pcs.used - index;
+        resp = put_u16(resp, pcs.used);
+        *resp++ = n;
+        while (n--) {
+            resp = put_u32(resp, pc_entries[index].pc);
+            resp = put_u32(resp, pc_entries[index].count);
+            index++;
+        }
+        break;
+    case PC_SAMPLE_STATUS:
+        *resp++ = pcs.running;
+        resp = put_u32(resp, pcs.period);
+        resp = put_u32(resp, pcs.samples);
+        resp = put_u32(resp, pcs.halted);
+        resp = put_u32(resp, pcs.dropped);
+        resp = put_u32(resp, pcs.errors);
+        resp = put_u16(resp, pcs.used);
+        break;
+    default:
+        ok = false;
+        break;
+    }
+
+    *response = ok ? DAP_OK : DAP_ERROR;
+    return (req_len << 16) | (uint32_t)(resp - response);
+}
@@ -0,0 +1,326 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <pico/stdlib.h>
+
+#include <hardware/clocks.h>
+#include <hardware/dma.h>
+#include <hardware/irq.h>
+#include <hardware/pio.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "probe_config.h"
+#include "ringbuf.h"
+#include "probe.h"
+#include "pio_uart.h"
+#include "pio_uart.pio.h"
+#include "swo.pio.h"
+
+#if PROBE_PIO_UART_COUNT
+
+/*
+ * Extra UART bridges on spare PIO state machines. Each port takes a TX and
+ * an RX SM on whichever PIO block still has room, plus three DMA channels.
+ * RX uses the SWO UART program and runs round a hardware ring like the
+ * PL011 bridge, TX is fed from a ring buffer one contiguous chunk at a time.
+ * Only 8N1 is supported, the baud rate can be anything up to clk_sys / 8.
+ */
+#define PIO_UART_RX_SIZE    4096
+#define PIO_UART_TX_SIZE    1024
+
+// Polling period for RX data while the task has nothing else to do
+#define PIO_UART_POLL_MS    1
+
+struct pio_uart_port {
+    uint tx_pin;
+    uint rx_pin;
+    uint32_t baud;
+    bool initted;
+    PIO pio;
+    int tx_sm;
+    int rx_sm;
+    int tx_dma;
+    int rx_dma;
+    int rx_ctrl;
+    struct ringbuf rx_ring;
+    struct ringbuf tx_ring;
+    uint32_t rx_count;
+    volatile int tx_len;
+};
+
+// A power of two, see ringbuf_dma_received()
+static const uint32_t rx_dma_reload = 1u << 31;
+
+static char rx_data[PROBE_PIO_UART_COUNT][PIO_UART_RX_SIZE] __attribute__((aligned(PIO_UART_RX_SIZE)));
+static char tx_data[PROBE_PIO_UART_COUNT][PIO_UART_TX_SIZE];
+
+static struct pio_uart_port ports[PROBE_PIO_UART_COUNT] = {
+    { .tx_pin = PROBE_PIO_UART0_TX, .rx_pin = PROBE_PIO_UART0_RX, .baud = PROBE_PIO_UART_BAUDRATE },
+#if PROBE_PIO_UART_COUNT > 1
+    { .tx_pin = PROBE_PIO_UART1_TX, .rx_pin = PROBE_PIO_UART1_RX, .baud = PROBE_PIO_UART_BAUDRATE },
+#endif
+};
+
+// Program offsets, loaded at most once per PIO block
+static int tx_offset[2] = { -1, -1 };
+static int rx_offset[2] = { -1, -1 };
+
+TaskHandle_t pio_uart_taskhandle;
+
+static void pio_uart_set_baud(struct pio_uart_port *p, uint32_t baud) {
+    uint32_t clk_sys_freq = clock_get_hz(clk_sys);
+    float div;
+
+    if (baud == 0 || baud > clk_sys_freq / 8)
+        baud = clk_sys_freq / 8;
+    div = (float)clk_sys_freq / (8.0f * baud);
+    if (div > 65535.0f)
+        div = 65535.0f;
+    pio_sm_set_clkdiv(p->pio, p->tx_sm, div);
+    pio_sm_set_clkdiv(p->pio, p->rx_sm, div);
+    p->baud = baud;
+}
+
+static bool pio_uart_load(struct pio_uart_port *p, PIO pio) {
+    uint idx = pio_get_index(pio);
+    int hold = PROBE_PIO0_LOADED;
+    bool ok = false;
+
+    // The UART programs must leave room for the SWD engine in pio0
+    if (pio == pio0) {
+        hold = probe_pio0_hold();
+        if (hold == PROBE_PIO0_FULL)
+            return false;
+    }
+
+    if (tx_offset[idx] < 0 && !pio_can_add_program(pio, &pio_uart_tx_program))
+        goto out;
+    if (rx_offset[idx] < 0 && !pio_can_add_program(pio, &swo_uart_program))
+        goto out;
+
+    p->tx_sm = pio_claim_unused_sm(pio, false);
+    if (p->tx_sm < 0)
+        goto out;
+    p->rx_sm = pio_claim_unused_sm(pio, false);
+    if (p->rx_sm < 0) {
+        pio_sm_unclaim(pio, p->tx_sm);
+        goto out;
+    }
+
+    if (tx_offset[idx] < 0)
+        tx_offset[idx] = pio_add_program(pio, &pio_uart_tx_program);
+    if (rx_offset[idx] < 0)
+        rx_offset[idx] = pio_add_program(pio, &swo_uart_program);
+    p->pio = pio;
+    ok = true;
+out:
+    probe_pio0_release(hold);
+    return ok;
+}
+
+static void pio_uart_port_init(struct pio_uart_port *p, char *rx_buf, char *tx_buf) {
+    dma_channel_config c;
+
+    // pio1 first, pio0 runs the SWD engine and only has room for one port at most
+    if (!pio_uart_load(p, pio1) && !pio_uart_load(p, pio0))
+        return;
+
+    p->tx_dma = dma_claim_unused_channel(true);
+    p->rx_dma = dma_claim_unused_channel(true);
+    p->rx_ctrl = dma_claim_unused_channel(true);
+    ringbuf_init(&p->rx_ring, rx_buf, PIO_UART_RX_SIZE);
+    ringbuf_init(&p->tx_ring, tx_buf, PIO_UART_TX_SIZE);
+
+    pio_uart_tx_program_init(p->pio, p->tx_sm, tx_offset[pio_get_index(p->pio)], p->tx_pin);
+    swo_uart_program_init(p->pio, p->rx_sm, rx_offset[pio_get_index(p->pio)], p->rx_pin);
+    pio_uart_set_baud(p, p->baud);
+
+    c = dma_channel_get_default_config(p->tx_dma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, pio_get_dreq(p->pio, p->tx_sm, true));
+    dma_channel_configure(p->tx_dma, &c, &p->pio->txf[p->tx_sm], tx_buf, 0, false);
+    dma_channel_set_irq1_enabled(p->tx_dma, true);
+
+    // Free-running RX ring, the control channel reloads the count when it runs out
+    c = dma_channel_get_default_config(p->rx_dma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_ring(&c, true, __builtin_ctz(PIO_UART_RX_SIZE));
+    channel_config_set_dreq(&c, pio_get_dreq(p->pio, p->rx_sm, false));
+    channel_config_set_chain_to(&c, p->rx_ctrl);
+    dma_channel_configure(p->rx_dma, &c, rx_buf, (io_rw_8 *)&p->pio->rxf[p->rx_sm] + 3, rx_dma_reload, true);
+    p->rx_count = rx_dma_reload;
+
+    c = dma_channel_get_default_config(p->rx_ctrl);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, false);
+    dma_channel_configure(p->rx_ctrl, &c, &dma_hw->ch[p->rx_dma].al1_transfer_count_trig,
+                          &rx_dma_reload, 1, false);
+
+    pio_sm_set_enabled(p->pio, p->rx_sm, true);
+    pio_sm_set_enabled(p->pio, p->tx_sm, true);
+    p->initted = true;
+}
+
+// Start the next contiguous chunk of the TX ring if the channel is idle
+static void pio_uart_tx_kick(struct pio_uart_port *p) {
+    const char *buf;
+    int len;
+
+    if (p->tx_len || dma_channel_is_busy(p->tx_dma))
+        return;
+    buf = ringbuf_get_ptr(&p->tx_ring, &len);
+    if (len > 0) {
+        p->tx_len = len;
+        dma_channel_transfer_from_buffer_now(p->tx_dma, buf, len);
+    }
+}
+
+static void pio_uart_dma_irq_handler(void) {
+    BaseType_t woken = pdFALSE;
+    struct pio_uart_port *p;
+    int i;
+
+    for (i = 0; i < PROBE_PIO_UART_COUNT; i++) {
+        p = &ports[i];
+        if (!p->initted || !dma_channel_get_irq1_status(p->tx_dma))
+            continue;
+        dma_channel_acknowledge_irq1(p->tx_dma);
+        ringbuf_consume(&p->tx_ring, p->tx_len);
+        p->tx_len = 0;
+        pio_uart_tx_kick(p);
+        if (pio_uart_taskhandle)
+            vTaskNotifyGiveFromISR(pio_uart_taskhandle, &woken);
+    }
+    portYIELD_FROM_ISR(woken);
+}
+
+// Publish what the RX channel wrote since the last call
+static void pio_uart_rx_sync(struct pio_uart_port *p) {
+    uint32_t put = ringbuf_dma_put(&p->rx_ring, dma_channel_hw_addr(p->rx_dma)->write_addr);
+    uint32_t count = dma_channel_hw_addr(p->rx_dma)->transfer_count;
+
+    ringbuf_dma_produce(&p->rx_ring, put, ringbuf_dma_received(p->rx_count, count, rx_dma_reload));
+    p->rx_count = count;
+}
+
+static bool pio_uart_port_task(struct pio_uart_port *p, uint8_t itf) {
+    bool keep_alive = false;
+    const char *rx_buf;
+    char *tx_buf;
+    int len;
+
+    if (tud_cdc_n_available(itf)) {
+        tx_buf = ringbuf_puts_ptr(&p->tx_ring, &len);
+        len = MIN(len, (int)tud_cdc_n_available(itf));
+        if (len > 0) {
+            tud_cdc_n_read(itf, tx_buf, len);
+            irq_set_enabled(DMA_IRQ_1, false);
+            ringbuf_produce(&p->tx_ring, len);
+            pio_uart_tx_kick(p);
+            irq_set_enabled(DMA_IRQ_1, true);
+            keep_alive = true;
+        }
+    }
+
+    pio_uart_rx_sync(p);
+    rx_buf = ringbuf_get_ptr(&p->rx_ring, &len);
+    len = MIN(len, (int)tud_cdc_n_write_available(itf));
+    if (len > 0) {
+        tud_cdc_n_write(itf, rx_buf, len);
+        tud_cdc_n_write_flush(itf);
+        ringbuf_consume(&p->rx_ring, len);
+        keep_alive = true;
+    }
+
+    return keep_alive;
+}
+
+void pio_uart_thread(void *ptr) {
+    bool keep_alive;
+    int i;
+
+    /* DMA_IRQ_1 is only enabled on core 0, which makes masking it there a
+     * critical section against the TX completion handler */
+#if (configNUMBER_OF_CORES > 1)
+    vTaskCoreAffinitySet(NULL, 1 << 0);
+#endif
+
+    while (1) {
+        keep_alive = false;
+        for (i = 0; i < PROBE_PIO_UART_COUNT; i++) {
+            if (ports[i].initted && tud_cdc_n_connected(PIO_UART_USB_PORT_BASE + i))
+                keep_alive |= pio_uart_port_task(&ports[i], PIO_UART_USB_PORT_BASE + i);
+        }
+        // Woken early by the USB callbacks and TX completion, RX is polled
+        if (!keep_alive)
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(PIO_UART_POLL_MS));
+    }
+}
+
+bool pio_uart_line_coding(uint8_t itf, cdc_line_coding_t const *line_coding) {
+    struct pio_uart_port *p;
+
+    if (itf < PIO_UART_USB_PORT_BASE || itf >= PIO_UART_USB_PORT_BASE + PROBE_PIO_UART_COUNT)
+        return false;
+    p = &ports[itf - PIO_UART_USB_PORT_BASE];
+    if (!p->initted)
+        return true;
+
+    if (line_coding->data_bits != 8 || line_coding->parity != CDC_LINE_CODING_PARITY_NONE ||
+        line_coding->stop_bits != CDC_LINE_CONDING_STOP_BITS_1)
+        probe_info("PIO UART %u only does 8N1\n", itf - PIO_UART_USB_PORT_BASE);
+
+    // Only the divider changes, the SMs and both rings keep running
+    pio_uart_set_baud(p, line_coding->bit_rate);
+    probe_info("PIO UART %u baud rate %lu\n", itf - PIO_UART_USB_PORT_BASE, p->baud);
+    return true;
+}
+
+bool pio_uart_notify(uint8_t itf) {
+    if (itf < PIO_UART_USB_PORT_BASE || itf >= PIO_UART_USB_PORT_BASE + PROBE_PIO_UART_COUNT)
+        return false;
+    if (pio_uart_taskhandle)
+        xTaskNotifyGive(pio_uart_taskhandle);
+    return true;
+}
+
+void pio_uart_init(void) {
+    int i;
+
+    for (i = 0; i < PROBE_PIO_UART_COUNT; i++)
+        pio_uart_port_init(&ports[i], rx_data[i], tx_data[i]);
+
+    irq_add_shared_handler(DMA_IRQ_1, pio_uart_dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_1, true);
+}
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef PIO_UART_H_
+#define PIO_UART_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tusb.h"
+#include "DAP_config.h"
+
+/*
+ * The PIO ports follow the other CDC interfaces: UART, GDB and, when the
+ * board has SWO, ITM.
+ */
+#if ((SWO_UART != 0) || (SWO_MANCHESTER != 0))
+#define PIO_UART_USB_PORT_BASE  3
+#else
+#define PIO_UART_USB_PORT_BASE  2
+#endif
+
+#if PROBE_PIO_UART_COUNT
+
+void pio_uart_init(void);
+void pio_uart_thread(void *ptr);
+
+// CDC callbacks for the PIO ports, return false if itf is not one of them
+bool pio_uart_line_coding(uint8_t itf, cdc_line_coding_t const *line_coding);
+bool pio_uart_notify(uint8_t itf);
+
+extern TaskHandle_t pio_uart_taskhandle;
+
+#endif
+
+#endif
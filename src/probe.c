@@ -118,7 +118,7 @@ static inline uint32_t fmt_probe_command(uint bit_count, bool out_en, probe_pio_
     return ((bit_count - 1) & 0xff) | ((uint)out_en << 8) | (cmd_addr << 9);
 }
 
-void probe_write_bits(uint bit_count, uint32_t data_byte) {
+void __probe_hot_func(probe_write_bits)(uint bit_count, uint32_t data_byte) {
     DEBUG_PINS_SET(probe_timing, DBG_PIN_WRITE);
     pio_sm_put_blocking(pio0, PROBE_SM, fmt_probe_command(bit_count, true, CMD_WRITE));
     pio_sm_put_blocking(pio0, PROBE_SM, data_byte);
@@ -127,12 +127,12 @@ void probe_write_bits(uint bit_count, uint32_t data_byte) {
     DEBUG_PINS_CLR(probe_timing, DBG_PIN_WRITE);
 }
 
-void probe_hiz_clocks(uint bit_count) {
+void __probe_hot_func(probe_hiz_clocks)(uint bit_count) {
     pio_sm_put_blocking(pio0, PROBE_SM, fmt_probe_command(bit_count, false, CMD_TURNAROUND));
     pio_sm_put_blocking(pio0, PROBE_SM, 0);
 }
 
-uint32_t probe_read_bits(uint bit_count) {
+uint32_t __probe_hot_func(probe_read_bits)(uint bit_count) {
     DEBUG_PINS_SET(probe_timing, DBG_PIN_READ);
     pio_sm_put_blocking(pio0, PROBE_SM, fmt_probe_command(bit_count, false, CMD_READ));
     uint32_t data = pio_sm_get_blocking(pio0, PROBE_SM);
@@ -182,6 +182,22 @@ void probe_init() {
     }
 }
 
+/* Other PIO users can load into pio0 before the first connect loads the
+ * SWD engine. Holding its space while they check and add their programs
+ * keeps room for it. */
+int probe_pio0_hold(void) {
+    if (probe.initted)
+        return PROBE_PIO0_LOADED;
+    if (!pio_can_add_program(pio0, &probe_program))
+        return PROBE_PIO0_FULL;
+    return pio_add_program(pio0, &probe_program);
+}
+
+void probe_pio0_release(int hold) {
+    if (hold >= 0)
+        pio_remove_program(pio0, &probe_program, hold);
+}
+
 void probe_deinit(void)
 {
 #if 0
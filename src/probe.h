@@ -47,6 +47,14 @@ void probe_write_mode(void);
 
 void probe_init(void);
 void probe_deinit(void);
+
+/* Reserves the SWD engine's space in pio0 for code adding its own programs
+ * there, released again once they are added. Returns the value to release,
+ * PROBE_PIO0_FULL if the engine would no longer fit. */
+#define PROBE_PIO0_LOADED   -1
+#define PROBE_PIO0_FULL     -2
+int probe_pio0_hold(void);
+void probe_pio0_release(int hold);
 void probe_assert_reset(bool state);
 int probe_reset_level(void);
 
@@ -29,6 +29,8 @@
 #include "FreeRTOS.h"
 #include "task.h"
 
+#include <pico/platform.h>
+
 #if false
 #define probe_info(format,args...) \
 do { \
@@ -72,6 +74,40 @@ do { \
 #endif
 //#include "board_example_config.h"
 
+// First of the 8 consecutive GPIOs sampled by the SWD capture mode. nRESET
+// is only recorded if the board puts it inside this window.
+#ifndef PROBE_CAPTURE_PIN_BASE
+#define PROBE_CAPTURE_PIN_BASE PROBE_PIN_OFFSET
+#endif
+
+// Extra UART bridges on spare PIO state machines, each on its own CDC
+// interface. A board opts in by defining the pins of port 0 and port 1.
+#if defined(PROBE_PIO_UART1_TX)
+#define PROBE_PIO_UART_COUNT 2
+#elif defined(PROBE_PIO_UART0_TX)
+#define PROBE_PIO_UART_COUNT 1
+#else
+#define PROBE_PIO_UART_COUNT 0
+#endif
+
+#ifndef PROBE_PIO_UART_BAUDRATE
+#define PROBE_PIO_UART_BAUDRATE 115200
+#endif
+
+// The SWD engine, DAP dispatch and ring buffers run from SRAM, so an XIP
+// cache miss caused by USB or UART code can't stall a transfer
+#ifndef PROBE_HOT_PATH_IN_RAM
+#define PROBE_HOT_PATH_IN_RAM 0
+#endif
+
+#if PROBE_HOT_PATH_IN_RAM
+#define __probe_hot_func(func) __not_in_flash_func(func)
+#define __probe_hot_data __not_in_flash("probe")
+#else
+#define __probe_hot_func(func) func
+#define __probe_hot_data
+#endif
+
 // Add the configuration to binary information
 void bi_decl_config();
 
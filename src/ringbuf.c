@@ -1,6 +1,8 @@
 #include "ringbuf.h"
 #include <string.h>
 
+#include "probe_config.h"
+
 int ringbuf_init(struct ringbuf *r, char *dataptr, unsigned int size)
 {
     if(!dataptr || size == 0){
@@ -21,7 +23,7 @@ void ringbuf_reset(struct ringbuf *r){
     r->get_ptr = 0;
 }
 
-int ringbuf_put(struct ringbuf *r, char c)
+int __probe_hot_func(ringbuf_put)(struct ringbuf *r, char c)
 {
     if (((r->put_ptr - r->get_ptr) & r->mask) == r->mask)
     {
@@ -32,7 +34,7 @@ int ringbuf_put(struct ringbuf *r, char c)
     return 0;
 }
 
-int ringbuf_get(struct ringbuf *r)
+int __probe_hot_func(ringbuf_get)(struct ringbuf *r)
 {
     char c;
     if (((r->put_ptr - r->get_ptr) & r->mask) > 0)
@@ -52,12 +54,12 @@ int ringbuf_size(const struct ringbuf *r)
     return r->mask + 1;
 }
 
-int ringbuf_elements(const struct ringbuf *r)
+int __probe_hot_func(ringbuf_elements)(const struct ringbuf *r)
 {
     return (r->put_ptr - r->get_ptr) & r->mask;
 }
 
-int ringbuf_free(const struct ringbuf *r){
+int __probe_hot_func(ringbuf_free)(const struct ringbuf *r){
     return r->mask - ((r->put_ptr - r->get_ptr) & r->mask);
 }
 
@@ -82,7 +84,7 @@ int ringbuf_query(const struct ringbuf *r, int idx)
     return r->data[(idx + r->get_ptr) & r->mask];
 }
 
-int ringbuf_puts(struct ringbuf *r, const char *buf, int len){
+int __probe_hot_func(ringbuf_puts)(struct ringbuf *r, const char *buf, int len){
     if(ringbuf_size(r) - ringbuf_elements(r) <= len){
         return -1;
     }
@@ -104,7 +106,7 @@ int ringbuf_puts(struct ringbuf *r, const char *buf, int len){
     return 0;
 }
 
-int ringbuf_gets(struct ringbuf *r, char *buf, int len){
+int __probe_hot_func(ringbuf_gets)(struct ringbuf *r, char *buf, int len){
     if(ringbuf_elements(r) < len){
         return -1;
     }
@@ -127,7 +129,7 @@ int ringbuf_gets(struct ringbuf *r, char *buf, int len){
 }
 
 // Get read buffer pointer
-const char* ringbuf_get_ptr(const struct ringbuf *r, int* max_len){
+const char* __probe_hot_func(ringbuf_get_ptr)(const struct ringbuf *r, int* max_len){
     *max_len = r->put_ptr - r->get_ptr;
     if(*max_len < 0){
         *max_len = r->mask - r->get_ptr + 1;
@@ -136,12 +138,12 @@ const char* ringbuf_get_ptr(const struct ringbuf *r, int* max_len){
 }
 
 // Declare that the specified length of data has been read
-void ringbuf_consume(struct ringbuf *r, int len){
+void __probe_hot_func(ringbuf_consume)(struct ringbuf *r, int len){
     r->get_ptr = (r->get_ptr + len) & r->mask;
 }
 
 // Get write buffer pointer
-char* ringbuf_puts_ptr(const struct ringbuf *r, int* max_len){
+char* __probe_hot_func(ringbuf_puts_ptr)(const struct ringbuf *r, int* max_len){
     unsigned int get_ptr_shadow = r->get_ptr;
     if(r->put_ptr < get_ptr_shadow){
         *max_len = get_ptr_shadow - r->put_ptr - 1;
@@ -155,6 +157,31 @@ char* ringbuf_puts_ptr(const struct ringbuf *r, int* max_len){
 }
 
 // Declare that data of the specified length has been written
-void ringbuf_produce(struct ringbuf *r, int len){
+void __probe_hot_func(ringbuf_produce)(struct ringbuf *r, int len){
     r->put_ptr = (r->put_ptr + len) & r->mask;
 }
+
+// Ring position the channel writes next
+unsigned int ringbuf_dma_put(const struct ringbuf *r, uintptr_t write_addr)
+{
+    return (write_addr - (uintptr_t)r->data) & r->mask;
+}
+
+// Bytes written between two reads of the count, across at most one reload
+unsigned int ringbuf_dma_received(uint32_t last_count, uint32_t count, uint32_t reload)
+{
+    return (last_count - count) & (reload - 1);
+}
+
+// Publish what the channel wrote, returns 1 if it lapped the reader
+int ringbuf_dma_produce(struct ringbuf *r, unsigned int put, unsigned int received)
+{
+    int overrun = received > (unsigned int)ringbuf_free(r);
+
+    // Only the newest bytes are intact, the reader restarts from the oldest of them
+    if(overrun){
+        r->get_ptr = (put + 1) & r->mask;
+    }
+    r->put_ptr = put;
+    return overrun;
+}
@@ -1,6 +1,8 @@
 #ifndef RINGBUF_H_
 #define RINGBUF_H_
 
+#include <stdint.h>
+
 #define RINGBUF_STATIC_ALLOC(name, size) \
     static char ringbuf_data_##name[size]; \
     static struct ringbuf name = \
@@ -45,4 +47,15 @@ void ringbuf_produce(struct ringbuf *r, int len);
 
 int ringbuf_printf(struct ringbuf *r, const char *fmt, ...);
 
+/*
+ * Rings filled by a DMA channel in ring mode: the write address wraps round
+ * the buffer in hardware and the transfer count is reloaded from a power of
+ * two whenever it runs out, so the channel never stops.
+ */
+unsigned int ringbuf_dma_put(const struct ringbuf *r, uintptr_t write_addr);
+
+unsigned int ringbuf_dma_received(uint32_t last_count, uint32_t count, uint32_t reload);
+
+int ringbuf_dma_produce(struct ringbuf *r, unsigned int put, unsigned int received);
+
 #endif
@@ -28,6 +28,8 @@
 #include "DAP_config.h"
 #include "DAP.h"
 #include "probe.h"
+#include "swd_capture.h"
+#include "dap_mem.h"
 
 /* Slight hack - we're not bitbashing so we need to set baudrate off the DAP's delay cycles.
  * Ideally we don't want calls to udiv everywhere... */
@@ -39,7 +41,7 @@ volatile uint32_t cached_delay = 0;
 //   data:   pointer to sequence bit data
 //   return: none
 #if ((DAP_SWD != 0) || (DAP_JTAG != 0))
-void SWJ_Sequence (uint32_t count, const uint8_t *data) {
+void __probe_hot_func(SWJ_Sequence) (uint32_t count, const uint8_t *data) {
   uint32_t bits;
   uint32_t n;
 
@@ -66,7 +68,7 @@ void SWJ_Sequence (uint32_t count, const uint8_t *data) {
 //   swdi:   pointer to SWDIO captured data
 //   return: none
 #if (DAP_SWD != 0)
-void SWD_Sequence (uint32_t info, const uint8_t *swdo, uint8_t *swdi) {
+void __probe_hot_func(SWD_Sequence) (uint32_t info, const uint8_t *swdo, uint8_t *swdi) {
   uint32_t bits;
   uint32_t n;
 
@@ -103,38 +105,32 @@ void SWD_Sequence (uint32_t info, const uint8_t *swdo, uint8_t *swdi) {
 #endif
 
 #if (DAP_SWD != 0)
-// SWD Transfer I/O
-//   request: A[3:2] RnW APnDP
-//   data:    DATA[31:0]
-//   return:  ACK[2:0]
-uint8_t SWD_Transfer (uint32_t request, uint32_t *data) {
-  uint8_t prq = 0;
+/* Request byte for A[3:2] RnW APnDP: start, parity, stop and park bits included */
+static const uint8_t __probe_hot_data swd_request_byte[16] = {
+  0x81, 0xA3, 0xA5, 0x87, 0xA9, 0x8B, 0x8D, 0xAF,
+  0xB1, 0x93, 0x95, 0xB7, 0x99, 0xBB, 0xBD, 0x9F,
+};
+
+/* The transfer body is instantiated once with the configuration as run time
+ * values and once with the default configuration folded in as constants. */
+static inline __attribute__((always_inline))
+uint8_t swd_transfer_body (uint32_t request, uint32_t *data,
+                           uint32_t turnaround, uint32_t data_phase, uint32_t idle_cycles) {
+  uint8_t prq;
   uint8_t ack;
   uint8_t bit;
   uint32_t val = 0;
   uint32_t parity = 0;
   uint32_t n;
 
-  if (DAP_Data.clock_delay != cached_delay) {
-    probe_set_swclk_freq(MAKE_KHZ(DAP_Data.clock_delay));
-    cached_delay = DAP_Data.clock_delay;
-  }
   probe_debug("SWD_transfer\n");
   /* Generate the request packet */
-  prq |= (1 << 0); /* Start Bit */
-  for (n = 1; n < 5; n++) {
-    bit = (request >> (n - 1)) & 0x1;
-    prq |= bit << n;
-    parity += bit;
-  }
-  prq |= (parity & 0x1) << 5; /* Parity Bit */
-  prq |= (0 << 6); /* Stop Bit */
-  prq |= (1 << 7); /* Park bit */
+  prq = swd_request_byte[request & 0xFU];
   probe_write_bits(8, prq);
 
   /* Turnaround (ignore read bits) */
-  ack = probe_read_bits(DAP_Data.swd_conf.turnaround + 3);
-  ack >>= DAP_Data.swd_conf.turnaround;
+  ack = probe_read_bits(turnaround + 3);
+  ack >>= turnaround;
 
   if (ack == DAP_TRANSFER_OK) {
     /* Data transfer phase */
@@ -152,10 +148,10 @@ uint8_t SWD_Transfer (uint32_t request, uint32_t *data) {
       probe_debug("Read %02x ack %02x 0x%08x parity %01x\n",
                       prq, ack, val, bit);
       /* Turnaround for line idle */
-      probe_hiz_clocks(DAP_Data.swd_conf.turnaround);
+      probe_hiz_clocks(turnaround);
     } else {
       /* Turnaround for write */
-      probe_hiz_clocks(DAP_Data.swd_conf.turnaround);
+      probe_hiz_clocks(turnaround);
 
       /* Write WDATA[0:31] */
       val = *data;
@@ -165,6 +161,10 @@ uint8_t SWD_Transfer (uint32_t request, uint32_t *data) {
       probe_write_bits(1, parity & 0x1);
       probe_debug("write %02x ack %02x 0x%08x parity %01x\n",
                       prq, ack, val, parity);
+      /* Shadow DP SELECT, it is write-only but background accesses must restore it */
+      if ((request & (DAP_TRANSFER_APnDP | DAP_TRANSFER_A2 | DAP_TRANSFER_A3)) == DP_SELECT) {
+        swd_dp_select = val;
+      }
     }
     /* Capture Timestamp */
     if (request & DAP_TRANSFER_TIMESTAMP) {
@@ -172,8 +172,8 @@ uint8_t SWD_Transfer (uint32_t request, uint32_t *data) {
     }
 
     /* Idle cycles - drive 0 for N clocks */
-    if (DAP_Data.transfer.idle_cycles) {
-      for (n = DAP_Data.transfer.idle_cycles; n; ) {
+    if (idle_cycles) {
+      for (n = idle_cycles; n; ) {
         if (n > 256) {
           probe_write_bits(256, 0);
           n -= 256;
@@ -186,13 +186,15 @@ uint8_t SWD_Transfer (uint32_t request, uint32_t *data) {
     return ((uint8_t)ack);
   }
 
+  swd_capture_ack(ack);
+
   if ((ack == DAP_TRANSFER_WAIT) || (ack == DAP_TRANSFER_FAULT)) {
-    if (DAP_Data.swd_conf.data_phase && ((request & DAP_TRANSFER_RnW) != 0U)) {
+    if (data_phase && ((request & DAP_TRANSFER_RnW) != 0U)) {
       /* Dummy Read RDATA[0:31] + Parity */
       probe_read_bits(33);
     }
-    probe_hiz_clocks(DAP_Data.swd_conf.turnaround);
-    if (DAP_Data.swd_conf.data_phase && ((request & DAP_TRANSFER_RnW) == 0U)) {
+    probe_hiz_clocks(turnaround);
+    if (data_phase && ((request & DAP_TRANSFER_RnW) == 0U)) {
       /* Dummy Write WDATA[0:31] + Parity */
       probe_write_bits(32, 0);
       probe_write_bits(1, 0);
@@ -201,10 +203,61 @@ uint8_t SWD_Transfer (uint32_t request, uint32_t *data) {
   }
 
   /* Protocol error */
-  n = DAP_Data.swd_conf.turnaround + 32U + 1U;
+  n = turnaround + 32U + 1U;
   /* Back off data phase */
   probe_read_bits(n);
   return ((uint8_t)ack);
 }
 
+static uint8_t __probe_hot_func(swd_transfer_generic) (uint32_t request, uint32_t *data) {
+  return swd_transfer_body(request, data, DAP_Data.swd_conf.turnaround,
+                           DAP_Data.swd_conf.data_phase, DAP_Data.transfer.idle_cycles);
+}
+
+/* Turnaround 1, no data phase on WAIT/FAULT, no idle cycles */
+static uint8_t __probe_hot_func(swd_transfer_default) (uint32_t request, uint32_t *data) {
+  return swd_transfer_body(request, data, 1U, 0U, 0U);
+}
+
+static uint8_t (*swd_transfer_fn)(uint32_t request, uint32_t *data) = swd_transfer_generic;
+
+/* DAP_SWD_Configure and DAP_TransferConfigure live in the CMSIS sources, so
+ * the variant is rebound the first time a transfer sees a new configuration,
+ * the same way the clock is picked up from clock_delay. */
+static uint32_t cached_swd_conf = 0xFFFFFFFFU;
+
+static inline uint32_t swd_conf_key (void) {
+  return DAP_Data.swd_conf.turnaround |
+         ((uint32_t)DAP_Data.swd_conf.data_phase << 8) |
+         ((uint32_t)DAP_Data.transfer.idle_cycles << 16);
+}
+
+static void swd_transfer_bind (uint32_t key) {
+  if (DAP_Data.swd_conf.turnaround == 1U && DAP_Data.swd_conf.data_phase == 0U &&
+      DAP_Data.transfer.idle_cycles == 0U) {
+    swd_transfer_fn = swd_transfer_default;
+  } else {
+    swd_transfer_fn = swd_transfer_generic;
+  }
+  cached_swd_conf = key;
+}
+
+// SWD Transfer I/O
+//   request: A[3:2] RnW APnDP
+//   data:    DATA[31:0]
+//   return:  ACK[2:0]
+uint8_t __probe_hot_func(SWD_Transfer) (uint32_t request, uint32_t *data) {
+  uint32_t key;
+
+  if (DAP_Data.clock_delay != cached_delay) {
+    probe_set_swclk_freq(MAKE_KHZ(DAP_Data.clock_delay));
+    cached_delay = DAP_Data.clock_delay;
+  }
+  key = swd_conf_key();
+  if (key != cached_swd_conf) {
+    swd_transfer_bind(key);
+  }
+  return swd_transfer_fn(request, data);
+}
+
 #endif  /* (DAP_SWD != 0) */
@@ -0,0 +1,338 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <pico/stdlib.h>
+
+#include <hardware/clocks.h>
+#include <hardware/dma.h>
+#include <hardware/irq.h>
+#include <hardware/pio.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "probe_config.h"
+#include "swd_capture.h"
+#include "swd_capture.pio.h"
+#include "tusb_stream.h"
+#include "DAP.h"
+#include "dap_job.h"
+#include "dap_vendor.h"
+
+/*
+ * The capture runs on pio1 so it never competes with PROBE_SM for
+ * instruction memory or FIFO bandwidth on pio0. Samples go round a DMA
+ * ring until the trigger fires, then the post-trigger part is allowed to
+ * fill before the SM is stopped and the buffer is handed to the stream
+ * endpoint by a job on the DAP thread. The raw data is one byte per sample, bit n being GPIO
+ * (PROBE_CAPTURE_PIN_BASE + n), which sigrok reads with the "binary"
+ * input format.
+ */
+#define CAPTURE_PIO pio1
+#define CAPTURE_BUF_BITS 14
+#define CAPTURE_BUF_SIZE (1u << CAPTURE_BUF_BITS)
+
+/*
+ * The capture channel never runs out: when its count reaches zero it chains
+ * to a control channel that reloads it, and the control channel's interrupt
+ * counts the reloads. The reload is a whole number of buffer laps, so the
+ * count still gives the position in the ring.
+ */
+#define CAPTURE_BUF_WORDS   (CAPTURE_BUF_SIZE / 4)
+#define CAPTURE_RELOAD      (0xFFFFFFFFu & ~(CAPTURE_BUF_WORDS - 1))
+
+// Trigger on any failed ACK by default
+#define CAPTURE_DEFAULT_TRIGGER (DAP_TRANSFER_WAIT | DAP_TRANSFER_FAULT | DAP_TRANSFER_ERROR)
+
+static uint8_t capture_buf[CAPTURE_BUF_SIZE] __attribute__((aligned(CAPTURE_BUF_SIZE)));
+static const uint32_t capture_reload = CAPTURE_RELOAD;
+static struct ringbuf capture_ring;
+
+volatile uint8_t swd_capture_state;
+
+static struct {
+    bool initted;
+    int sm;
+    int dma_ch;
+    int ctrl_ch;
+    dma_channel_config dma_config;
+    uint offset;
+    uint8_t trigger_mask;
+    uint8_t trigger_ack;
+    uint32_t rate;
+    uint32_t post_samples;
+    // Words written since arming, from the reload count and the DMA transfer count
+    volatile uint32_t reloads;
+    uint64_t trigger_words;
+    uint64_t total_words;
+    bool wrapped;
+    uint32_t length;
+} capture;
+
+static void capture_dma_irq_handler(void) {
+    if (capture.initted && dma_channel_get_irq1_status(capture.ctrl_ch)) {
+        dma_channel_acknowledge_irq1(capture.ctrl_ch);
+        capture.reloads++;
+    }
+}
+
+static bool swd_capture_init(void) {
+    if (capture.initted)
+        return true;
+
+    if (!pio_can_add_program(CAPTURE_PIO, &swd_capture_program))
+        return false;
+    capture.sm = pio_claim_unused_sm(CAPTURE_PIO, false);
+    if (capture.sm < 0)
+        return false;
+    capture.dma_ch = dma_claim_unused_channel(false);
+    capture.ctrl_ch = dma_claim_unused_channel(false);
+    if (capture.dma_ch < 0 || capture.ctrl_ch < 0) {
+        if (capture.dma_ch >= 0)
+            dma_channel_unclaim(capture.dma_ch);
+        if (capture.ctrl_ch >= 0)
+            dma_channel_unclaim(capture.ctrl_ch);
+        pio_sm_unclaim(CAPTURE_PIO, capture.sm);
+        return false;
+    }
+
+    capture.offset = pio_add_program(CAPTURE_PIO, &swd_capture_program);
+    swd_capture_sm_init(CAPTURE_PIO, capture.sm, capture.offset, PROBE_CAPTURE_PIN_BASE);
+
+    ringbuf_init(&capture_ring, (char *)capture_buf, CAPTURE_BUF_SIZE);
+    dma_channel_set_irq1_enabled(capture.ctrl_ch, true);
+    irq_add_shared_handler(DMA_IRQ_1, capture_dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+#if (configNUMBER_OF_CORES > 1)
+    /* DMA_IRQ_1 must only ever be enabled on core 0: pio_uart masks it
+     * there to guard its ring state, which would not cover a handler
+     * running on core 1. Hop over to core 0 just for the enable. */
+    UBaseType_t affinity = vTaskCoreAffinityGet(NULL);
+    vTaskCoreAffinitySet(NULL, 1 << 0);
+    irq_set_enabled(DMA_IRQ_1, true);
+    vTaskCoreAffinitySet(NULL, affinity);
+#else
+    irq_set_enabled(DMA_IRQ_1, true);
+#endif
+    capture.initted = true;
+    return true;
+}
+
+static uint64_t capture_words_written(void) {
+    uint32_t reloads, count;
+
+    // Read again if a reload came in between the two
+    do {
+        reloads = capture.reloads;
+        count = dma_channel_hw_addr(capture.dma_ch)->transfer_count;
+    } while (reloads != capture.reloads);
+
+    return (uint64_t)reloads * CAPTURE_RELOAD + (CAPTURE_RELOAD - count);
+}
+
+// Samples from the trigger to the end of the capture
+static inline uint32_t capture_post_samples(void) {
+    return (uint32_t)(capture.total_words - capture.trigger_words) * 4;
+}
+
+// Point the ring buffer at the captured window, oldest sample first
+static bool capture_publish(void) {
+    uint32_t wr = (uint32_t)(capture.total_words * 4) & (CAPTURE_BUF_SIZE - 1);
+
+    stream_detach(&capture_ring);
+    ringbuf_reset(&capture_ring);
+    ringbuf_produce(&capture_ring, wr);
+    if (capture.wrapped) {
+        // Full ring: the sample at wr is the oldest, the ring buffer can only hand out size - 1
+        ringbuf_consume(&capture_ring, wr + 1);
+    }
+    capture.length = ringbuf_elements(&capture_ring);
+    return stream_attach(&capture_ring);
+}
+
+// Stream endpoint ownership is taken in task context, not from the alarm
+static void capture_publish_job(void) {
+    if (swd_capture_state == CAPTURE_DONE)
+        capture_publish();
+}
+
+static void capture_stop(void) {
+    pio_sm_set_enabled(CAPTURE_PIO, capture.sm, false);
+    // Unchain first, an aborted channel can still fire its chain trigger
+    channel_config_set_chain_to(&capture.dma_config, capture.dma_ch);
+    dma_channel_set_config(capture.dma_ch, &capture.dma_config, false);
+    dma_channel_abort(capture.dma_ch);
+    dma_channel_abort(capture.ctrl_ch);
+}
+
+static int64_t capture_post_trigger_done(alarm_id_t id, void *user_data) {
+    capture_stop();
+    capture.total_words = capture_words_written();
+    capture.wrapped = capture.total_words >= CAPTURE_BUF_WORDS;
+    swd_capture_state = CAPTURE_DONE;
+    dap_job_kick_from_isr(capture_publish_job);
+    return 0;
+}
+
+// ack is DAP_TRANSFER_OK for a trigger forced by the host
+void swd_capture_fire(uint8_t ack) {
+    uint8_t cls;
+
+    if (swd_capture_state != CAPTURE_ARMED)
+        return;
+
+    // Anything other than WAIT/FAULT is a protocol error
+    cls = (ack == DAP_TRANSFER_WAIT || ack == DAP_TRANSFER_FAULT) ? ack : DAP_TRANSFER_ERROR;
+    if (ack != DAP_TRANSFER_OK && !(cls & capture.trigger_mask))
+        return;
+
+    capture.trigger_words = capture_words_written();
+    capture.trigger_ack = ack;
+    swd_capture_state = CAPTURE_TRIGGERED;
+
+    uint64_t post_us = ((uint64_t)capture.post_samples * 1000000u) / capture.rate + 1;
+    add_alarm_in_us(post_us, capture_post_trigger_done, NULL, true);
+}
+
+static bool swd_capture_arm(uint32_t rate, uint8_t post_percent, uint8_t trigger_mask) {
+    uint32_t clk_sys_freq = clock_get_hz(clk_sys);
+    uint16_t div_int;
+    uint8_t div_frac;
+
+    if (!swd_capture_init())
+        return false;
+
+    if (swd_capture_state == CAPTURE_ARMED || swd_capture_state == CAPTURE_TRIGGERED)
+        capture_stop();
+    swd_capture_state = CAPTURE_IDLE;
+    stream_detach(&capture_ring);
+    /* Without the job (CMSIS-DAP v1) the capture is only sent on
+     * SWD_CAPTURE_UPLOAD */
+    dap_job_start(capture_publish_job, 0);
+
+    if (rate == 0 || rate > clk_sys_freq)
+        rate = clk_sys_freq;
+    float divider = (float)clk_sys_freq / rate;
+    if (divider > 65535.0f)
+        divider = 65535.0f;
+    pio_calculate_clkdiv_from_float(divider, &div_int, &div_frac);
+    pio_sm_set_clkdiv_int_frac(CAPTURE_PIO, capture.sm, div_int, div_frac);
+    capture.rate = (float)clk_sys_freq / (div_int + div_frac / 256.0f);
+
+    if (post_percent > 100)
+        post_percent = 100;
+    capture.post_samples = (CAPTURE_BUF_SIZE - 1) * post_percent / 100;
+    capture.trigger_mask = trigger_mask ? trigger_mask : CAPTURE_DEFAULT_TRIGGER;
+    capture.trigger_ack = 0;
+    // Drop any reload left pending by the abort of the last capture
+    dma_channel_acknowledge_irq1(capture.ctrl_ch);
+    capture.reloads = 0;
+    capture.trigger_words = 0;
+    capture.total_words = 0;
+    capture.wrapped = false;
+    capture.length = 0;
+
+    pio_sm_clear_fifos(CAPTURE_PIO, capture.sm);
+    pio_sm_restart(CAPTURE_PIO, capture.sm);
+    pio_sm_exec(CAPTURE_PIO, capture.sm, pio_encode_jmp(capture.offset));
+
+    dma_channel_config *c = &capture.dma_config;
+    *c = dma_channel_get_default_config(capture.dma_ch);
+    channel_config_set_transfer_data_size(c, DMA_SIZE_32);
+    channel_config_set_read_increment(c, false);
+    channel_config_set_write_increment(c, true);
+    channel_config_set_ring(c, true, CAPTURE_BUF_BITS);
+    channel_config_set_dreq(c, pio_get_dreq(CAPTURE_PIO, capture.sm, false));
+    channel_config_set_chain_to(c, capture.ctrl_ch);
+    dma_channel_configure(capture.dma_ch, c, capture_buf, &CAPTURE_PIO->rxf[capture.sm], CAPTURE_RELOAD, false);
+
+    dma_channel_config cc = dma_channel_get_default_config(capture.ctrl_ch);
+    channel_config_set_transfer_data_size(&cc, DMA_SIZE_32);
+    channel_config_set_read_increment(&cc, false);
+    channel_config_set_write_increment(&cc, false);
+    dma_channel_configure(capture.ctrl_ch, &cc, &dma_hw->ch[capture.dma_ch].al1_transfer_count_trig,
+                          &capture_reload, 1, false);
+    dma_channel_start(capture.dma_ch);
+
+    swd_capture_state = CAPTURE_ARMED;
+    pio_sm_set_enabled(CAPTURE_PIO, capture.sm, true);
+    return true;
+}
+
+// Vendor command: request  [sub-command][parameters]
+//                 response [status][data]
+uint32_t swd_capture_command(const uint8_t *request, uint8_t *response) {
+    uint8_t *resp = response + 1;
+    uint32_t req_len = 1;
+    uint32_t length = 0, trigger = 0, post;
+    bool trigger_lost = false;
+    bool ok = true;
+
+    switch (*request) {
+    case SWD_CAPTURE_ARM: {
+        uint32_t rate = get_u32(&request[1]);
+        req_len += 6;
+        ok = swd_capture_arm(rate, request[5], request[6]);
+        resp = put_u32(resp, capture.rate);
+        break;
+    }
+    case SWD_CAPTURE_TRIGGER:
+        ok = swd_capture_state == CAPTURE_ARMED;
+        swd_capture_fire(DAP_TRANSFER_OK);
+        break;
+    case SWD_CAPTURE_ABORT:
+        if (swd_capture_state == CAPTURE_ARMED || swd_capture_state == CAPTURE_TRIGGERED)
+            capture_stop();
+        swd_capture_state = CAPTURE_IDLE;
+        stream_detach(&capture_ring);
+        break;
+    case SWD_CAPTURE_UPLOAD:
+        // Send the last capture again, e.g. when the endpoint was owned by someone else
+        ok = swd_capture_state == CAPTURE_DONE && capture_publish();
+        break;
+    case SWD_CAPTURE_STATUS:
+        if (swd_capture_state == CAPTURE_DONE) {
+            length = capture.length;
+            // Trigger position within the uploaded window, 0 and flagged if a late stop pushed it out
+            post = capture_post_samples();
+            trigger_lost = post > length;
+            trigger = trigger_lost ? 0 : length - post;
+        }
+        *resp++ = swd_capture_state;
+        *resp++ = PROBE_CAPTURE_PIN_BASE;
+        *resp++ = capture.trigger_ack;
+        resp = put_u32(resp, capture.rate);
+        resp = put_u32(resp, length);
+        resp = put_u32(resp, trigger);
+        *resp++ = trigger_lost;
+        break;
+    default:
+        ok = false;
+        break;
+    }
+
+    *response = ok ? DAP_OK : DAP_ERROR;
+    return (req_len << 16) | (uint32_t)(resp - response);
+}
@@ -0,0 +1,58 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef SWD_CAPTURE_H_
+#define SWD_CAPTURE_H_
+
+#include <stdint.h>
+
+// Vendor command sub-commands
+#define SWD_CAPTURE_STATUS  0
+#define SWD_CAPTURE_ARM     1
+#define SWD_CAPTURE_TRIGGER 2
+#define SWD_CAPTURE_ABORT   3
+#define SWD_CAPTURE_UPLOAD  4
+
+enum swd_capture_state {
+    CAPTURE_IDLE = 0,
+    CAPTURE_ARMED,
+    CAPTURE_TRIGGERED,
+    CAPTURE_DONE,
+};
+
+extern volatile uint8_t swd_capture_state;
+
+void swd_capture_fire(uint8_t ack);
+
+// Called by the SWD engine with the ACK of every failed transfer
+static inline void swd_capture_ack(uint8_t ack) {
+    if (swd_capture_state == CAPTURE_ARMED)
+        swd_capture_fire(ack);
+}
+
+uint32_t swd_capture_command(const uint8_t *request, uint8_t *response);
+
+#endif
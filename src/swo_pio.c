@@ -0,0 +1,777 @@
+/*
+ * Copyright (c) 2013-2021 ARM Limited. All rights reserved.
+ * Copyright (c) 2024 DazzlingOkami
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * This replaces the CMSIS-DAP SWO.c, which depends on a CMSIS USART driver
+ * and RTX. The SWO pin is sampled by a state machine on PIO1 and the decoded
+ * bytes are moved by DMA into TraceBuf, so the CPU only has to look at the
+ * DMA transfer count to know how much trace arrived. UART and Manchester
+ * mode share the state machine, DMA channels and trace buffer, only the
+ * loaded decoder differs.
+ */
+
+#include <pico/stdlib.h>
+
+#include <hardware/clocks.h>
+#include <hardware/dma.h>
+#include <hardware/pio.h>
+
+#include "DAP_config.h"
+#include "DAP.h"
+#include "swo_pio.h"
+#include "itm.h"
+#include "swo.pio.h"
+
+#if ((SWO_UART != 0) || (SWO_MANCHESTER != 0))
+
+#define SWO_PIO pio1
+
+#define TRANSPORT_NONE    0U
+#define TRANSPORT_DATA    1U
+#define TRANSPORT_STREAM  2U
+
+/* The Manchester decoder needs about 40 clk_sys cycles per bit to keep a 3% edge jitter margin */
+#define SWO_MANCHESTER_MAX_BAUDRATE (clock_get_hz(clk_sys) / 40U)
+
+/* Largest single transfer queued on the SWO endpoint */
+#define SWO_STREAM_XFER_MAX 4096U
+
+/* The data channel is re-armed with this count by the control channel */
+static const uint32_t swo_dma_reload = 0xFFFFFFFFU;
+
+static uint8_t TraceTransport = 0U;
+static uint8_t TraceMode = 0U;
+static uint8_t TraceStatus = 0U;
+static uint8_t TraceError = 0U;
+
+static uint8_t TraceBuf[SWO_BUFFER_SIZE] __attribute__((aligned(SWO_BUFFER_SIZE)));
+static volatile uint32_t TraceIndexI = 0U;
+static volatile uint32_t TraceIndexO = 0U;
+
+#if (SWO_STREAM != 0)
+static volatile uint8_t TransferBusy = 0U;
+static uint32_t TransferSize;
+#endif
+
+TaskHandle_t swo_taskhandle;
+
+#if (TIMESTAMP_CLOCK != 0U)
+static volatile struct {
+  uint32_t index;
+  uint32_t tick;
+} TraceTimestamp;
+#endif
+
+static struct {
+  bool initted;
+  int sm;
+  int dma_ch;
+  int ctrl_ch;
+  // Decoder currently loaded for the selected mode
+  const pio_program_t *program;
+  uint offset;
+  uint32_t last_count;
+} swo;
+
+
+// Claim the PIO and DMA resources on first use
+static uint32_t swo_init (void) {
+  if (swo.initted) {
+    return (1U);
+  }
+
+  swo.sm = pio_claim_unused_sm(SWO_PIO, false);
+  if (swo.sm < 0) {
+    return (0U);
+  }
+  swo.dma_ch  = dma_claim_unused_channel(false);
+  swo.ctrl_ch = dma_claim_unused_channel(false);
+  if ((swo.dma_ch < 0) || (swo.ctrl_ch < 0)) {
+    if (swo.dma_ch >= 0) {
+      dma_channel_unclaim(swo.dma_ch);
+    }
+    if (swo.ctrl_ch >= 0) {
+      dma_channel_unclaim(swo.ctrl_ch);
+    }
+    pio_sm_unclaim(SWO_PIO, swo.sm);
+    return (0U);
+  }
+
+  swo.initted = true;
+  return (1U);
+}
+
+static void swo_stop (void) {
+  pio_sm_set_enabled(SWO_PIO, swo.sm, false);
+  dma_channel_abort(swo.ctrl_ch);
+  dma_channel_abort(swo.dma_ch);
+}
+
+// Only the decoder for the selected mode occupies PIO1 instruction memory
+static void swo_unload (void) {
+  if (swo.program != NULL) {
+    swo_stop();
+    pio_remove_program(SWO_PIO, swo.program, swo.offset);
+    swo.program = NULL;
+  }
+}
+
+static uint32_t swo_load (const pio_program_t *program) {
+  if (!swo_init()) {
+    return (0U);
+  }
+  swo_unload();
+  if (!pio_can_add_program(SWO_PIO, program)) {
+    return (0U);
+  }
+  swo.offset = pio_add_program(SWO_PIO, program);
+  swo.program = program;
+  return (1U);
+}
+
+static void swo_start (void) {
+  dma_channel_config c;
+
+  pio_sm_clear_fifos(SWO_PIO, swo.sm);
+  pio_sm_restart(SWO_PIO, swo.sm);
+  pio_sm_exec(SWO_PIO, swo.sm, pio_encode_jmp(swo.offset));
+
+  // Control channel: restarts the data channel whenever its count runs out
+  c = dma_channel_get_default_config(swo.ctrl_ch);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+  channel_config_set_read_increment(&c, false);
+  channel_config_set_write_increment(&c, false);
+  dma_channel_configure(swo.ctrl_ch, &c, &dma_hw->ch[swo.dma_ch].al1_transfer_count_trig,
+                        &swo_dma_reload, 1, false);
+
+  // Data channel: one byte per FIFO entry, wrapping round TraceBuf
+  c = dma_channel_get_default_config(swo.dma_ch);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+  channel_config_set_read_increment(&c, false);
+  channel_config_set_write_increment(&c, true);
+  channel_config_set_ring(&c, true, __builtin_ctz(SWO_BUFFER_SIZE));
+  channel_config_set_dreq(&c, pio_get_dreq(SWO_PIO, swo.sm, false));
+  channel_config_set_chain_to(&c, swo.ctrl_ch);
+  dma_channel_configure(swo.dma_ch, &c, TraceBuf, (io_rw_8 *)&SWO_PIO->rxf[swo.sm] + 3,
+                        swo_dma_reload, true);
+  swo.last_count = swo_dma_reload;
+
+  pio_sm_set_enabled(SWO_PIO, swo.sm, true);
+}
+
+#if (SWO_UART != 0)
+
+// Enable or disable UART SWO Mode
+//   enable: enable flag
+//   return: 1 - Success, 0 - Error
+uint32_t UART_SWO_Mode (uint32_t enable) {
+  if (enable != 0U) {
+    if (!swo_load(&swo_uart_program)) {
+      return (0U);
+    }
+    swo_uart_program_init(SWO_PIO, swo.sm, swo.offset, PROBE_PIN_SWO);
+    return (1U);
+  }
+  swo_unload();
+  return (1U);
+}
+
+// Configure UART SWO Baudrate
+//   baudrate: requested baudrate
+//   return:   actual baudrate or 0 when not configured
+uint32_t UART_SWO_Baudrate (uint32_t baudrate) {
+  uint32_t clk_sys_freq = clock_get_hz(clk_sys);
+  uint16_t div_int;
+  uint8_t  div_frac;
+  float    divider;
+
+  if ((baudrate == 0U) || (swo.program != &swo_uart_program)) {
+    return (0U);
+  }
+
+  // 8 SM cycles per bit
+  divider = (float)clk_sys_freq / (baudrate * 8U);
+  if (divider < 1.0f) {
+    divider = 1.0f;
+  }
+  pio_calculate_clkdiv_from_float(divider, &div_int, &div_frac);
+  pio_sm_set_clkdiv_int_frac(SWO_PIO, swo.sm, div_int, div_frac);
+
+  return ((uint32_t)((float)clk_sys_freq / (div_int + div_frac / 256.0f) / 8U));
+}
+
+// Control UART SWO Capture
+//   active: active flag
+//   return: 1 - Success, 0 - Error
+uint32_t UART_SWO_Control (uint32_t active) {
+  if (active) {
+    swo_start();
+  } else {
+    swo_stop();
+  }
+  return (1U);
+}
+
+#endif  /* (SWO_UART != 0) */
+
+#if (SWO_MANCHESTER != 0)
+
+// Enable or disable Manchester SWO Mode
+//   enable: enable flag
+//   return: 1 - Success, 0 - Error
+uint32_t Manchester_SWO_Mode (uint32_t enable) {
+  if (enable != 0U) {
+    if (!swo_load(&swo_manchester_program)) {
+      return (0U);
+    }
+    swo_manchester_program_init(SWO_PIO, swo.sm, swo.offset, PROBE_PIN_SWO);
+    return (1U);
+  }
+  swo_unload();
+  return (1U);
+}
+
+// Configure Manchester SWO Baudrate
+//   baudrate: requested baudrate
+//   return:   actual baudrate or 0 when not configured
+uint32_t Manchester_SWO_Baudrate (uint32_t baudrate) {
+  if ((baudrate == 0U) || (swo.program != &swo_manchester_program)) {
+    return (0U);
+  }
+  // The decoder measures the bit period from every start bit, so any rate
+  // it can keep up with is accepted as is
+  if (baudrate > SWO_MANCHESTER_MAX_BAUDRATE) {
+    baudrate = SWO_MANCHESTER_MAX_BAUDRATE;
+  }
+  return (baudrate);
+}
+
+// Control Manchester SWO Capture
+//   active: active flag
+//   return: 1 - Success, 0 - Error
+uint32_t Manchester_SWO_Control (uint32_t active) {
+  if (active) {
+    swo_start();
+  } else {
+    swo_stop();
+  }
+  return (1U);
+}
+
+#endif  /* (SWO_MANCHESTER != 0) */
+
+
+// Account for the bytes the DMA has written since the last call
+static void UpdateTraceIndex (void) {
+  uint32_t count, n;
+
+  if (!swo.initted || !(TraceStatus & DAP_SWO_CAPTURE_ACTIVE)) {
+    return;
+  }
+
+  taskENTER_CRITICAL();
+  count = dma_channel_hw_addr(swo.dma_ch)->transfer_count;
+  if (count <= swo.last_count) {
+    n = swo.last_count - count;
+  } else {
+    // Reloaded by the control channel since the last look
+    n = swo.last_count + (swo_dma_reload - count);
+  }
+  swo.last_count = count;
+
+  if (n != 0U) {
+    TraceIndexI += n;
+#if (TIMESTAMP_CLOCK != 0U)
+    TraceTimestamp.index = TraceIndexI;
+    TraceTimestamp.tick  = TIMESTAMP_GET();
+#endif
+    if ((TraceIndexI - TraceIndexO) > SWO_BUFFER_SIZE) {
+      // Unread trace has been overwritten, drop everything that is left
+      TraceError |= DAP_SWO_BUFFER_OVERRUN;
+      TraceIndexO = TraceIndexI;
+#if (SWO_STREAM != 0)
+      TransferSize = 0U;
+#endif
+    }
+  }
+  taskEXIT_CRITICAL();
+}
+
+// Clear Trace Errors and Data
+static void ClearTrace (void) {
+  taskENTER_CRITICAL();
+  TraceError  = 0U;
+  TraceIndexI = 0U;
+  TraceIndexO = 0U;
+#if (SWO_STREAM != 0)
+  // A transfer still in flight must not advance the new read index
+  TransferSize = 0U;
+#endif
+#if (TIMESTAMP_CLOCK != 0U)
+  TraceTimestamp.index = 0U;
+  TraceTimestamp.tick  = 0U;
+#endif
+  taskEXIT_CRITICAL();
+}
+
+// Get Trace Status (clear Error flags)
+//   return: Trace Status (Active flag and Error flags)
+static uint8_t GetTraceStatus (void) {
+  uint8_t status;
+
+  taskENTER_CRITICAL();
+  status = TraceStatus | TraceError;
+  TraceError = 0U;
+  taskEXIT_CRITICAL();
+
+  return (status);
+}
+
+// Get Trace Count
+//   return: number of available data bytes in trace buffer
+static uint32_t GetTraceCount (void) {
+  UpdateTraceIndex();
+  return (TraceIndexI - TraceIndexO);
+}
+
+
+// Process SWO Transport command and prepare response
+//   request:  pointer to request data
+//   response: pointer to response data
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+uint32_t SWO_Transport (const uint8_t *request, uint8_t *response) {
+  uint8_t  transport;
+  uint32_t result;
+
+  transport = *request;
+
+  if ((TraceStatus & DAP_SWO_CAPTURE_ACTIVE) == 0U) {
+    switch (transport) {
+      case TRANSPORT_NONE:
+      case TRANSPORT_DATA:
+        result = 1U;
+        break;
+#if (SWO_STREAM != 0)
+      case TRANSPORT_STREAM:
+        result = 1U;
+        break;
+#endif
+      default:
+        result = 0U;
+        break;
+    }
+  } else {
+    result = 0U;
+  }
+
+  if (result != 0U) {
+    TraceTransport = transport;
+  }
+
+  *response = result ? DAP_OK : DAP_ERROR;
+
+  return ((1U << 16) | 1U);
+}
+
+// Process SWO Mode command and prepare response
+//   request:  pointer to request data
+//   response: pointer to response data
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+uint32_t SWO_Mode (const uint8_t *request, uint8_t *response) {
+  uint8_t  mode;
+  uint32_t result;
+
+  mode = *request;
+
+  switch (TraceMode) {
+#if (SWO_UART != 0)
+    case DAP_SWO_UART:
+      UART_SWO_Mode(0U);
+      break;
+#endif
+#if (SWO_MANCHESTER != 0)
+    case DAP_SWO_MANCHESTER:
+      Manchester_SWO_Mode(0U);
+      break;
+#endif
+    default:
+      break;
+  }
+
+  switch (mode) {
+    case DAP_SWO_OFF:
+      result = 1U;
+      break;
+#if (SWO_UART != 0)
+    case DAP_SWO_UART:
+      result = UART_SWO_Mode(1U);
+      break;
+#endif
+#if (SWO_MANCHESTER != 0)
+    case DAP_SWO_MANCHESTER:
+      result = Manchester_SWO_Mode(1U);
+      break;
+#endif
+    default:
+      result = 0U;
+      break;
+  }
+  if (result != 0U) {
+    TraceMode = mode;
+  } else {
+    TraceMode = DAP_SWO_OFF;
+  }
+
+  TraceStatus = 0U;
+
+  *response = result ? DAP_OK : DAP_ERROR;
+
+  return ((1U << 16) | 1U);
+}
+
+// Process SWO Baudrate command and prepare response
+//   request:  pointer to request data
+//   response: pointer to response data
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+uint32_t SWO_Baudrate (const uint8_t *request, uint8_t *response) {
+  uint32_t baudrate;
+
+  baudrate = (uint32_t)(*(request+0) <<  0) |
+             (uint32_t)(*(request+1) <<  8) |
+             (uint32_t)(*(request+2) << 16) |
+             (uint32_t)(*(request+3) << 24);
+
+  switch (TraceMode) {
+#if (SWO_UART != 0)
+    case DAP_SWO_UART:
+      if (baudrate > SWO_UART_MAX_BAUDRATE) {
+        baudrate = SWO_UART_MAX_BAUDRATE;
+      }
+      baudrate = UART_SWO_Baudrate(baudrate);
+      break;
+#endif
+#if (SWO_MANCHESTER != 0)
+    case DAP_SWO_MANCHESTER:
+      baudrate = Manchester_SWO_Baudrate(baudrate);
+      break;
+#endif
+    default:
+      baudrate = 0U;
+      break;
+  }
+
+  if (baudrate == 0U) {
+    TraceStatus = 0U;
+  }
+
+  *response++ = (uint8_t)(baudrate >>  0);
+  *response++ = (uint8_t)(baudrate >>  8);
+  *response++ = (uint8_t)(baudrate >> 16);
+  *response   = (uint8_t)(baudrate >> 24);
+
+  return ((4U << 16) | 4U);
+}
+
+// Process SWO Control command and prepare response
+//   request:  pointer to request data
+//   response: pointer to response data
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+uint32_t SWO_Control (const uint8_t *request, uint8_t *response) {
+  uint8_t  active;
+  uint32_t result;
+
+  active = *request & DAP_SWO_CAPTURE_ACTIVE;
+
+  if (active != (TraceStatus & DAP_SWO_CAPTURE_ACTIVE)) {
+    if (active) {
+      ClearTrace();
+    } else {
+      // Pick up whatever arrived before the capture is stopped
+      UpdateTraceIndex();
+    }
+    switch (TraceMode) {
+#if (SWO_UART != 0)
+      case DAP_SWO_UART:
+        result = UART_SWO_Control(active);
+        break;
+#endif
+#if (SWO_MANCHESTER != 0)
+      case DAP_SWO_MANCHESTER:
+        result = Manchester_SWO_Control(active);
+        break;
+#endif
+      default:
+        result = 0U;
+        break;
+    }
+    if (result != 0U) {
+      TraceStatus = active;
+      xTaskNotifyGive(swo_taskhandle);
+    }
+  } else {
+    result = 1U;
+  }
+
+  *response = result ? DAP_OK : DAP_ERROR;
+
+  return ((1U << 16) | 1U);
+}
+
+// Process SWO Status command and prepare response
+//   response: pointer to response data
+//   return:   number of bytes in response
+uint32_t SWO_Status (uint8_t *response) {
+  uint8_t  status;
+  uint32_t count;
+
+  count  = GetTraceCount();
+  status = GetTraceStatus();
+
+  *response++ = status;
+  *response++ = (uint8_t)(count >>  0);
+  *response++ = (uint8_t)(count >>  8);
+  *response++ = (uint8_t)(count >> 16);
+  *response   = (uint8_t)(count >> 24);
+
+  return (5U);
+}
+
+// Process SWO Extended Status command and prepare response
+//   request:  pointer to request data
+//   response: pointer to response data
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+uint32_t SWO_ExtendedStatus (const uint8_t *request, uint8_t *response) {
+  uint8_t  cmd;
+  uint8_t  status;
+  uint32_t count = 0U;
+#if (TIMESTAMP_CLOCK != 0U)
+  uint32_t index;
+  uint32_t tick;
+#endif
+  uint32_t num;
+
+  num = 0U;
+  cmd = *request;
+
+  if (cmd & 0x02U) {
+    count = GetTraceCount();
+  }
+
+  if (cmd & 0x01U) {
+    status = GetTraceStatus();
+    *response++ = status;
+    num += 1U;
+  }
+
+  if (cmd & 0x02U) {
+    *response++ = (uint8_t)(count >>  0);
+    *response++ = (uint8_t)(count >>  8);
+    *response++ = (uint8_t)(count >> 16);
+    *response++ = (uint8_t)(count >> 24);
+    num += 4U;
+  }
+
+#if (TIMESTAMP_CLOCK != 0U)
+  if (cmd & 0x04U) {
+    taskENTER_CRITICAL();
+    index = TraceTimestamp.index;
+    tick  = TraceTimestamp.tick;
+    taskEXIT_CRITICAL();
+    *response++ = (uint8_t)(index >>  0);
+    *response++ = (uint8_t)(index >>  8);
+    *response++ = (uint8_t)(index >> 16);
+    *response++ = (uint8_t)(index >> 24);
+    *response++ = (uint8_t)(tick  >>  0);
+    *response++ = (uint8_t)(tick  >>  8);
+    *response++ = (uint8_t)(tick  >> 16);
+    *response++ = (uint8_t)(tick  >> 24);
+    num += 8U;
+  }
+#endif
+
+  return ((1U << 16) | num);
+}
+
+// Process SWO Data command and prepare response
+//   request:  pointer to request data
+//   response: pointer to response data
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+uint32_t SWO_Data (const uint8_t *request, uint8_t *response) {
+  uint8_t  status;
+  uint32_t count;
+  uint32_t index;
+  uint32_t n, i;
+
+  count  = GetTraceCount();
+  status = GetTraceStatus();
+
+  if (TraceTransport == TRANSPORT_DATA) {
+    n = (uint32_t)(*(request+0) << 0) |
+        (uint32_t)(*(request+1) << 8);
+    if (n > (DAP_PACKET_SIZE - 4U)) {
+      n = DAP_PACKET_SIZE - 4U;
+    }
+    if (count > n) {
+      count = n;
+    }
+  } else {
+    count = 0U;
+  }
+
+  *response++ = status;
+  *response++ = (uint8_t)(count >> 0);
+  *response++ = (uint8_t)(count >> 8);
+
+  if (TraceTransport == TRANSPORT_DATA) {
+    index = TraceIndexO;
+    for (i = index, n = count; n; n--) {
+      i &= SWO_BUFFER_SIZE - 1U;
+      *response++ = TraceBuf[i++];
+    }
+    taskENTER_CRITICAL();
+    // An overrun may have moved the read index meanwhile
+    if (TraceIndexO == index) {
+      TraceIndexO = index + count;
+    }
+    taskEXIT_CRITICAL();
+  }
+
+  return ((2U << 16) | (3U + count));
+}
+
+
+// Get the index the next captured byte will be written at
+//   return: trace input index
+uint32_t SWO_TraceHead (void) {
+  UpdateTraceIndex();
+  return (TraceIndexI);
+}
+
+// Copy trace for a consumer that keeps its own read index
+//   index: read index, advanced past the copied data
+//   buf:   pointer to destination
+//   num:   maximum number of bytes to copy
+//   lost:  incremented by the number of bytes overwritten before they were read
+//   return: number of bytes copied
+uint32_t SWO_TraceRead (uint32_t *index, uint8_t *buf, uint32_t num, uint32_t *lost) {
+  uint32_t count;
+  uint32_t n;
+
+  UpdateTraceIndex();
+  count = TraceIndexI - *index;
+  if ((int32_t)count < 0) {
+    // Capture was restarted, the trace starts over
+    *index = 0U;
+    count = TraceIndexI;
+  }
+  if (count > SWO_BUFFER_SIZE) {
+    *lost += count;
+    *index = TraceIndexI;
+    return (0U);
+  }
+
+  if (count > num) {
+    count = num;
+  }
+  for (n = 0U; n < count; n++) {
+    buf[n] = TraceBuf[(*index + n) & (SWO_BUFFER_SIZE - 1U)];
+  }
+  *index += count;
+
+  return (count);
+}
+
+
+#if (SWO_STREAM != 0)
+
+// SWO Data Transfer complete callback
+void SWO_TransferComplete (void) {
+  taskENTER_CRITICAL();
+  TraceIndexO += TransferSize;
+  TransferSize = 0U;
+  TransferBusy = 0U;
+  taskEXIT_CRITICAL();
+  xTaskNotifyGive(swo_taskhandle);
+}
+
+void SWO_TransferReset (void) {
+  taskENTER_CRITICAL();
+  TransferSize = 0U;
+  TransferBusy = 0U;
+  taskEXIT_CRITICAL();
+}
+
+// Queue the next contiguous block of trace on the SWO endpoint
+static void SWO_StreamTrace (void) {
+  uint32_t count;
+  uint32_t index;
+  uint32_t n;
+
+  if ((TraceTransport != TRANSPORT_STREAM) || TransferBusy) {
+    return;
+  }
+
+  taskENTER_CRITICAL();
+  count = TraceIndexI - TraceIndexO;
+  index = TraceIndexO & (SWO_BUFFER_SIZE - 1U);
+  n = SWO_BUFFER_SIZE - index;
+  if (count > n) {
+    count = n;
+  }
+  if (count > SWO_STREAM_XFER_MAX) {
+    count = SWO_STREAM_XFER_MAX;
+  }
+  if (count != 0U) {
+    TransferSize = count;
+    TransferBusy = 1U;
+  }
+  taskEXIT_CRITICAL();
+
+  if (count != 0U) {
+    SWO_QueueTransfer(&TraceBuf[index], count);
+  }
+}
+
+#endif  /* (SWO_STREAM != 0) */
+
+// SWO Thread
+void SWO_Thread (void *ptr) {
+  do {
+    // Woken by SWO_Control and transfer completion, otherwise poll once per tick
+    ulTaskNotifyTake(pdTRUE, 1);
+
+    if (!(TraceStatus & DAP_SWO_CAPTURE_ACTIVE)) {
+      continue;
+    }
+
+    UpdateTraceIndex();
+    itm_task();
+#if (SWO_STREAM != 0)
+    SWO_StreamTrace();
+#endif
+  } while (1);
+}
+
+#endif  /* ((SWO_UART != 0) || (SWO_MANCHESTER != 0)) */
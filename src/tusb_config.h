@@ -26,6 +26,9 @@
 #ifndef _TUSB_CONFIG_H_
 #define _TUSB_CONFIG_H_
 
+#include "probe_config.h"
+#include "DAP_config.h"
+
 #ifdef __cplusplus
  extern "C" {
 #endif
@@ -63,7 +66,12 @@
 
 //------------- CLASS -------------//
 #define CFG_TUD_HID             1
-#define CFG_TUD_CDC             2
+// UART and GDB, plus ITM when the board has SWO, plus the PIO UARTs
+#if ((SWO_UART != 0) || (SWO_MANCHESTER != 0))
+#define CFG_TUD_CDC             (3 + PROBE_PIO_UART_COUNT)
+#else
+#define CFG_TUD_CDC             (2 + PROBE_PIO_UART_COUNT)
+#endif
 #define CFG_TUD_MSC             0
 #define CFG_TUD_MIDI            0
 #define CFG_TUD_VENDOR          1
@@ -6,6 +6,12 @@
 
 #include "tusb_edpt_handler.h"
 #include "DAP.h"
+#include "tusb_stream.h"
+#include "swo_pio.h"
+#include "dap_mem.h"
+#include "dap_job.h"
+#include "bulk_write.h"
+#include "dap_stats.h"
 
 static uint8_t itf_num;
 static uint8_t _rhport;
@@ -14,6 +20,7 @@ volatile uint32_t _resp_len;
 
 static uint8_t _out_ep_addr;
 static uint8_t _in_ep_addr;
+static uint8_t _swo_ep_addr;
 
 static buffer_t USBRequestBuffer;
 static buffer_t USBResponseBuffer;
@@ -21,6 +28,12 @@ static buffer_t USBResponseBuffer;
 static uint8_t DAPRequestBuffer[DAP_PACKET_SIZE];
 static uint8_t DAPResponseBuffer[DAP_PACKET_SIZE];
 
+/* Latency timestamps: OUT completion per request slot, execution end and
+ * command per response slot */
+static uint32_t USBRequestTime[DAP_PACKET_COUNT];
+static uint32_t USBResponseTime[DAP_PACKET_COUNT];
+static uint8_t USBResponseCmd[DAP_PACKET_COUNT];
+
 #define WR_IDX(x) (x.wptr % DAP_PACKET_COUNT)
 #define RD_IDX(x) (x.rptr % DAP_PACKET_COUNT)
 
@@ -53,6 +66,11 @@ bool dap_edpt_deinit(void)
 void dap_edpt_reset(uint8_t __unused rhport)
 {
 	itf_num = 0;
+	dap_job_stop_all();
+	bulk_write_cancel();
+#if (SWO_STREAM != 0)
+	SWO_TransferReset();
+#endif
 }
 
 char * dap_cmd_string[] = {
@@ -131,6 +149,14 @@ uint16_t dap_edpt_open(uint8_t __unused rhport, tusb_desc_interface_t const *itf
 	// The IN endpoint doesn't need a transfer to initialise it, as this will be done by the main loop of dap_thread
 	usbd_edpt_open(rhport, edpt_desc);
 
+	// Optional SWO trace endpoint, transfers are queued by the SWO thread
+	if (itf_desc->bNumEndpoints > 2)
+	{
+		edpt_desc++;
+		_swo_ep_addr = edpt_desc->bEndpointAddress;
+		usbd_edpt_open(rhport, edpt_desc);
+	}
+
 	return drv_len;
 
 }
@@ -141,14 +167,24 @@ bool dap_edpt_control_xfer_cb(uint8_t __unused rhport, uint8_t stage, tusb_contr
 }
 
 // Manage USBResponseBuffer (request) write and USBRequestBuffer (response) read indices
-bool dap_edpt_xfer_cb(uint8_t __unused rhport, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
+bool __probe_hot_func(dap_edpt_xfer_cb)(uint8_t __unused rhport, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
 {
 	const uint8_t ep_dir = tu_edpt_dir(ep_addr);
 
+#if (SWO_STREAM != 0)
+	if(_swo_ep_addr && ep_addr == _swo_ep_addr)
+	{
+		SWO_TransferComplete();
+		return true;
+	}
+#endif
+
 	if(ep_dir == TUSB_DIR_IN)
 	{
 		if(xferred_bytes >= 0u && xferred_bytes <= DAP_PACKET_SIZE)
 		{
+			dap_stats_record(USBResponseCmd[RD_IDX(USBResponseBuffer)], DAP_STATS_REPLY,
+					 time_us_32() - USBResponseTime[RD_IDX(USBResponseBuffer)]);
 			USBResponseBuffer.rptr++;
 
 			// This checks that the buffer was not empty in DAP thread, which means the next buffer was not queued up for the in endpoint callback
@@ -172,6 +208,8 @@ bool dap_edpt_xfer_cb(uint8_t __unused rhport, uint8_t ep_addr, xfer_result_t re
 
 		if(xferred_bytes >= 0u && xferred_bytes <= DAP_PACKET_SIZE)
 		{
+			USBRequestTime[WR_IDX(USBRequestBuffer)] = time_us_32();
+
 			// Only queue the next buffer in the out callback if the buffer is not full
 			// If full, we set the wasFull flag, which will be checked by dap thread
 			if(!buffer_full(&USBRequestBuffer))
@@ -194,9 +232,10 @@ bool dap_edpt_xfer_cb(uint8_t __unused rhport, uint8_t ep_addr, xfer_result_t re
 	else return false;
 }
 
-void dap_thread(void *ptr)
+void __probe_hot_func(dap_thread)(void *ptr)
 {
 	uint32_t n;
+	uint32_t t_rx, t_start, t_end;
 	do
 	{
 		while(USBRequestBuffer.rptr != USBRequestBuffer.wptr)
@@ -206,7 +245,7 @@ void dap_thread(void *ptr)
 			 * until a non-QueueCommands packet is seen.
 			 */
 			n = USBRequestBuffer.rptr;
-			while (USBRequestBuffer.data[n % DAP_PACKET_COUNT][0] == ID_DAP_QueueCommands) {
+			while (!bulk_write_active() && USBRequestBuffer.data[n % DAP_PACKET_COUNT][0] == ID_DAP_QueueCommands) {
 				probe_info("%lu %lu DAP queued cmd %s len %02x\n",
 					       USBRequestBuffer.wptr, USBRequestBuffer.rptr,
 					       dap_cmd_string[USBRequestBuffer.data[n % DAP_PACKET_COUNT][0]], USBRequestBuffer.data[n % DAP_PACKET_COUNT][1]);
@@ -220,6 +259,7 @@ void dap_thread(void *ptr)
 			}
 			// Read a single packet from the USB buffer into the DAP Request buffer
 			memcpy(DAPRequestBuffer, RD_SLOT_PTR(USBRequestBuffer), DAP_PACKET_SIZE);
+			t_rx = USBRequestTime[RD_IDX(USBRequestBuffer)];
 			probe_info("%lu %lu DAP cmd %s len %02x\n",
 				       USBRequestBuffer.wptr, USBRequestBuffer.rptr,
 				       dap_cmd_string[DAPRequestBuffer[0]], DAPRequestBuffer[1]);
@@ -235,7 +275,23 @@ void dap_thread(void *ptr)
 				xTaskResumeAll();
 			}
 
-			_resp_len = DAP_ExecuteCommand(DAPRequestBuffer, DAPResponseBuffer);
+			t_start = time_us_32();
+			if (bulk_write_active())
+			{
+				// Raw data of an open bulk write, only the last packet gets a response
+				bulk_write_packet(DAPRequestBuffer);
+				if (bulk_write_active())
+					continue;
+				_resp_len = bulk_write_result(DAPResponseBuffer);
+			} else {
+				// Hand the AP back in the state the host left it before it talks to the target again
+				dap_mem_release();
+				_resp_len = DAP_ExecuteCommand(DAPRequestBuffer, DAPResponseBuffer);
+			}
+			t_end = time_us_32();
+			// Responses echo the command ID, which also covers queued and bulk write packets
+			dap_stats_record(DAPResponseBuffer[0], DAP_STATS_QUEUE, t_start - t_rx);
+			dap_stats_record(DAPResponseBuffer[0], DAP_STATS_EXEC, t_end - t_start);
 			probe_info("%lu %lu DAP resp %s\n",
 					USBResponseBuffer.wptr, USBResponseBuffer.rptr,
 					dap_cmd_string[DAPResponseBuffer[0]]);
@@ -244,6 +300,9 @@ void dap_thread(void *ptr)
 			//  Suspend the scheduler to avoid stale values/race conditions between threads
 			vTaskSuspendAll();
 
+			USBResponseTime[WR_IDX(USBResponseBuffer)] = t_end;
+			USBResponseCmd[WR_IDX(USBResponseBuffer)] = DAPResponseBuffer[0];
+
 			if(buffer_empty(&USBResponseBuffer))
 			{
 				memcpy(WR_SLOT_PTR(USBResponseBuffer), DAPResponseBuffer, (uint16_t) _resp_len);
@@ -261,15 +320,31 @@ void dap_thread(void *ptr)
 			xTaskResumeAll();
 		}
 
-		// Suspend DAP thread until it is awoken by a USB thread callback
+		// Background jobs only get the debug port while the host is quiet
+		dap_job_run();
+
+		// Suspend DAP thread until it is awoken by a USB thread callback or a job timer
 		vTaskSuspend(dap_taskhandle);
 
 	} while (1);
 
 }
 
-usbd_class_driver_t const _dap_edpt_driver =
+#if (SWO_STREAM != 0)
+void SWO_QueueTransfer(uint8_t *buf, uint32_t num)
+{
+	usbd_edpt_xfer(_rhport, _swo_ep_addr, buf, (uint16_t) num);
+}
+
+void SWO_AbortTransfer(void)
 {
+	// Nothing to do, a queued transfer completes once the host reads it
+}
+#endif
+
+usbd_class_driver_t const _app_edpt_drivers[] =
+{
+	{
 		.init = dap_edpt_init,
 		.deinit = dap_edpt_deinit,
 		.reset = dap_edpt_reset,
@@ -280,12 +355,25 @@ usbd_class_driver_t const _dap_edpt_driver =
 #if CFG_TUSB_DEBUG >= 2
 		.name = "DAP ENDPOINT"
 #endif
+	},
+	{
+		.init = stream_edpt_init,
+		.deinit = stream_edpt_deinit,
+		.reset = stream_edpt_reset,
+		.open = stream_edpt_open,
+		.control_xfer_cb = stream_edpt_control_xfer_cb,
+		.xfer_cb = stream_edpt_xfer_cb,
+		.sof = NULL,
+#if CFG_TUSB_DEBUG >= 2
+		.name = "STREAM ENDPOINT"
+#endif
+	},
 };
 
-// Add the custom driver to the tinyUSB stack
+// Add the custom drivers to the tinyUSB stack
 usbd_class_driver_t const *usbd_app_driver_get_cb(uint8_t *driver_count)
 {
-	*driver_count = 1;
-	return &_dap_edpt_driver;
+	*driver_count = TU_ARRAY_SIZE(_app_edpt_drivers);
+	return _app_edpt_drivers;
 }
 
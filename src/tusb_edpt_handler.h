@@ -15,6 +15,19 @@
 #define DAP_INTERFACE_SUBCLASS 0x00
 #define DAP_INTERFACE_PROTOCOL 0x00
 
+/* CMSIS-DAP v2 interface with the optional SWO trace endpoint */
+#define TUD_DAP_SWO_DESC_LEN (TUD_VENDOR_DESC_LEN + 7)
+
+#define TUD_DAP_SWO_DESCRIPTOR(_itfnum, _stridx, _epout, _epin, _epswo, _epsize) \
+  /* Interface */\
+  9, TUSB_DESC_INTERFACE, _itfnum, 0, 3, TUSB_CLASS_VENDOR_SPECIFIC, DAP_INTERFACE_SUBCLASS, DAP_INTERFACE_PROTOCOL, _stridx,\
+  /* Endpoint Out */\
+  7, TUSB_DESC_ENDPOINT, _epout, TUSB_XFER_BULK, U16_TO_U8S_LE(_epsize), 0,\
+  /* Endpoint In */\
+  7, TUSB_DESC_ENDPOINT, _epin, TUSB_XFER_BULK, U16_TO_U8S_LE(_epsize), 0,\
+  /* Endpoint SWO In */\
+  7, TUSB_DESC_ENDPOINT, _epswo, TUSB_XFER_BULK, U16_TO_U8S_LE(_epsize), 0
+
 typedef struct {
 	uint8_t data[DAP_PACKET_COUNT][DAP_PACKET_SIZE];
 	volatile uint32_t wptr;
@@ -0,0 +1,171 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "tusb_stream.h"
+
+/* Largest single transfer handed to the stack, it splits it into packets */
+#define STREAM_XFER_MAX 4096
+
+static uint8_t _rhport;
+static uint8_t _in_ep_addr;
+static volatile bool ep_opened;
+
+static struct ringbuf *volatile stream_source;
+/* Bumped by every detach, so a transfer started before it never consumes
+ * from the ring once it has been reset and attached again */
+static uint32_t stream_gen;
+
+/* Ring buffer, length and generation of the transfer currently owned by the endpoint */
+static struct ringbuf *volatile inflight_source;
+static int inflight_len;
+static uint32_t inflight_gen;
+
+void stream_edpt_init(void)
+{
+
+}
+
+bool stream_edpt_deinit(void)
+{
+	ep_opened = false;
+	inflight_source = NULL;
+	inflight_len = 0;
+	return true;
+}
+
+void stream_edpt_reset(uint8_t __unused rhport)
+{
+	stream_edpt_deinit();
+}
+
+uint16_t stream_edpt_open(uint8_t __unused rhport, tusb_desc_interface_t const *itf_desc, uint16_t max_len)
+{
+	TU_VERIFY(TUSB_CLASS_VENDOR_SPECIFIC == itf_desc->bInterfaceClass &&
+			STREAM_INTERFACE_SUBCLASS == itf_desc->bInterfaceSubClass &&
+			STREAM_INTERFACE_PROTOCOL == itf_desc->bInterfaceProtocol, 0);
+
+	uint16_t const drv_len = sizeof(tusb_desc_interface_t) + (itf_desc->bNumEndpoints * sizeof(tusb_desc_endpoint_t));
+	TU_VERIFY(max_len >= drv_len, 0);
+
+	// Single IN endpoint, transfers are queued by stream_task() when there is data
+	tusb_desc_endpoint_t *edpt_desc = (tusb_desc_endpoint_t *) (itf_desc + 1);
+	TU_VERIFY(usbd_edpt_open(rhport, edpt_desc), 0);
+
+	_rhport = rhport;
+	_in_ep_addr = edpt_desc->bEndpointAddress;
+	inflight_source = NULL;
+	inflight_len = 0;
+	ep_opened = true;
+
+	return drv_len;
+}
+
+bool stream_edpt_control_xfer_cb(uint8_t __unused rhport, uint8_t stage, tusb_control_request_t const *request)
+{
+	return false;
+}
+
+bool stream_edpt_xfer_cb(uint8_t __unused rhport, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
+{
+	if (ep_addr != _in_ep_addr)
+		return false;
+
+	// The source may have been swapped or reset while the transfer was in flight, only release what we took
+	taskENTER_CRITICAL();
+	if (inflight_source && inflight_source == stream_source && inflight_gen == stream_gen)
+		ringbuf_consume(inflight_source, inflight_len);
+	inflight_source = NULL;
+	inflight_len = 0;
+	taskEXIT_CRITICAL();
+
+	// Keep the endpoint busy without waiting for the next USB thread pass
+	stream_task();
+	return true;
+}
+
+bool stream_attach(struct ringbuf *source)
+{
+	bool ok;
+
+	taskENTER_CRITICAL();
+	ok = !stream_source || stream_source == source;
+	if (ok)
+		stream_source = source;
+	taskEXIT_CRITICAL();
+	return ok;
+}
+
+void stream_detach(struct ringbuf *source)
+{
+	taskENTER_CRITICAL();
+	if (stream_source == source) {
+		stream_source = NULL;
+		stream_gen++;
+	}
+	taskEXIT_CRITICAL();
+}
+
+bool stream_inflight(const struct ringbuf *source)
+{
+	return inflight_source == source;
+}
+
+bool stream_busy(void)
+{
+	return stream_source != NULL;
+}
+
+void stream_task(void)
+{
+	struct ringbuf *source;
+	const char *buf = NULL;
+	int len = 0;
+
+	// Claim the data under the same lock as detach, so it belongs to the current generation
+	taskENTER_CRITICAL();
+	source = stream_source;
+	if (ep_opened && source && !inflight_source) {
+		buf = ringbuf_get_ptr(source, &len);
+		if (len > STREAM_XFER_MAX)
+			len = STREAM_XFER_MAX;
+		if (len > 0) {
+			inflight_source = source;
+			inflight_len = len;
+			inflight_gen = stream_gen;
+		}
+	}
+	taskEXIT_CRITICAL();
+	if (len <= 0)
+		return;
+
+	if (!usbd_edpt_xfer(_rhport, _in_ep_addr, (uint8_t *) buf, (uint16_t) len)) {
+		inflight_source = NULL;
+		inflight_len = 0;
+	}
+}
@@ -0,0 +1,71 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef TUSB_STREAM_H
+#define TUSB_STREAM_H
+
+#include "tusb.h"
+
+#include "device/usbd_pvt.h"
+#include "ringbuf.h"
+
+/* Vendor interface with a single bulk IN endpoint, used to push probe-side
+ * data (bus captures, sampled variables, ...) to the host. */
+#define STREAM_INTERFACE_SUBCLASS 0x01
+#define STREAM_INTERFACE_PROTOCOL 0x00
+
+#define TUD_STREAM_DESC_LEN (9 + 7)
+
+#define TUD_STREAM_DESCRIPTOR(_itfnum, _stridx, _epin, _epsize) \
+  /* Interface */\
+  9, TUSB_DESC_INTERFACE, _itfnum, 0, 1, TUSB_CLASS_VENDOR_SPECIFIC, STREAM_INTERFACE_SUBCLASS, STREAM_INTERFACE_PROTOCOL, _stridx,\
+  /* Endpoint In */\
+  7, TUSB_DESC_ENDPOINT, _epin, TUSB_XFER_BULK, U16_TO_U8S_LE(_epsize), 0
+
+/* Endpoint Handling */
+void stream_edpt_init(void);
+bool stream_edpt_deinit(void);
+void stream_edpt_reset(uint8_t __unused rhport);
+uint16_t stream_edpt_open(uint8_t __unused rhport, tusb_desc_interface_t const *itf_desc, uint16_t max_len);
+bool stream_edpt_control_xfer_cb(uint8_t __unused rhport, uint8_t stage, tusb_control_request_t const *request);
+bool stream_edpt_xfer_cb(uint8_t __unused rhport, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes);
+
+/* Only one producer owns the endpoint at a time. The producer fills the
+ * ring buffer, the USB thread drains it. Attach and detach are called from
+ * task context only. After a detach the ring can be reset and attached
+ * again, a transfer still in flight from before no longer consumes from it. */
+bool stream_attach(struct ringbuf *source);
+void stream_detach(struct ringbuf *source);
+bool stream_busy(void);
+
+/* True while the endpoint still reads from the ring's memory, which must
+ * stay allocated until then even after a detach */
+bool stream_inflight(const struct ringbuf *source);
+
+/* Called from the USB thread to start pending transfers */
+void stream_task(void);
+
+#endif
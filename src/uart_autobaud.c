@@ -0,0 +1,306 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <pico/stdlib.h>
+
+#include <hardware/clocks.h>
+#include <hardware/dma.h>
+#include <hardware/pio.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "probe_config.h"
+#include "DAP.h"
+#include "dap_vendor.h"
+#include "cdc_uart.h"
+#include "probe.h"
+#include "uart_autobaud.h"
+#include "uart_autobaud.pio.h"
+
+/*
+ * Auto-baud for the debug UART. A PIO state machine times every pulse on
+ * the RX pin and DMA collects the widths. The bit period is taken from the
+ * shortest width that several pulses agree on, then refined over every
+ * pulse that is a whole number of bits long, so a few characters of normal
+ * traffic are enough. The result is snapped to a standard rate when it is
+ * close to one, and the bridge switches the PL011 to it.
+ *
+ * The state machine and DMA channel are only claimed while detection runs.
+ * Like the other UART features, start and stop requests are carried out on
+ * the bridge thread.
+ */
+#define AUTOBAUD_SAMPLES        64
+#define AUTOBAUD_MIN_SAMPLES    16
+// Bits the final average has to cover
+#define AUTOBAUD_MIN_BITS       32
+// Widths within 1/8 of each other count as the same length
+#define AUTOBAUD_SUPPORT        3
+// Longest run of equal bits, start bit plus eight zero data bits
+#define AUTOBAUD_MAX_BITS       9
+#define AUTOBAUD_SNAP_PERMILLE  15
+// Fastest rate looked for, shorter pulses are glitches
+#define AUTOBAUD_MAX_RATE       4000000
+
+static const uint32_t autobaud_rates[] = {
+    1200, 2400, 4800, 9600, 14400, 19200, 28800, 38400, 57600, 76800,
+    115200, 230400, 250000, 460800, 500000, 921600, 1000000, 1500000,
+    2000000, 3000000,
+};
+
+static uint32_t samples[AUTOBAUD_SAMPLES];
+
+static struct {
+    PIO pio;
+    int sm;
+    int dma_ch;
+    uint offset;
+    volatile uint8_t request;   // AUTOBAUD_RUNNING or AUTOBAUD_IDLE
+    volatile uint8_t request_seq;
+    uint8_t applied_seq;
+    volatile uint8_t state;
+    uint32_t collected;
+    uint32_t measured;
+    uint32_t rate;
+} ab;
+
+static bool autobaud_load(PIO pio) {
+    int hold = PROBE_PIO0_LOADED;
+    bool ok = false;
+
+    // The program must leave room for the SWD engine in pio0
+    if (pio == pio0) {
+        hold = probe_pio0_hold();
+        if (hold == PROBE_PIO0_FULL)
+            return false;
+    }
+
+    if (!pio_can_add_program(pio, &uart_autobaud_program))
+        goto out;
+    ab.sm = pio_claim_unused_sm(pio, false);
+    if (ab.sm < 0)
+        goto out;
+    ab.pio = pio;
+    ab.offset = pio_add_program(pio, &uart_autobaud_program);
+    ok = true;
+out:
+    probe_pio0_release(hold);
+    return ok;
+}
+
+static bool autobaud_claim(void) {
+    ab.dma_ch = dma_claim_unused_channel(false);
+    if (ab.dma_ch < 0)
+        return false;
+    // pio1 first, as for the PIO UARTs, pio0 runs the SWD engine
+    if (!autobaud_load(pio1) && !autobaud_load(pio0)) {
+        dma_channel_unclaim(ab.dma_ch);
+        return false;
+    }
+    return true;
+}
+
+static void autobaud_release(void) {
+    pio_sm_set_enabled(ab.pio, ab.sm, false);
+    dma_channel_abort(ab.dma_ch);
+    dma_channel_unclaim(ab.dma_ch);
+    pio_remove_program(ab.pio, &uart_autobaud_program, ab.offset);
+    pio_sm_unclaim(ab.pio, ab.sm);
+}
+
+static bool autobaud_start(void) {
+    if (!autobaud_claim())
+        return false;
+
+    uart_autobaud_sm_init(ab.pio, ab.sm, ab.offset, PROBE_UART_RX);
+
+    dma_channel_config c = dma_channel_get_default_config(ab.dma_ch);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_dreq(&c, pio_get_dreq(ab.pio, ab.sm, false));
+    dma_channel_configure(ab.dma_ch, &c, samples, &ab.pio->rxf[ab.sm], AUTOBAUD_SAMPLES, true);
+
+    ab.collected = 0;
+    ab.measured = 0;
+    ab.rate = 0;
+    pio_sm_set_enabled(ab.pio, ab.sm, true);
+    return true;
+}
+
+/* The loop count plus the push and reload. Each phase starts counting only
+ * after the previous one has pushed, and the high phase takes one instruction
+ * more to leave, so that cycle belongs to the low pulse that follows it. */
+static inline uint32_t autobaud_cycles(uint32_t sample, bool low) {
+    return 3 * ~sample + (low ? 4 : 3);
+}
+
+/* Average over the low pulses that are a whole number of bits of about t0
+ * cycles. The widths alternate low and high from the first, high one, and a
+ * high pulse can take in the idle time between characters, so only a start
+ * bit and the zero bits after it are known to be whole bits. */
+static uint64_t autobaud_average(const uint32_t *w, uint32_t n, uint32_t t0, uint32_t *sum_bits) {
+    uint32_t i, t, bits;
+    uint64_t sum_cycles = 0;
+
+    *sum_bits = 0;
+    for (i = 1; i < n; i += 2) {
+        t = autobaud_cycles(w[i], true);
+        bits = (t + t0 / 2) / t0;
+        if (bits < 1 || bits > AUTOBAUD_MAX_BITS)
+            continue;
+        if (t + t0 / 4 < bits * t0 || t > bits * t0 + t0 / 4)
+            continue;
+        sum_cycles += t;
+        *sum_bits += bits;
+    }
+    return sum_cycles;
+}
+
+// Returns the baud rate the widths agree on, or 0 if they don't yet
+static uint32_t autobaud_estimate(const uint32_t *w, uint32_t n) {
+    uint32_t t0 = 0, t, bits;
+    uint32_t t_min = clock_get_hz(clk_sys) / AUTOBAUD_MAX_RATE;
+    uint64_t sum_cycles;
+    uint32_t i, j, support;
+
+    // Shortest width that enough other pulses share
+    for (i = 0; i < n; i++) {
+        t = autobaud_cycles(w[i], i & 1);
+        if (t < t_min || (t0 && t >= t0))
+            continue;
+        support = 0;
+        for (j = 0; j < n; j++) {
+            if (j != i && autobaud_cycles(w[j], j & 1) - t + t / 8 <= t / 4)
+                support++;
+        }
+        if (support >= AUTOBAUD_SUPPORT)
+            t0 = t;
+    }
+    if (!t0)
+        return 0;
+
+    /* With jitter the shortest width is short of a bit, which would drop the
+     * longer pulses of a run from the average, so sort the pulses again by the
+     * first average. */
+    sum_cycles = autobaud_average(w, n, t0, &bits);
+    if (!bits)
+        return 0;
+    sum_cycles = autobaud_average(w, n, (sum_cycles + bits / 2) / bits, &bits);
+    if (bits < AUTOBAUD_MIN_BITS)
+        return 0;
+
+    return ((uint64_t)clock_get_hz(clk_sys) * bits + sum_cycles / 2) / sum_cycles;
+}
+
+static uint32_t autobaud_snap(uint32_t measured) {
+    unsigned int i;
+    uint32_t diff;
+
+    for (i = 0; i < count_of(autobaud_rates); i++) {
+        diff = measured > autobaud_rates[i] ? measured - autobaud_rates[i] : autobaud_rates[i] - measured;
+        if (diff * 1000ull <= (uint64_t)autobaud_rates[i] * AUTOBAUD_SNAP_PERMILLE)
+            return autobaud_rates[i];
+    }
+    return measured;
+}
+
+uint32_t uart_autobaud_poll(void) {
+    uint32_t n, measured;
+    uint8_t request;
+
+    if (ab.request_seq != ab.applied_seq) {
+        ab.applied_seq = ab.request_seq;
+        request = ab.request;
+        if (ab.state == AUTOBAUD_RUNNING)
+            autobaud_release();
+        ab.state = AUTOBAUD_IDLE;
+        if (request == AUTOBAUD_RUNNING)
+            ab.state = autobaud_start() ? AUTOBAUD_RUNNING : AUTOBAUD_FAILED;
+    }
+    if (ab.state != AUTOBAUD_RUNNING)
+        return 0;
+
+    n = AUTOBAUD_SAMPLES - dma_channel_hw_addr(ab.dma_ch)->transfer_count;
+    if (n == ab.collected)
+        return 0;
+    ab.collected = n;
+    if (n < AUTOBAUD_MIN_SAMPLES)
+        return 0;
+
+    // The first width is the SM starting up, not a pulse
+    measured = autobaud_estimate(&samples[1], n - 1);
+    if (!measured) {
+        if (n == AUTOBAUD_SAMPLES) {
+            autobaud_release();
+            ab.state = AUTOBAUD_FAILED;
+        }
+        return 0;
+    }
+
+    autobaud_release();
+    ab.measured = measured;
+    ab.rate = autobaud_snap(measured);
+    ab.state = AUTOBAUD_LOCKED;
+    return ab.rate;
+}
+
+static void uart_autobaud_request(uint8_t state) {
+    ab.request = state;
+    ab.request_seq++;
+    if (uart_taskhandle)
+        xTaskNotifyGive(uart_taskhandle);
+}
+
+// Vendor command: request  [sub-command]
+//                 response [status][data]
+uint32_t uart_autobaud_command(const uint8_t *request, uint8_t *response) {
+    uint8_t *resp = response + 1;
+    uint32_t req_len = 1;
+    bool ok = true;
+
+    switch (*request) {
+    case UART_AUTOBAUD_STATUS:
+        *resp++ = ab.state;
+        *resp++ = ab.request_seq != ab.applied_seq;
+        *resp++ = ab.collected;
+        resp = put_u32(resp, ab.rate);
+        resp = put_u32(resp, ab.measured);
+        break;
+    case UART_AUTOBAUD_START:
+        uart_autobaud_request(AUTOBAUD_RUNNING);
+        break;
+    case UART_AUTOBAUD_STOP:
+        uart_autobaud_request(AUTOBAUD_IDLE);
+        break;
+    default:
+        ok = false;
+        break;
+    }
+
+    *response = ok ? DAP_OK : DAP_ERROR;
+    return (req_len << 16) | (uint32_t)(resp - response);
+}
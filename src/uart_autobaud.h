@@ -0,0 +1,49 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef UART_AUTOBAUD_H_
+#define UART_AUTOBAUD_H_
+
+#include <stdint.h>
+
+// Vendor command sub-commands
+#define UART_AUTOBAUD_STATUS    0
+#define UART_AUTOBAUD_START     1
+#define UART_AUTOBAUD_STOP      2
+
+enum uart_autobaud_state {
+    AUTOBAUD_IDLE = 0,
+    AUTOBAUD_RUNNING,
+    AUTOBAUD_LOCKED,
+    AUTOBAUD_FAILED,
+};
+
+// Called on the UART bridge thread, returns the baud rate to switch to once detected
+uint32_t uart_autobaud_poll(void);
+
+uint32_t uart_autobaud_command(const uint8_t *request, uint8_t *response);
+
+#endif
@@ -0,0 +1,200 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <pico/stdlib.h>
+
+#include "probe_config.h"
+#include "buf_pool.h"
+#include "dap_vendor.h"
+#include "ringbuf.h"
+#include "tusb_stream.h"
+#include "uart_capture.h"
+
+/*
+ * Timestamped capture: while enabled, every byte the RX DMA publishes is also
+ * sent on the stream endpoint, grouped into records of
+ *   [delta us, varint][length, varint][data]
+ * where delta is the arrival time of the record's first byte relative to the
+ * previous record, or to the start of the capture. Arrival times come from
+ * the time of the sync that found the bytes, counting back one character
+ * time per byte from the newest. A record is closed once it spans
+ * UART_TS_WINDOW_US or is full. A record of length 0 is a gap and is followed
+ * by the number of bytes lost, as a varint, when the host fell behind.
+ */
+#define UART_TS_RING_SIZE   4096
+#define UART_TS_RECORD_MAX  128
+#define UART_TS_WINDOW_US   64
+
+static struct {
+    volatile bool want;
+    volatile bool running;
+    volatile bool failed;
+    struct ringbuf ring;
+    char *stale;            // Block of a stopped capture the endpoint may still be reading
+    uint32_t char_ns;
+    uint32_t last_ts;       // Start of the previous record
+    uint32_t last_sync;
+    uint32_t open_ts;       // Start of the record being built
+    uint32_t len;
+    uint32_t lost;          // Bytes lost since the last gap record
+    uint32_t records;
+    uint32_t lost_total;
+    uint8_t rec[UART_TS_RECORD_MAX];
+} ts = {
+    .char_ns = (10 * 1000 * 1000 * 1000ull) / PROBE_UART_BAUDRATE,
+};
+
+static uint8_t *put_varint(uint8_t *p, uint32_t v) {
+    while (v >= 0x80) {
+        *p++ = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+static bool uart_ts_emit(uint32_t stamp, uint32_t len, const uint8_t *data) {
+    uint8_t hdr[15], *p;
+
+    p = put_varint(hdr, stamp - ts.last_ts);
+    p = put_varint(p, len);
+    if (len == 0)
+        p = put_varint(p, ts.lost);
+    if ((uint32_t)ringbuf_free(&ts.ring) < (p - hdr) + len)
+        return false;
+    ringbuf_puts(&ts.ring, (const char *)hdr, p - hdr);
+    if (len)
+        ringbuf_puts(&ts.ring, (const char *)data, len);
+    ts.last_ts = stamp;
+    return true;
+}
+
+static void uart_ts_flush(void) {
+    if (ts.len == 0)
+        return;
+    if (ts.lost && uart_ts_emit(ts.open_ts, 0, NULL))
+        ts.lost = 0;
+    if (!ts.lost && uart_ts_emit(ts.open_ts, ts.len, ts.rec)) {
+        ts.records++;
+    } else {
+        ts.lost += ts.len;
+        ts.lost_total += ts.len;
+    }
+    ts.len = 0;
+}
+
+void uart_capture_request(bool start) {
+    ts.want = start;
+    ts.failed = false;
+}
+
+uint8_t *uart_capture_status(uint8_t *resp) {
+    *resp++ = ts.running;
+    *resp++ = ts.failed;
+    resp = put_u32(resp, ts.records);
+    return put_u32(resp, ts.lost_total);
+}
+
+bool uart_capture_pending(void) {
+    return ts.want != ts.running || ts.stale;
+}
+
+// The block goes back to the pool once no transfer reads from it any more
+static void uart_ts_release(void) {
+    if (ts.stale && !stream_inflight(&ts.ring)) {
+        buf_pool_free(ts.stale, UART_TS_RING_SIZE);
+        ts.stale = NULL;
+    }
+}
+
+// Start and stop requests from the vendor command are carried out on the bridge thread
+void uart_capture_apply(void) {
+    char *buf;
+
+    uart_ts_release();
+    // The ring struct is reused, a new capture waits for the old block to be released
+    if (ts.want && !ts.running && !ts.stale) {
+        buf = buf_pool_alloc(UART_TS_RING_SIZE);
+        if (buf)
+            ringbuf_init(&ts.ring, buf, UART_TS_RING_SIZE);
+        if (!buf || !stream_attach(&ts.ring)) {
+            if (buf)
+                buf_pool_free(buf, UART_TS_RING_SIZE);
+            ts.want = false;
+            ts.failed = true;
+            return;
+        }
+        ts.last_ts = ts.last_sync = time_us_32();
+        ts.len = 0;
+        ts.lost = 0;
+        ts.records = 0;
+        ts.lost_total = 0;
+        ts.failed = false;
+        ts.running = true;
+    } else if (!ts.want && ts.running) {
+        uart_ts_flush();
+        ts.running = false;
+        stream_detach(&ts.ring);
+        ts.stale = ts.ring.data;
+        uart_ts_release();
+    }
+}
+
+void uart_capture_set_char_time(uint32_t char_ns) {
+    ts.char_ns = char_ns;
+}
+
+void uart_capture_feed(const struct ringbuf *r, uint32_t from, uint32_t n,
+                       uint32_t lost, uint32_t now) {
+    uint32_t stamp, i;
+
+    if (!ts.running)
+        return;
+    ts.lost += lost;
+    ts.lost_total += lost;
+    for (i = 0; i < n; i++) {
+        stamp = now - (uint32_t)(((uint64_t)(n - 1 - i) * ts.char_ns) / 1000);
+        // Nothing can have arrived before the previous sync saw the line
+        if ((int32_t)(stamp - ts.last_sync) < 0)
+            stamp = ts.last_sync;
+        if (ts.len && (ts.len == UART_TS_RECORD_MAX || stamp - ts.open_ts >= UART_TS_WINDOW_US))
+            uart_ts_flush();
+        if (ts.len == 0)
+            ts.open_ts = stamp;
+        ts.rec[ts.len++] = r->data[(from + i) & r->mask];
+    }
+    ts.last_sync = now;
+}
+
+void uart_capture_poll(uint32_t now) {
+    if (ts.running && ts.len && now - ts.open_ts >= UART_TS_WINDOW_US)
+        uart_ts_flush();
+}
+
+void uart_capture_flush(void) {
+    if (ts.running)
+        uart_ts_flush();
+}
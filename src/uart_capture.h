@@ -0,0 +1,57 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef UART_CAPTURE_H_
+#define UART_CAPTURE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ringbuf.h"
+
+// Called from the vendor command, carried out by uart_capture_apply()
+void uart_capture_request(bool start);
+uint8_t *uart_capture_status(uint8_t *resp);
+
+/* Called by the UART bridge when uart_capture_pending() says so, which
+ * includes a stopped capture whose block is still being sent */
+bool uart_capture_pending(void);
+void uart_capture_apply(void);
+
+// Time one character takes on the line at the current baud rate
+void uart_capture_set_char_time(uint32_t char_ns);
+
+/* Called by the UART bridge with n new bytes of r, starting at from, found
+ * at now. The lost bytes before them were overwritten before they were seen. */
+void uart_capture_feed(const struct ringbuf *r, uint32_t from, uint32_t n,
+                       uint32_t lost, uint32_t now);
+
+// Closes the open record once it spans the record window
+void uart_capture_poll(uint32_t now);
+// Closes the open record, when the line goes idle
+void uart_capture_flush(void);
+
+#endif
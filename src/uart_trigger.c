@@ -0,0 +1,309 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include <pico/stdlib.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "probe_config.h"
+#include "probe.h"
+#include "DAP.h"
+#include "dap_vendor.h"
+#include "dap_mem.h"
+#include "dap_job.h"
+#include "cdc_uart.h"
+#include "uart_trigger.h"
+
+/*
+ * Pattern trigger on the debug UART's received data. The patterns are
+ * compiled into an Aho-Corasick automaton, which the UART bridge steps once
+ * per new byte as it publishes them, so a match is found as soon as its
+ * last byte is in the ring, with no rescanning. The trigger is one shot:
+ * the first match fires the actions of every pattern that ends there, and
+ * it stays fired until it is armed again.
+ *
+ * Patterns are edited and the trigger armed from the DAP thread, but the
+ * automaton is only built and stepped on the bridge thread.
+ */
+#define UART_TRIGGER_NODES  (1 + UART_TRIGGER_PATTERNS * UART_TRIGGER_PATTERN_MAX)
+
+#define DCB_DHCSR       0xE000EDF0U
+#define DHCSR_DBGKEY    (0xA05Fu << 16)
+#define DHCSR_C_DEBUGEN (1u << 0)
+#define DHCSR_C_HALT    (1u << 1)
+#define DHCSR_S_HALT    (1u << 17)
+
+// DHCSR reads before giving up on S_HALT
+#define HALT_POLLS      8
+
+enum trigger_halt_result {
+    HALT_NONE = 0,
+    HALT_OK,
+    HALT_FAILED,
+};
+
+// Trie node, 0 ends the child and sibling lists as the root is never a child
+struct trigger_node {
+    uint8_t c;
+    uint8_t child;
+    uint8_t sibling;
+    uint8_t fail;
+    uint8_t out;        // Patterns ending here, including through fail links
+};
+
+static struct {
+    struct {
+        uint8_t len;
+        uint8_t actions;
+        uint8_t bytes[UART_TRIGGER_PATTERN_MAX];
+    } patterns[UART_TRIGGER_PATTERNS];
+    uint8_t count;
+    uint8_t ap;
+    // Last request from the DAP thread, TRIGGER_ARMED or TRIGGER_IDLE
+    volatile uint8_t request;
+    volatile uint8_t request_seq;
+    uint8_t applied_seq;
+    volatile uint8_t state;
+    struct trigger_node nodes[UART_TRIGGER_NODES];
+    uint8_t cur;
+    uint32_t seen;              // Bytes fed since arming
+    uint8_t match;
+    uint32_t match_offset;
+    uint32_t match_time;
+    volatile uint8_t halt;
+} trig;
+
+static void uart_trigger_halt_job(void) {
+    uint32_t dhcsr = 0;
+    int i;
+
+    trig.halt = HALT_FAILED;
+    if (!dap_mem_acquire(trig.ap) ||
+        !dap_mem_write(DCB_DHCSR, 4, DHCSR_DBGKEY | DHCSR_C_DEBUGEN | DHCSR_C_HALT))
+        return;
+
+    // Only report the halt once the core says it has stopped
+    for (i = 0; i < HALT_POLLS; i++) {
+        if (!dap_mem_read(DCB_DHCSR, 4, &dhcsr))
+            return;
+        if (dhcsr & DHCSR_S_HALT) {
+            trig.halt = HALT_OK;
+            return;
+        }
+    }
+}
+
+static inline uint8_t trigger_child(uint8_t s, uint8_t c) {
+    uint8_t v;
+
+    for (v = trig.nodes[s].child; v && trig.nodes[v].c != c; v = trig.nodes[v].sibling)
+        ;
+    return v;
+}
+
+static inline uint8_t trigger_step(uint8_t s, uint8_t c) {
+    uint8_t v;
+
+    while (1) {
+        v = trigger_child(s, c);
+        if (v || s == 0)
+            return v;
+        s = trig.nodes[s].fail;
+    }
+}
+
+static void trigger_compile(void) {
+    uint8_t queue[UART_TRIGGER_NODES];
+    unsigned int head = 0, tail = 0, count = 1;
+    uint8_t s, u, v, f;
+    int p, i;
+
+    memset(trig.nodes, 0, sizeof(trig.nodes));
+
+    for (p = 0; p < trig.count; p++) {
+        s = 0;
+        for (i = 0; i < trig.patterns[p].len; i++) {
+            v = trigger_child(s, trig.patterns[p].bytes[i]);
+            if (!v) {
+                v = count++;
+                trig.nodes[v].c = trig.patterns[p].bytes[i];
+                trig.nodes[v].sibling = trig.nodes[s].child;
+                trig.nodes[s].child = v;
+            }
+            s = v;
+        }
+        trig.nodes[s].out |= 1u << p;
+    }
+
+    // Breadth first, so every fail target is finished before it is used
+    for (v = trig.nodes[0].child; v; v = trig.nodes[v].sibling)
+        queue[tail++] = v;
+    while (head < tail) {
+        u = queue[head++];
+        for (v = trig.nodes[u].child; v; v = trig.nodes[v].sibling) {
+            f = trig.nodes[u].fail;
+            while (f && !trigger_child(f, trig.nodes[v].c))
+                f = trig.nodes[f].fail;
+            trig.nodes[v].fail = trigger_child(f, trig.nodes[v].c);
+            trig.nodes[v].out |= trig.nodes[trig.nodes[v].fail].out;
+            queue[tail++] = v;
+        }
+    }
+}
+
+static void uart_trigger_fire(uint8_t out) {
+    uint8_t actions = 0;
+    int p;
+
+    for (p = 0; p < trig.count; p++) {
+        if (out & (1u << p))
+            actions |= trig.patterns[p].actions;
+    }
+
+    trig.match = out;
+    trig.match_time = time_us_32();
+    trig.state = TRIGGER_FIRED;
+
+    if (actions & UART_TRIGGER_HALT)
+        dap_job_kick(uart_trigger_halt_job);
+    if (actions & UART_TRIGGER_RESET)
+        probe_assert_reset(0);
+}
+
+void __probe_hot_func(uart_trigger_feed)(const struct ringbuf *r, uint32_t from, uint32_t n) {
+    uint8_t s = trig.cur;
+    uint32_t i;
+
+    if (trig.state != TRIGGER_ARMED)
+        return;
+
+    for (i = 0; i < n; i++) {
+        s = trigger_step(s, r->data[(from + i) & r->mask]);
+        if (trig.nodes[s].out) {
+            trig.match_offset = trig.seen + i;
+            uart_trigger_fire(trig.nodes[s].out);
+            break;
+        }
+    }
+    trig.cur = s;
+    trig.seen += n;
+}
+
+bool uart_trigger_pending(void) {
+    return trig.request_seq != trig.applied_seq;
+}
+
+void uart_trigger_apply(void) {
+    uint8_t request;
+
+    trig.applied_seq = trig.request_seq;
+    request = trig.request;
+    if (request == TRIGGER_ARMED) {
+        trigger_compile();
+        trig.cur = 0;
+        trig.seen = 0;
+        trig.match = 0;
+        trig.match_offset = 0;
+        trig.match_time = 0;
+        trig.halt = HALT_NONE;
+    }
+    trig.state = request;
+}
+
+static void uart_trigger_request(uint8_t state) {
+    trig.request = state;
+    trig.request_seq++;
+    if (uart_taskhandle)
+        xTaskNotifyGive(uart_taskhandle);
+}
+
+// Vendor command: request  [sub-command][parameters]
+//                 response [status][data]
+uint32_t uart_trigger_command(const uint8_t *request, uint8_t *response) {
+    uint8_t *resp = response + 1;
+    uint32_t req_len = 1;
+    bool ok = true;
+    bool idle = !uart_trigger_pending() && trig.state != TRIGGER_ARMED;
+    uint8_t actions = 0, len;
+    int p;
+
+    switch (*request) {
+    case UART_TRIGGER_STATUS:
+        *resp++ = trig.state;
+        *resp++ = uart_trigger_pending();
+        *resp++ = trig.match;
+        *resp++ = trig.halt;
+        resp = put_u32(resp, trig.match_offset);
+        // Match time as an age, the host has no other use for the probe's clock
+        resp = put_u32(resp, trig.state == TRIGGER_FIRED ? time_us_32() - trig.match_time : 0);
+        break;
+    case UART_TRIGGER_ADD:
+        // [actions][length][bytes] -> [pattern index]
+        len = request[2];
+        req_len += 2 + len;
+        ok = idle && trig.count < UART_TRIGGER_PATTERNS && len > 0 && len <= UART_TRIGGER_PATTERN_MAX;
+        if (!ok)
+            break;
+        trig.patterns[trig.count].actions = request[1];
+        trig.patterns[trig.count].len = len;
+        memcpy(trig.patterns[trig.count].bytes, &request[3], len);
+        *resp++ = trig.count++;
+        break;
+    case UART_TRIGGER_CLEAR:
+        ok = idle;
+        if (ok)
+            trig.count = 0;
+        break;
+    case UART_TRIGGER_ARM:
+        // [ap], the MEM-AP used to halt the core
+        req_len += 1;
+        ok = trig.count > 0;
+        if (!ok)
+            break;
+        for (p = 0; p < trig.count; p++)
+            actions |= trig.patterns[p].actions;
+        trig.ap = request[1];
+        dap_job_stop(uart_trigger_halt_job);
+        // The halt runs on the DAP thread, which the bridge wakes on a match
+        if (actions & UART_TRIGGER_HALT)
+            ok = dap_job_start(uart_trigger_halt_job, 0);
+        if (ok)
+            uart_trigger_request(TRIGGER_ARMED);
+        break;
+    case UART_TRIGGER_DISARM:
+        dap_job_stop(uart_trigger_halt_job);
+        uart_trigger_request(TRIGGER_IDLE);
+        break;
+    default:
+        ok = false;
+        break;
+    }
+
+    *response = ok ? DAP_OK : DAP_ERROR;
+    return (req_len << 16) | (uint32_t)(resp - response);
+}
@@ -0,0 +1,65 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef UART_TRIGGER_H_
+#define UART_TRIGGER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ringbuf.h"
+
+// Pattern table limits, every pattern byte is a node in the automaton
+#define UART_TRIGGER_PATTERNS       4
+#define UART_TRIGGER_PATTERN_MAX    32
+
+// Actions, per pattern
+#define UART_TRIGGER_RESET  (1u << 0)   // Assert nRESET and leave it asserted
+#define UART_TRIGGER_HALT   (1u << 1)   // Halt the core through DHCSR
+
+// Vendor command sub-commands
+#define UART_TRIGGER_STATUS 0
+#define UART_TRIGGER_ADD    1
+#define UART_TRIGGER_CLEAR  2
+#define UART_TRIGGER_ARM    3
+#define UART_TRIGGER_DISARM 4
+
+enum uart_trigger_state {
+    TRIGGER_IDLE = 0,
+    TRIGGER_ARMED,
+    TRIGGER_FIRED,
+};
+
+// Called by the UART bridge with n new bytes of r, starting at from
+void uart_trigger_feed(const struct ringbuf *r, uint32_t from, uint32_t n);
+
+// Called by the UART bridge when uart_trigger_pending() says so
+bool uart_trigger_pending(void);
+void uart_trigger_apply(void);
+
+uint32_t uart_trigger_command(const uint8_t *request, uint8_t *response);
+
+#endif
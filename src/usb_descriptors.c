@@ -28,6 +28,8 @@
 #include "tusb.h"
 #include "get_serial.h"
 #include "probe_config.h"
+#include "tusb_stream.h"
+#include "tusb_edpt_handler.h"
 
 //--------------------------------------------------------------------+
 // Device Descriptors
@@ -73,6 +75,19 @@ enum
   ITF_NUM_CDC_DATA,
   ITF_NUM_GDB,
   ITF_NUM_GDB_DATA,
+#if ((SWO_UART != 0) || (SWO_MANCHESTER != 0))
+  ITF_NUM_ITM,
+  ITF_NUM_ITM_DATA,
+#endif
+  ITF_NUM_STREAM,
+#if PROBE_PIO_UART_COUNT > 0
+  ITF_NUM_PIO_UART0,
+  ITF_NUM_PIO_UART0_DATA,
+#endif
+#if PROBE_PIO_UART_COUNT > 1
+  ITF_NUM_PIO_UART1,
+  ITF_NUM_PIO_UART1_DATA,
+#endif
   ITF_NUM_TOTAL
 };
 
@@ -84,13 +99,39 @@ enum
 #define EPNUM_GDB_NOTIF   0x86
 #define EPNUM_GDB_OUT     0x07
 #define EPNUM_GDB_IN      0x88
+#define STREAM_IN_EP_NUM  0x89
+#define DAP_SWO_EP_NUM    0x8A
+#define EPNUM_ITM_NOTIF   0x8B
+#define EPNUM_ITM_OUT     0x0C
+#define EPNUM_ITM_IN      0x8D
+#define EPNUM_PIO_UART0_NOTIF 0x8E
+#define EPNUM_PIO_UART0_OUT   0x0E
+#define EPNUM_PIO_UART0_IN    0x8F
+#define EPNUM_PIO_UART1_NOTIF 0x8C
+#define EPNUM_PIO_UART1_OUT   0x0F
+#define EPNUM_PIO_UART1_IN    0x87
 
 #if (PROBE_DEBUG_PROTOCOL == PROTO_DAP_V1)
-#define CONFIG_TOTAL_LEN  (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN * CFG_TUD_CDC + TUD_HID_INOUT_DESC_LEN)
+#define PROBE_DESC_LEN    TUD_HID_INOUT_DESC_LEN
+#elif (SWO_STREAM != 0)
+#define PROBE_DESC_LEN    TUD_DAP_SWO_DESC_LEN
+#else
+#define PROBE_DESC_LEN    TUD_VENDOR_DESC_LEN
+#endif
+
+// The ITM CDC only exists when the board can capture SWO
+#if ((SWO_UART != 0) || (SWO_MANCHESTER != 0))
+#define ITM_CDC_DESC_LEN  TUD_CDC_DESC_LEN
 #else
-#define CONFIG_TOTAL_LEN  (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN * CFG_TUD_CDC + TUD_VENDOR_DESC_LEN)
+#define ITM_CDC_DESC_LEN  0
 #endif
 
+#define CONFIG_TOTAL_LEN  (TUD_CONFIG_DESC_LEN + PROBE_DESC_LEN + TUD_CDC_DESC_LEN * 2 + ITM_CDC_DESC_LEN + TUD_STREAM_DESC_LEN + \
+                           TUD_CDC_DESC_LEN * PROBE_PIO_UART_COUNT)
+
+// Offset of the GDB CDC descriptor within desc_configuration
+#define GDB_CDC_DESC_OFFSET (TUD_CONFIG_DESC_LEN + PROBE_DESC_LEN + TUD_CDC_DESC_LEN)
+
 static uint8_t const desc_hid_report[] =
 {
   TUD_HID_REPORT_DESC_GENERIC_INOUT(CFG_TUD_HID_EP_BUFSIZE)
@@ -109,6 +150,9 @@ uint8_t desc_configuration[] =
 #if (PROBE_DEBUG_PROTOCOL == PROTO_DAP_V1)
   // HID (named interface)
   TUD_HID_INOUT_DESCRIPTOR(ITF_NUM_PROBE, 4, HID_ITF_PROTOCOL_NONE, sizeof(desc_hid_report), DAP_OUT_EP_NUM, DAP_IN_EP_NUM, CFG_TUD_HID_EP_BUFSIZE, 1),
+#elif (PROBE_DEBUG_PROTOCOL == PROTO_DAP_V2) && (SWO_STREAM != 0)
+  // Bulk (named interface) with SWO trace endpoint
+  TUD_DAP_SWO_DESCRIPTOR(ITF_NUM_PROBE, 5, DAP_OUT_EP_NUM, DAP_IN_EP_NUM, DAP_SWO_EP_NUM, 64),
 #elif (PROBE_DEBUG_PROTOCOL == PROTO_DAP_V2)
   // Bulk (named interface)
   TUD_VENDOR_DESCRIPTOR(ITF_NUM_PROBE, 5, DAP_OUT_EP_NUM, DAP_IN_EP_NUM, 64),
@@ -120,6 +164,19 @@ uint8_t desc_configuration[] =
   TUD_CDC_DESCRIPTOR(ITF_NUM_CDC_COM, 6, CDC_NOTIFICATION_EP_NUM, 64, CDC_DATA_OUT_EP_NUM, CDC_DATA_IN_EP_NUM, 64),
   // Interface 3 + 4
   TUD_CDC_DESCRIPTOR(ITF_NUM_GDB, 7, EPNUM_GDB_NOTIF, 64, EPNUM_GDB_OUT, EPNUM_GDB_IN, 64),
+#if ((SWO_UART != 0) || (SWO_MANCHESTER != 0))
+  // Interface 5 + 6
+  TUD_CDC_DESCRIPTOR(ITF_NUM_ITM, 9, EPNUM_ITM_NOTIF, 64, EPNUM_ITM_OUT, EPNUM_ITM_IN, 64),
+#endif
+  // Stream interface
+  TUD_STREAM_DESCRIPTOR(ITF_NUM_STREAM, 8, STREAM_IN_EP_NUM, 64),
+#if PROBE_PIO_UART_COUNT > 0
+  // PIO UART bridges
+  TUD_CDC_DESCRIPTOR(ITF_NUM_PIO_UART0, 10, EPNUM_PIO_UART0_NOTIF, 64, EPNUM_PIO_UART0_OUT, EPNUM_PIO_UART0_IN, 64),
+#endif
+#if PROBE_PIO_UART_COUNT > 1
+  TUD_CDC_DESCRIPTOR(ITF_NUM_PIO_UART1, 11, EPNUM_PIO_UART1_NOTIF, 64, EPNUM_PIO_UART1_OUT, EPNUM_PIO_UART1_IN, 64),
+#endif
 };
 
 // Invoked when received GET CONFIGURATION DESCRIPTOR
@@ -129,7 +186,7 @@ uint8_t const * tud_descriptor_configuration_cb(uint8_t index)
 {
   (void) index; // for multiple configurations
   /* Hack in CAP_BREAK support */
-  desc_configuration[CONFIG_TOTAL_LEN - TUD_CDC_DESC_LEN + 8 + 9 + 5 + 5 + 4 - 1] = 0x6;
+  desc_configuration[GDB_CDC_DESC_OFFSET + 8 + 9 + 5 + 5 + 4 - 1] = 0x6;
   return desc_configuration;
 }
 
@@ -148,6 +205,10 @@ char const* string_desc_arr [] =
   "CMSIS-DAP v2 Interface", // 5: Interface descriptor for Bulk transport
   "CDC-ACM UART Interface", // 6: Interface descriptor for CDC
   "Black Magic GDB Server", // 7: Interface descriptor for CDC
+  "Debugprobe Data Stream", // 8: Interface descriptor for the stream endpoint
+  "ITM Stimulus Port 0",    // 9: Interface descriptor for CDC
+  "PIO UART 0",             // 10: Interface descriptor for CDC
+  "PIO UART 1",             // 11: Interface descriptor for CDC
 };
 
 static uint16_t _desc_str[32];
@@ -206,7 +267,9 @@ will insert "DeviceInterfaceGUIDs" multistring property.
 https://developers.google.com/web/fundamentals/native-hardware/build-for-webusb/
 (Section Microsoft OS compatibility descriptors)
 */
-#define MS_OS_20_DESC_LEN  0xB2
+// One function subset per WinUSB interface: subset header, compatible ID and registry property
+#define MS_OS_20_FUNC_LEN  0xA0
+#define MS_OS_20_DESC_LEN  (0x0A + 0x08 + MS_OS_20_FUNC_LEN * 2)
 
 #define BOS_TOTAL_LEN      (TUD_BOS_DESC_LEN + TUD_BOS_MICROSOFT_OS_DESC_LEN)
 
@@ -228,14 +291,14 @@ uint8_t const desc_ms_os_20[] =
   U16_TO_U8S_LE(0x0008), U16_TO_U8S_LE(MS_OS_20_SUBSET_HEADER_CONFIGURATION), 0, 0, U16_TO_U8S_LE(MS_OS_20_DESC_LEN-0x0A),
 
   // Function Subset header: length, type, first interface, reserved, subset length
-  U16_TO_U8S_LE(0x0008), U16_TO_U8S_LE(MS_OS_20_SUBSET_HEADER_FUNCTION), ITF_NUM_PROBE, 0, U16_TO_U8S_LE(MS_OS_20_DESC_LEN-0x0A-0x08),
+  U16_TO_U8S_LE(0x0008), U16_TO_U8S_LE(MS_OS_20_SUBSET_HEADER_FUNCTION), ITF_NUM_PROBE, 0, U16_TO_U8S_LE(MS_OS_20_FUNC_LEN),
 
   // MS OS 2.0 Compatible ID descriptor: length, type, compatible ID, sub compatible ID
   U16_TO_U8S_LE(0x0014), U16_TO_U8S_LE(MS_OS_20_FEATURE_COMPATBLE_ID), 'W', 'I', 'N', 'U', 'S', 'B', 0x00, 0x00,
   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // sub-compatible
 
   // MS OS 2.0 Registry property descriptor: length, type
-  U16_TO_U8S_LE(MS_OS_20_DESC_LEN-0x0A-0x08-0x08-0x14), U16_TO_U8S_LE(MS_OS_20_FEATURE_REG_PROPERTY),
+  U16_TO_U8S_LE(MS_OS_20_FUNC_LEN-0x08-0x14), U16_TO_U8S_LE(MS_OS_20_FEATURE_REG_PROPERTY),
   U16_TO_U8S_LE(0x0007), U16_TO_U8S_LE(0x002A), // wPropertyDataType, wPropertyNameLength and PropertyName "DeviceInterfaceGUIDs\0" in UTF-16
   'D', 0x00, 'e', 0x00, 'v', 0x00, 'i', 0x00, 'c', 0x00, 'e', 0x00, 'I', 0x00, 'n', 0x00, 't', 0x00, 'e', 0x00,
   'r', 0x00, 'f', 0x00, 'a', 0x00, 'c', 0x00, 'e', 0x00, 'G', 0x00, 'U', 0x00, 'I', 0x00, 'D', 0x00, 's', 0x00, 0x00, 0x00,
@@ -244,7 +307,26 @@ uint8_t const desc_ms_os_20[] =
   '{', 0x00, 'C', 0x00, 'D', 0x00, 'B', 0x00, '3', 0x00, 'B', 0x00, '5', 0x00, 'A', 0x00, 'D', 0x00, '-', 0x00,
   '2', 0x00, '9', 0x00, '3', 0x00, 'B', 0x00, '-', 0x00, '4', 0x00, '6', 0x00, '6', 0x00, '3', 0x00, '-', 0x00,
   'A', 0x00, 'A', 0x00, '3', 0x00, '6', 0x00, '-', 0x00, '1', 0x00, 'A', 0x00, 'A', 0x00, 'E', 0x00, '4', 0x00,
-  '6', 0x00, '4', 0x00, '6', 0x00, '3', 0x00, '7', 0x00, '7', 0x00, '6', 0x00, '}', 0x00, 0x00, 0x00, 0x00, 0x00
+  '6', 0x00, '4', 0x00, '6', 0x00, '3', 0x00, '7', 0x00, '7', 0x00, '6', 0x00, '}', 0x00, 0x00, 0x00, 0x00, 0x00,
+
+  // Function Subset header: length, type, first interface, reserved, subset length
+  U16_TO_U8S_LE(0x0008), U16_TO_U8S_LE(MS_OS_20_SUBSET_HEADER_FUNCTION), ITF_NUM_STREAM, 0, U16_TO_U8S_LE(MS_OS_20_FUNC_LEN),
+
+  // MS OS 2.0 Compatible ID descriptor: length, type, compatible ID, sub compatible ID
+  U16_TO_U8S_LE(0x0014), U16_TO_U8S_LE(MS_OS_20_FEATURE_COMPATBLE_ID), 'W', 'I', 'N', 'U', 'S', 'B', 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // sub-compatible
+
+  // MS OS 2.0 Registry property descriptor: length, type
+  U16_TO_U8S_LE(MS_OS_20_FUNC_LEN-0x08-0x14), U16_TO_U8S_LE(MS_OS_20_FEATURE_REG_PROPERTY),
+  U16_TO_U8S_LE(0x0007), U16_TO_U8S_LE(0x002A), // wPropertyDataType, wPropertyNameLength and PropertyName "DeviceInterfaceGUIDs\0" in UTF-16
+  'D', 0x00, 'e', 0x00, 'v', 0x00, 'i', 0x00, 'c', 0x00, 'e', 0x00, 'I', 0x00, 'n', 0x00, 't', 0x00, 'e', 0x00,
+  'r', 0x00, 'f', 0x00, 'a', 0x00, 'c', 0x00, 'e', 0x00, 'G', 0x00, 'U', 0x00, 'I', 0x00, 'D', 0x00, 's', 0x00, 0x00, 0x00,
+  U16_TO_U8S_LE(0x0050), // wPropertyDataLength
+  // bPropertyData "{9FAC8D56-0214-4425-8A3A-3727ED6061CF}" as a UTF-16 string
+  '{', 0x00, '9', 0x00, 'F', 0x00, 'A', 0x00, 'C', 0x00, '8', 0x00, 'D', 0x00, '5', 0x00, '6', 0x00, '-', 0x00,
+  '0', 0x00, '2', 0x00, '1', 0x00, '4', 0x00, '-', 0x00, '4', 0x00, '4', 0x00, '2', 0x00, '5', 0x00, '-', 0x00,
+  '8', 0x00, 'A', 0x00, '3', 0x00, 'A', 0x00, '-', 0x00, '3', 0x00, '7', 0x00, '2', 0x00, '7', 0x00, 'E', 0x00,
+  'D', 0x00, '6', 0x00, '0', 0x00, '6', 0x00, '1', 0x00, 'C', 0x00, 'F', 0x00, '}', 0x00, 0x00, 0x00, 0x00, 0x00
 };
 
 TU_VERIFY_STATIC(sizeof(desc_ms_os_20) == MS_OS_20_DESC_LEN, "Incorrect size");
@@ -0,0 +1,303 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * The two SWD transfer variants in sw_dp_pio.c against a scripted target.
+ * The PIO layer is replaced by a recorder, so a transfer turns into the list
+ * of bit operations it would have queued. The default-configuration variant
+ * has to produce the same operations, ACK, data and side effects as the
+ * generic one for every request and target response, SWD_Transfer has to
+ * pick it only for the default configuration, and the two are timed against
+ * each other. The timings are printed, not checked: on the host they only
+ * show the work the constant folding removes, not the gain on the RP2040.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "test.h"
+
+// The variants are static, build the source into this file to reach them
+#include "sw_dp_pio.c"
+
+#define OPS_MAX         16
+#define BENCH_ROUNDS    2000000
+
+enum op_kind {
+    OP_WRITE = 1,
+    OP_READ,
+    OP_HIZ,
+};
+
+struct op {
+    uint8_t kind;
+    uint16_t bits;
+    uint32_t data;
+};
+
+struct transcript {
+    struct op ops[OPS_MAX];
+    int count;
+    uint8_t ack;
+    uint32_t data;
+    uint32_t timestamp;
+    uint32_t dp_select;
+    int captured;
+};
+
+DAP_Data_t DAP_Data;
+uint32_t swd_dp_select;
+volatile uint8_t swd_capture_state = CAPTURE_ARMED;
+
+// Scripted target: the ACK it answers with and the read data it returns
+static uint8_t target_ack;
+static uint32_t target_rdata;
+static bool target_bad_parity;
+static int target_reads;
+
+static bool recording;
+static struct transcript *rec;
+static volatile uint32_t sink;
+
+uint32_t time_us_32(void) {
+    return 0x5A5A0000u + target_reads;
+}
+
+void swd_capture_fire(uint8_t ack) {
+    if (recording)
+        rec->captured++;
+}
+
+void probe_set_swclk_freq(uint freq_khz) {
+}
+
+static void record(uint8_t kind, uint bits, uint32_t data) {
+    if (!recording)
+        return;
+    CHECK(rec->count < OPS_MAX);
+    if (rec->count < OPS_MAX)
+        rec->ops[rec->count++] = (struct op) { kind, (uint16_t)bits, data };
+}
+
+void probe_write_bits(uint bit_count, uint32_t data_byte) {
+    sink += data_byte;
+    record(OP_WRITE, bit_count, data_byte);
+}
+
+/* The reads after the request are, in order: turnaround + ACK, then either
+ * the read data and its parity or, on a protocol error, the back-off. */
+uint32_t probe_read_bits(uint bit_count) {
+    uint32_t v;
+
+    switch (target_reads++) {
+    case 0:
+        // The turnaround bits the host ignores are read as 1s
+        v = ((uint32_t)target_ack << DAP_Data.swd_conf.turnaround) |
+            ((1u << DAP_Data.swd_conf.turnaround) - 1);
+        break;
+    case 1:
+        v = target_rdata;
+        break;
+    case 2:
+        v = (__builtin_popcount(target_rdata) & 1u) ^ target_bad_parity;
+        break;
+    default:
+        v = 0xFFFFFFFFu;
+        break;
+    }
+    record(OP_READ, bit_count, v);
+    return v;
+}
+
+void probe_hiz_clocks(uint bit_count) {
+    sink += bit_count;
+    record(OP_HIZ, bit_count, 0);
+}
+
+static void run(uint8_t (*fn)(uint32_t, uint32_t *), uint32_t request, struct transcript *t) {
+    memset(t, 0, sizeof(*t));
+    t->data = 0x13572468u;
+    swd_dp_select = 0;
+    DAP_Data.timestamp = 0;
+    target_reads = 0;
+    rec = t;
+    recording = true;
+    t->ack = fn(request, &t->data);
+    recording = false;
+    t->timestamp = DAP_Data.timestamp;
+    t->dp_select = swd_dp_select;
+}
+
+static bool same(const struct transcript *a, const struct transcript *b) {
+    return a->count == b->count && !memcmp(a->ops, b->ops, sizeof(a->ops)) &&
+           a->ack == b->ack && a->data == b->data && a->timestamp == b->timestamp &&
+           a->dp_select == b->dp_select && a->captured == b->captured;
+}
+
+static void set_conf(uint8_t turnaround, uint8_t data_phase, uint8_t idle_cycles) {
+    DAP_Data.swd_conf.turnaround = turnaround;
+    DAP_Data.swd_conf.data_phase = data_phase;
+    DAP_Data.transfer.idle_cycles = idle_cycles;
+}
+
+static void test_request_bytes(void) {
+    uint32_t i, parity, expect;
+
+    for (i = 0; i < 16; i++) {
+        // Start, APnDP, RnW, A2, A3, parity, stop, park - sent LSB first
+        parity = __builtin_popcount(i) & 1u;
+        expect = 1u | (i << 1) | (parity << 5) | (1u << 7);
+        CHECK_EQ(swd_request_byte[i], expect);
+    }
+}
+
+static void test_variants_agree(void) {
+    static const uint8_t acks[] = {
+        DAP_TRANSFER_OK, DAP_TRANSFER_WAIT, DAP_TRANSFER_FAULT, 0, 7,
+    };
+    struct transcript g, d;
+    uint32_t request;
+    unsigned int a, bad;
+
+    set_conf(1, 0, 0);
+    for (request = 0; request < 16; request++) {
+        for (a = 0; a < sizeof(acks); a++) {
+            for (bad = 0; bad < 2; bad++) {
+                uint32_t req = request | (bad ? DAP_TRANSFER_TIMESTAMP : 0);
+
+                target_ack = acks[a];
+                target_rdata = 0x80000001u + request * 0x01010101u;
+                target_bad_parity = bad;
+                run(swd_transfer_generic, req, &g);
+                run(swd_transfer_default, req, &d);
+                if (!same(&g, &d))
+                    printf("  request %02x ack %u parity %s differs\n", (unsigned int)req,
+                           target_ack, bad ? "bad" : "good");
+                CHECK(same(&g, &d));
+            }
+        }
+    }
+
+    // Spot checks that the recorded behaviour is the SWD protocol at all
+    target_ack = DAP_TRANSFER_OK;
+    target_rdata = 0x00000003u;
+    target_bad_parity = false;
+    run(swd_transfer_default, DAP_TRANSFER_RnW | DAP_TRANSFER_APnDP, &d);
+    CHECK_EQ(d.ack, DAP_TRANSFER_OK);
+    CHECK_EQ(d.data, 0x00000003u);
+    CHECK_EQ(d.count, 5);
+    CHECK_EQ(d.ops[0].data, 0x87);
+    CHECK_EQ(d.ops[1].bits, 4);
+    CHECK_EQ(d.ops[4].kind, OP_HIZ);
+
+    target_bad_parity = true;
+    run(swd_transfer_default, DAP_TRANSFER_RnW, &d);
+    CHECK_EQ(d.ack, DAP_TRANSFER_ERROR);
+
+    target_bad_parity = false;
+    run(swd_transfer_default, DP_SELECT, &d);
+    CHECK_EQ(d.dp_select, 0x13572468u);
+    CHECK_EQ(d.ops[3].bits, 32);
+    CHECK_EQ(d.ops[3].data, 0x13572468u);
+
+    target_ack = DAP_TRANSFER_WAIT;
+    run(swd_transfer_default, DAP_TRANSFER_RnW, &d);
+    CHECK_EQ(d.ack, DAP_TRANSFER_WAIT);
+    CHECK_EQ(d.count, 3);
+    CHECK_EQ(d.captured, 1);
+}
+
+static void test_binding(void) {
+    struct transcript t;
+
+    target_ack = DAP_TRANSFER_OK;
+    target_rdata = 0;
+    target_bad_parity = false;
+
+    set_conf(1, 0, 0);
+    run(SWD_Transfer, DAP_TRANSFER_RnW, &t);
+    CHECK(swd_transfer_fn == swd_transfer_default);
+
+    // Each non-default setting must fall back to the generic body
+    set_conf(2, 0, 0);
+    run(SWD_Transfer, DAP_TRANSFER_RnW, &t);
+    CHECK(swd_transfer_fn == swd_transfer_generic);
+    CHECK_EQ(t.ops[1].bits, 5);
+    CHECK_EQ(t.ops[t.count - 1].bits, 2);
+
+    set_conf(1, 0, 200);
+    run(SWD_Transfer, 0, &t);
+    CHECK(swd_transfer_fn == swd_transfer_generic);
+    CHECK_EQ(t.ops[t.count - 1].kind, OP_WRITE);
+    CHECK_EQ(t.ops[t.count - 1].bits, 200);
+    CHECK_EQ(t.ops[t.count - 1].data, 0);
+
+    set_conf(1, 1, 0);
+    target_ack = DAP_TRANSFER_WAIT;
+    run(SWD_Transfer, DAP_TRANSFER_RnW, &t);
+    CHECK(swd_transfer_fn == swd_transfer_generic);
+    CHECK_EQ(t.ops[2].bits, 33);
+
+    set_conf(1, 0, 0);
+    target_ack = DAP_TRANSFER_OK;
+    run(SWD_Transfer, DAP_TRANSFER_RnW, &t);
+    CHECK(swd_transfer_fn == swd_transfer_default);
+}
+
+static double bench(uint8_t (*fn)(uint32_t, uint32_t *)) {
+    struct timespec t0, t1;
+    uint32_t data = 0;
+    long i;
+
+    target_ack = DAP_TRANSFER_OK;
+    target_rdata = 0x12345678u;
+    target_bad_parity = false;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        // The mix of a memory read loop: AP reads with the odd write
+        target_reads = 0;
+        sink += fn((i & 7) ? (DAP_TRANSFER_RnW | DAP_TRANSFER_APnDP | DAP_TRANSFER_A3) : 0x4, &data);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / BENCH_ROUNDS;
+}
+
+int main(void) {
+    double generic, dflt;
+
+    test_request_bytes();
+    test_variants_agree();
+    test_binding();
+
+    set_conf(1, 0, 0);
+    generic = bench(swd_transfer_generic);
+    dflt = bench(swd_transfer_default);
+    printf("swd_transfer_generic %.1f ns, swd_transfer_default %.1f ns per transfer\n",
+           generic, dflt);
+
+    TEST_EXIT();
+}
@@ -0,0 +1,592 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pio_sim.h"
+
+enum {
+    COND_ALWAYS,
+    COND_X_ZERO,
+    COND_X_DEC,
+    COND_Y_ZERO,
+    COND_Y_DEC,
+    COND_X_NE_Y,
+    COND_PIN,
+    COND_OSR_NOT_EMPTY,
+};
+
+enum {
+    REG_PINS,
+    REG_X,
+    REG_Y,
+    REG_NULL,
+    REG_PINDIRS,
+    REG_PC,
+    REG_ISR,
+    REG_OSR,
+    REG_STATUS,
+};
+
+enum {
+    MOV_NONE,
+    MOV_INVERT,
+    MOV_REVERSE,
+};
+
+#define MAX_LINE    256
+#define MAX_LABELS  PIO_SIM_MAX_INSNS
+#define MAX_TOKENS  8
+
+struct label {
+    char name[32];
+    unsigned int index;
+};
+
+struct source_insn {
+    char text[MAX_LINE];
+    unsigned int line;
+};
+
+static const char *sim_path;
+
+static bool parse_error(unsigned int line, const char *what, const char *text) {
+    fprintf(stderr, "%s:%u: %s: %s\n", sim_path, line, what, text);
+    return false;
+}
+
+static char *trim(char *s) {
+    char *end;
+
+    while (isspace((unsigned char)*s))
+        s++;
+    end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1]))
+        *--end = '\0';
+    return s;
+}
+
+// Drop ; and // comments, and /* */ blocks which may span lines
+static void strip_comments(char *s, bool *in_block) {
+    char *out = s;
+
+    while (*s) {
+        if (*in_block) {
+            if (s[0] == '*' && s[1] == '/') {
+                *in_block = false;
+                s += 2;
+            } else {
+                s++;
+            }
+        } else if (s[0] == '/' && s[1] == '*') {
+            *in_block = true;
+            s += 2;
+        } else if (s[0] == ';' || (s[0] == '/' && s[1] == '/')) {
+            break;
+        } else {
+            *out++ = *s++;
+        }
+    }
+    *out = '\0';
+}
+
+static bool parse_number(const char *s, unsigned int *val) {
+    char *end;
+    unsigned long v = strtoul(s, &end, 0);
+
+    if (*s == '\0' || *end != '\0')
+        return false;
+    *val = v;
+    return true;
+}
+
+static int parse_reg(const char *s) {
+    static const char *const names[] = {
+        [REG_PINS] = "pins", [REG_X] = "x", [REG_Y] = "y", [REG_NULL] = "null",
+        [REG_PINDIRS] = "pindirs", [REG_PC] = "pc", [REG_ISR] = "isr",
+        [REG_OSR] = "osr", [REG_STATUS] = "status",
+    };
+    unsigned int i;
+
+    for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(s, names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static int find_label(const struct label *labels, unsigned int n, const char *name) {
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        if (strcmp(labels[i].name, name) == 0)
+            return labels[i].index;
+    }
+    return -1;
+}
+
+static unsigned int tokenize(char *s, char **tok) {
+    unsigned int n = 0;
+    char *t;
+
+    for (t = strtok(s, " \t,"); t && n < MAX_TOKENS; t = strtok(NULL, " \t,"))
+        tok[n++] = t;
+    return n;
+}
+
+static bool assemble(struct pio_sim_insn *insn, char *text, unsigned int line,
+                     const struct label *labels, unsigned int nlabels) {
+    static const char *const conds[] = {
+        [COND_X_ZERO] = "!x", [COND_X_DEC] = "x--", [COND_Y_ZERO] = "!y",
+        [COND_Y_DEC] = "y--", [COND_X_NE_Y] = "x!=y", [COND_PIN] = "pin",
+        [COND_OSR_NOT_EMPTY] = "!osre",
+    };
+    char copy[MAX_LINE];
+    char *tok[MAX_TOKENS], *p;
+    unsigned int n, i, val;
+    int reg, target;
+
+    snprintf(copy, sizeof(copy), "%s", text);
+    memset(insn, 0, sizeof(*insn));
+    insn->side = -1;
+
+    // [delay] and side <value> trail the operands
+    p = strchr(copy, '[');
+    if (p) {
+        *p = '\0';
+        if (!parse_number(trim(strtok(p + 1, "]")), &val) || val > 31)
+            return parse_error(line, "bad delay", text);
+        insn->delay = val;
+    }
+    for (p = strstr(copy, " side"); p && !isspace((unsigned char)p[5]); p = strstr(p + 1, " side"))
+        ;
+    if (p) {
+        *p = '\0';
+        if (!parse_number(trim(p + 5), &val) || val > 1)
+            return parse_error(line, "bad side-set", text);
+        insn->side = val;
+    }
+
+    n = tokenize(copy, tok);
+    if (n == 0)
+        return parse_error(line, "empty instruction", text);
+
+    if (strcmp(tok[0], "jmp") == 0) {
+        insn->op = PIO_SIM_JMP;
+        insn->cond = COND_ALWAYS;
+        if (n == 3) {
+            for (i = 1; i < sizeof(conds) / sizeof(conds[0]); i++) {
+                if (strcmp(tok[1], conds[i]) == 0)
+                    insn->cond = i;
+            }
+            if (insn->cond == COND_ALWAYS)
+                return parse_error(line, "bad jmp condition", text);
+        } else if (n != 2) {
+            return parse_error(line, "bad jmp", text);
+        }
+        target = find_label(labels, nlabels, tok[n - 1]);
+        if (target < 0)
+            return parse_error(line, "unknown label", text);
+        insn->target = target;
+    } else if (strcmp(tok[0], "wait") == 0) {
+        insn->op = PIO_SIM_WAIT;
+        if (n != 4 || (strcmp(tok[2], "pin") != 0 && strcmp(tok[2], "gpio") != 0) ||
+            !parse_number(tok[1], &val) || val > 1)
+            return parse_error(line, "unsupported wait", text);
+        insn->cond = val;
+        if (!parse_number(tok[3], &val) || val > 31)
+            return parse_error(line, "bad wait pin", text);
+        insn->count = val;
+    } else if (strcmp(tok[0], "in") == 0 || strcmp(tok[0], "out") == 0) {
+        insn->op = tok[0][0] == 'i' ? PIO_SIM_IN : PIO_SIM_OUT;
+        reg = n == 3 ? parse_reg(tok[1]) : -1;
+        if (reg < 0 || !parse_number(tok[2], &val) || val == 0 || val > 32)
+            return parse_error(line, "bad shift", text);
+        insn->src = insn->dst = reg;
+        insn->count = val;
+    } else if (strcmp(tok[0], "push") == 0 || strcmp(tok[0], "pull") == 0) {
+        insn->op = strcmp(tok[0], "push") == 0 ? PIO_SIM_PUSH : PIO_SIM_PULL;
+        insn->block = true;
+        for (i = 1; i < n; i++) {
+            if (strcmp(tok[i], "noblock") == 0)
+                insn->block = false;
+            else if (strcmp(tok[i], "block") != 0 && strcmp(tok[i], "iffull") != 0 &&
+                     strcmp(tok[i], "ifempty") != 0)
+                return parse_error(line, "bad push/pull", text);
+        }
+    } else if (strcmp(tok[0], "mov") == 0) {
+        insn->op = PIO_SIM_MOV;
+        if (n == 4) {
+            // Operator written apart from the source
+            if (strcmp(tok[2], "~") == 0 || strcmp(tok[2], "!") == 0)
+                insn->mov_op = MOV_INVERT;
+            else if (strcmp(tok[2], "::") == 0)
+                insn->mov_op = MOV_REVERSE;
+            else
+                return parse_error(line, "bad mov", text);
+            tok[2] = tok[3];
+        } else if (n != 3) {
+            return parse_error(line, "bad mov", text);
+        } else if (tok[2][0] == '~' || tok[2][0] == '!') {
+            insn->mov_op = MOV_INVERT;
+            tok[2]++;
+        } else if (strncmp(tok[2], "::", 2) == 0) {
+            insn->mov_op = MOV_REVERSE;
+            tok[2] += 2;
+        }
+        reg = parse_reg(tok[1]);
+        if (reg < 0)
+            return parse_error(line, "bad mov destination", text);
+        insn->dst = reg;
+        reg = parse_reg(tok[2]);
+        if (reg < 0)
+            return parse_error(line, "bad mov source", text);
+        insn->src = reg;
+    } else if (strcmp(tok[0], "set") == 0) {
+        insn->op = PIO_SIM_SET;
+        reg = n == 3 ? parse_reg(tok[1]) : -1;
+        if (reg < 0 || !parse_number(tok[2], &val) || val > 31)
+            return parse_error(line, "bad set", text);
+        insn->dst = reg;
+        insn->count = val;
+    } else {
+        return parse_error(line, "unsupported instruction", text);
+    }
+    return true;
+}
+
+bool pio_sim_load(struct pio_sim *sm, const char *path, const char *name) {
+    static struct source_insn src[PIO_SIM_MAX_INSNS];
+    struct label labels[MAX_LABELS];
+    unsigned int nlabels = 0, nsrc = 0, line = 0, i;
+    bool in_block = false, in_code = false, found = false, wrap_set = false;
+    char buf[MAX_LINE], *s, *colon;
+    FILE *f;
+
+    sim_path = path;
+    f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+
+    memset(sm, 0, sizeof(*sm));
+    while (fgets(buf, sizeof(buf), f)) {
+        line++;
+        // Skip the % c-sdk { ... %} blocks
+        if (in_code) {
+            if (strncmp(buf, "%}", 2) == 0)
+                in_code = false;
+            continue;
+        }
+        if (buf[0] == '%') {
+            in_code = true;
+            continue;
+        }
+        strip_comments(buf, &in_block);
+        s = trim(buf);
+        if (*s == '\0')
+            continue;
+
+        if (strncmp(s, ".program", 8) == 0) {
+            if (found)
+                break;
+            found = strcmp(trim(s + 8), name) == 0;
+            continue;
+        }
+        if (!found)
+            continue;
+
+        if (strcmp(s, ".wrap_target") == 0) {
+            sm->wrap_target = nsrc;
+        } else if (strcmp(s, ".wrap") == 0) {
+            sm->wrap = nsrc - 1;
+            wrap_set = true;
+        } else if (*s == '.') {
+            // .side_set is taken from the instructions themselves
+            continue;
+        } else {
+            colon = strchr(s, ':');
+            if (colon && colon[1] != ':') {
+                *colon = '\0';
+                if (nlabels == MAX_LABELS) {
+                    fclose(f);
+                    return parse_error(line, "too many labels", s);
+                }
+                snprintf(labels[nlabels].name, sizeof(labels[nlabels].name), "%s", trim(s));
+                labels[nlabels++].index = nsrc;
+                s = trim(colon + 1);
+                if (*s == '\0')
+                    continue;
+            }
+            if (nsrc == PIO_SIM_MAX_INSNS) {
+                fclose(f);
+                return parse_error(line, "program too long", s);
+            }
+            snprintf(src[nsrc].text, sizeof(src[nsrc].text), "%s", s);
+            src[nsrc++].line = line;
+        }
+    }
+    fclose(f);
+
+    if (!found || nsrc == 0) {
+        fprintf(stderr, "%s: no program %s\n", path, name);
+        return false;
+    }
+    for (i = 0; i < nsrc; i++) {
+        if (!assemble(&sm->insn[i], src[i].text, src[i].line, labels, nlabels))
+            return false;
+    }
+    sm->len = nsrc;
+    if (!wrap_set)
+        sm->wrap = nsrc - 1;
+    sm->push_thresh = 32;
+    sm->clkdiv_int = 1;
+    return true;
+}
+
+static uint32_t sim_input(struct pio_sim *sm) {
+    return sm->input ? sm->input(sm->ctx, sm->cycle) : 0;
+}
+
+static void sim_output(struct pio_sim *sm, uint32_t val) {
+    int level = val & 1;
+
+    if (level != sm->out_level) {
+        sm->out_level = level;
+        if (sm->output)
+            sm->output(sm->ctx, sm->cycle, level);
+    }
+}
+
+static uint32_t sim_read(struct pio_sim *sm, unsigned int reg) {
+    switch (reg) {
+    case REG_PINS:
+        return sim_input(sm);
+    case REG_X:
+        return sm->x;
+    case REG_Y:
+        return sm->y;
+    case REG_ISR:
+        return sm->isr;
+    case REG_OSR:
+        return sm->osr;
+    default:
+        return 0;
+    }
+}
+
+static void sim_write(struct pio_sim *sm, unsigned int reg, uint32_t val, unsigned int *pc) {
+    switch (reg) {
+    case REG_PINS:
+        sim_output(sm, val);
+        break;
+    case REG_X:
+        sm->x = val;
+        break;
+    case REG_Y:
+        sm->y = val;
+        break;
+    case REG_ISR:
+        sm->isr = val;
+        sm->isr_count = 0;
+        break;
+    case REG_OSR:
+        sm->osr = val;
+        sm->osr_count = 0;
+        break;
+    case REG_PC:
+        *pc = val % sm->len;
+        break;
+    default:
+        break;
+    }
+}
+
+static uint32_t bit_reverse(uint32_t v) {
+    uint32_t r = 0;
+    int i;
+
+    for (i = 0; i < 32; i++) {
+        r = (r << 1) | (v & 1);
+        v >>= 1;
+    }
+    return r;
+}
+
+static bool sim_push(struct pio_sim *sm) {
+    if (sm->rx_count == PIO_SIM_FIFO_SIZE)
+        return false;
+    sm->rx[sm->rx_count++] = sm->isr;
+    sm->isr = 0;
+    sm->isr_count = 0;
+    return true;
+}
+
+// On to the system clock of the next SM clock
+static void sim_clock(struct pio_sim *sm) {
+    sm->cycle += sm->clkdiv_int;
+    sm->clkdiv_acc += sm->clkdiv_frac;
+    if (sm->clkdiv_acc >= 256) {
+        sm->clkdiv_acc -= 256;
+        sm->cycle++;
+    }
+}
+
+void pio_sim_step(struct pio_sim *sm) {
+    const struct pio_sim_insn *in;
+    unsigned int pc, n = 0;
+    uint32_t v = 0, mask;
+    bool take = true;
+
+    if (sm->delay) {
+        sm->delay--;
+        sim_clock(sm);
+        return;
+    }
+
+    in = &sm->insn[sm->pc];
+    // Side-set is asserted even while the instruction stalls
+    if (in->side >= 0)
+        sim_output(sm, in->side);
+    pc = sm->pc == sm->wrap ? sm->wrap_target : sm->pc + 1;
+    sm->stalled = false;
+    if (in->op == PIO_SIM_IN || in->op == PIO_SIM_OUT)
+        n = in->count;
+    mask = n == 32 ? 0xFFFFFFFFu : (1u << n) - 1;
+
+    switch (in->op) {
+    case PIO_SIM_JMP:
+        switch (in->cond) {
+        case COND_X_ZERO:
+            take = sm->x == 0;
+            break;
+        case COND_X_DEC:
+            take = sm->x-- != 0;
+            break;
+        case COND_Y_ZERO:
+            take = sm->y == 0;
+            break;
+        case COND_Y_DEC:
+            take = sm->y-- != 0;
+            break;
+        case COND_X_NE_Y:
+            take = sm->x != sm->y;
+            break;
+        case COND_PIN:
+            take = (sim_input(sm) >> sm->jmp_pin) & 1;
+            break;
+        case COND_OSR_NOT_EMPTY:
+            take = sm->osr_count < 32;
+            break;
+        }
+        if (take)
+            pc = in->target;
+        break;
+    case PIO_SIM_WAIT:
+        sm->stalled = ((sim_input(sm) >> in->count) & 1) != in->cond;
+        break;
+    case PIO_SIM_IN:
+        v = sim_read(sm, in->src) & mask;
+        if (n == 32)
+            sm->isr = v;
+        else if (sm->in_shift_right)
+            sm->isr = (sm->isr >> n) | (v << (32 - n));
+        else
+            sm->isr = (sm->isr << n) | v;
+        sm->isr_count += n;
+        if (sm->isr_count > 32)
+            sm->isr_count = 32;
+        if (sm->autopush && sm->isr_count >= sm->push_thresh)
+            sim_push(sm);
+        break;
+    case PIO_SIM_OUT:
+        if (sm->out_shift_right) {
+            v = sm->osr & mask;
+            sm->osr = n == 32 ? 0 : sm->osr >> n;
+        } else {
+            v = n == 32 ? sm->osr : sm->osr >> (32 - n);
+            sm->osr = n == 32 ? 0 : sm->osr << n;
+        }
+        sm->osr_count += n;
+        if (sm->osr_count > 32)
+            sm->osr_count = 32;
+        sim_write(sm, in->dst, v, &pc);
+        break;
+    case PIO_SIM_PUSH:
+        if (!sim_push(sm) && in->block)
+            sm->stalled = true;
+        break;
+    case PIO_SIM_PULL:
+        if (pio_sim_tx_empty(sm)) {
+            if (in->block)
+                sm->stalled = true;
+            else
+                sm->osr = sm->x;
+        } else {
+            sm->osr = sm->tx[sm->tx_head];
+            sm->tx_head = (sm->tx_head + 1) % PIO_SIM_FIFO_SIZE;
+        }
+        if (!sm->stalled)
+            sm->osr_count = 0;
+        break;
+    case PIO_SIM_MOV:
+        v = sim_read(sm, in->src);
+        if (in->mov_op == MOV_INVERT)
+            v = ~v;
+        else if (in->mov_op == MOV_REVERSE)
+            v = bit_reverse(v);
+        sim_write(sm, in->dst, v, &pc);
+        break;
+    case PIO_SIM_SET:
+        sim_write(sm, in->dst, in->count, &pc);
+        break;
+    }
+
+    if (!sm->stalled) {
+        sm->pc = pc;
+        sm->delay = in->delay;
+    }
+    sim_clock(sm);
+}
+
+void pio_sim_run_until(struct pio_sim *sm, uint64_t cycle) {
+    while (sm->cycle < cycle)
+        pio_sim_step(sm);
+}
+
+bool pio_sim_tx_put(struct pio_sim *sm, uint32_t word) {
+    size_t next = (sm->tx_tail + 1) % PIO_SIM_FIFO_SIZE;
+
+    if (next == sm->tx_head)
+        return false;
+    sm->tx[sm->tx_tail] = word;
+    sm->tx_tail = next;
+    return true;
+}
@@ -0,0 +1,127 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef PIO_SIM_H_
+#define PIO_SIM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Cycle model of a single PIO state machine for host tests. The program is
+ * assembled straight from the .pio source, so the tests exercise exactly
+ * what pioasm builds into the firmware. Only what the probe's programs use
+ * is modelled: one SM, pins relative to the IN/OUT bases, FIFO stalls, delays,
+ * optional side-set and wrap. Time is counted in system clocks, and the
+ * SM runs on those its clock divider lets through: int + frac / 256 on
+ * average, each SM clock int or int + 1 system clocks after the last, as
+ * the RP2040's fractional divider spaces them. The divider is 1 after
+ * loading, which makes the two the same.
+ */
+
+#define PIO_SIM_MAX_INSNS   32
+#define PIO_SIM_FIFO_SIZE   4096
+
+enum pio_sim_op {
+    PIO_SIM_JMP,
+    PIO_SIM_WAIT,
+    PIO_SIM_IN,
+    PIO_SIM_OUT,
+    PIO_SIM_PUSH,
+    PIO_SIM_PULL,
+    PIO_SIM_MOV,
+    PIO_SIM_SET,
+};
+
+struct pio_sim_insn {
+    enum pio_sim_op op;
+    uint8_t cond;       // JMP condition, or WAIT polarity
+    uint8_t src;        // IN/MOV source
+    uint8_t dst;        // OUT/MOV/SET destination
+    uint8_t mov_op;     // MOV invert/reverse
+    uint8_t count;      // IN/OUT bit count, WAIT pin index, SET value
+    uint8_t target;     // JMP target
+    bool block;         // PUSH/PULL
+    uint8_t delay;
+    int8_t side;        // side-set value, -1 when absent
+};
+
+struct pio_sim {
+    struct pio_sim_insn insn[PIO_SIM_MAX_INSNS];
+    unsigned int len;
+    unsigned int wrap_target;
+    unsigned int wrap;
+
+    // Configuration, set by the test after loading
+    bool in_shift_right;
+    bool autopush;
+    unsigned int push_thresh;
+    bool out_shift_right;
+    unsigned int jmp_pin;
+    // Clock divider, as pio_sm_set_clkdiv_int_frac() takes it
+    uint16_t clkdiv_int;
+    uint8_t clkdiv_frac;
+    // Pin levels seen by the SM at a given cycle, bit 0 is the IN base
+    uint32_t (*input)(void *ctx, uint64_t cycle);
+    // Called whenever the single OUT / side-set pin is written
+    void (*output)(void *ctx, uint64_t cycle, int level);
+    void *ctx;
+
+    // Execution state
+    unsigned int pc;
+    uint32_t x, y, isr, osr;
+    unsigned int isr_count, osr_count;
+    unsigned int delay;
+    // System clock of the next SM clock, and the divider's fraction so far
+    uint64_t cycle;
+    unsigned int clkdiv_acc;
+    bool stalled;
+    // Level of the OUT / side-set pin, the test sets where it idles
+    int out_level;
+
+    uint32_t rx[PIO_SIM_FIFO_SIZE];
+    size_t rx_count;
+    uint32_t tx[PIO_SIM_FIFO_SIZE];
+    size_t tx_head, tx_tail;
+};
+
+// Assemble `.program name` from a .pio file and reset the SM, false on error
+bool pio_sim_load(struct pio_sim *sm, const char *path, const char *name);
+
+// Run for one SM clock
+void pio_sim_step(struct pio_sim *sm);
+
+// Run the SM clocks before the given system clock
+void pio_sim_run_until(struct pio_sim *sm, uint64_t cycle);
+
+bool pio_sim_tx_put(struct pio_sim *sm, uint32_t word);
+
+static inline bool pio_sim_tx_empty(const struct pio_sim *sm) {
+    return sm->tx_head == sm->tx_tail;
+}
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/* The parts of CMSIS-DAP's DAP.h the tested sources use */
+
+#ifndef DAP_H_
+#define DAP_H_
+
+#include <stdint.h>
+
+#include "DAP_config.h"
+
+#define DAP_OK      0U
+#define DAP_ERROR   0xFFU
+
+// DAP Transfer Request
+#define DAP_TRANSFER_APnDP      (1U << 0)
+#define DAP_TRANSFER_RnW        (1U << 1)
+#define DAP_TRANSFER_A2         (1U << 2)
+#define DAP_TRANSFER_A3         (1U << 3)
+#define DAP_TRANSFER_TIMESTAMP  (1U << 7)
+
+// DAP Transfer Response
+#define DAP_TRANSFER_OK         (1U << 0)
+#define DAP_TRANSFER_WAIT       (1U << 1)
+#define DAP_TRANSFER_FAULT      (1U << 2)
+#define DAP_TRANSFER_ERROR      (1U << 3)
+
+// DAP SWD Sequence Info
+#define SWD_SEQUENCE_CLK        0x3FU
+#define SWD_SEQUENCE_DIN        (1U << 7)
+
+// Debug Port Register Addresses
+#define DP_SELECT               0x08U
+
+typedef struct {
+    uint8_t debug_port;
+    uint8_t fast_clock;
+    uint8_t padding[2];
+    uint32_t clock_delay;
+    uint32_t timestamp;
+    uint32_t nominal_clock;
+    struct {
+        uint8_t idle_cycles;
+        uint8_t padding[3];
+        uint16_t retry_count;
+        uint16_t match_retry;
+        uint32_t match_mask;
+    } transfer;
+    struct {
+        uint8_t turnaround;
+        uint8_t data_phase;
+    } swd_conf;
+} DAP_Data_t;
+
+extern DAP_Data_t DAP_Data;
+
+#endif
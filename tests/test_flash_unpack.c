@@ -0,0 +1,296 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * heatshrink round trips through flash_unpack.c. A reference encoder in
+ * the test compresses images of different kinds with greedy longest
+ * matches, reaching back into heatshrink's zeroed history and overlapping
+ * the bytes being produced, and with index and count both stored minus one
+ * so the largest window offset and run are hit. The stream is fed through
+ * the vendor command in packets of assorted sizes and must come out of
+ * flash_exec_write() byte for byte.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dap_vendor.h"
+#include "flash_exec.h"
+#include "flash_unpack.h"
+#include "test.h"
+#include "wave.h"
+
+#define IMAGE_MAX   (64 * 1024)
+
+// What reached the flash executor
+static uint8_t flashed[IMAGE_MAX + 256];
+static uint32_t flashed_len;
+static bool exec_ready = true;
+static uint32_t exec_fail_after = UINT32_MAX;
+
+bool flash_exec_ready(void) {
+    return exec_ready;
+}
+
+bool flash_exec_write(const uint8_t *data, uint32_t len) {
+    if (flashed_len + len > exec_fail_after)
+        return false;
+    if (flashed_len + len <= sizeof(flashed))
+        memcpy(&flashed[flashed_len], data, len);
+    flashed_len += len;
+    return true;
+}
+
+struct bit_writer {
+    uint8_t *buf;
+    uint32_t len;
+    uint8_t bits;
+};
+
+static void put_bits(struct bit_writer *w, uint32_t val, uint8_t n) {
+    while (n--) {
+        if (w->bits == 0)
+            w->buf[w->len++] = 0;
+        w->buf[w->len - 1] |= ((val >> n) & 1) << (7 - w->bits);
+        w->bits = (w->bits + 1) & 7;
+    }
+}
+
+// Byte at position i of the input, with heatshrink's zeroed history before it
+static uint8_t history(const uint8_t *in, long i) {
+    return i < 0 ? 0 : in[i];
+}
+
+// Greedy heatshrink encoder, returns the compressed length
+static uint32_t encode(const uint8_t *in, uint32_t len, uint8_t *out,
+                       uint8_t window_bits, uint8_t lookahead_bits, uint32_t *refs) {
+    struct bit_writer w = { out, 0, 0 };
+    uint32_t window = 1u << window_bits, lookahead = 1u << lookahead_bits;
+    uint32_t pos = 0, off, best_off, best_len, n;
+
+    *refs = 0;
+    while (pos < len) {
+        best_len = 0;
+        best_off = 0;
+        for (off = 1; off <= window; off++) {
+            // Matches may overlap the bytes they produce
+            for (n = 0; n < lookahead && pos + n < len; n++) {
+                if (history(in, (long)pos + n - off) != in[pos + n])
+                    break;
+            }
+            if (n > best_len) {
+                best_len = n;
+                best_off = off;
+            }
+        }
+        if (best_len >= 2) {
+            put_bits(&w, 0, 1);
+            put_bits(&w, best_off - 1, window_bits);
+            put_bits(&w, best_len - 1, lookahead_bits);
+            pos += best_len;
+            (*refs)++;
+        } else {
+            put_bits(&w, 1, 1);
+            put_bits(&w, in[pos], 8);
+            pos++;
+        }
+    }
+    return w.len;
+}
+
+static bool unpack_start(uint8_t window_bits, uint8_t lookahead_bits) {
+    uint8_t req[3] = { FLASH_UNPACK_START, window_bits, lookahead_bits }, resp[64];
+
+    CHECK_EQ(flash_unpack_command(req, resp), 3u << 16 | 1);
+    return resp[0] == DAP_OK;
+}
+
+// Send the stream in packets of random size, false if a packet was refused
+static bool unpack_feed(const uint8_t *data, uint32_t len, uint32_t *seed) {
+    uint8_t req[DAP_PACKET_SIZE], resp[64];
+    uint32_t n;
+
+    while (len) {
+        n = 1 + wave_rand(seed) % (DAP_PACKET_SIZE - 3);
+        if (n > len)
+            n = len;
+        req[0] = FLASH_UNPACK_DATA;
+        req[1] = n;
+        memcpy(&req[2], data, n);
+        CHECK_EQ(flash_unpack_command(req, resp), (2 + n) << 16 | 1);
+        if (resp[0] != DAP_OK)
+            return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static void unpack_status(uint32_t *in, uint32_t *out) {
+    uint8_t req[1] = { FLASH_UNPACK_STATUS }, resp[64];
+
+    flash_unpack_command(req, resp);
+    *in = get_u32(&resp[3]);
+    *out = get_u32(&resp[7]);
+}
+
+enum image_kind {
+    IMAGE_FIRMWARE,
+    IMAGE_RANDOM,
+    IMAGE_RUN,
+    IMAGE_PERIODIC,
+};
+
+static uint32_t make_image(uint8_t *img, enum image_kind kind, uint8_t window_bits, uint32_t *seed) {
+    uint32_t len = 0, i;
+
+    switch (kind) {
+    case IMAGE_FIRMWARE:
+        // Vector table, code-ish bytes, repeated tables, strings and erased padding
+        len = 20000 + wave_rand(seed) % 1000;
+        for (i = 0; i < 256; i += 4)
+            put_u32(&img[i], 0x10000100u + (i ? 0x200 + i * 8 : 0) + 1);
+        for (i = 256; i < 8192; i++)
+            img[i] = (wave_rand(seed) % 4) ? (uint8_t)wave_rand(seed) : img[i - 1 - wave_rand(seed) % 64];
+        for (i = 8192; i < 12288; i++)
+            img[i] = img[8192 + (i % 300)] = (uint8_t)(i * 7);
+        for (i = 12288; i < 14000; i++)
+            img[i] = "debugprobe flash_unpack round trip "[i % 35];
+        memset(&img[14000], 0xFF, len - 14000);
+        img[len - 1] = 0x5A;
+        break;
+    case IMAGE_RANDOM:
+        len = 5000;
+        for (i = 0; i < len; i++)
+            img[i] = wave_rand(seed);
+        break;
+    case IMAGE_RUN:
+        // Starts with zeros that can come straight from the history
+        len = 3000;
+        memset(img, 0, 1000);
+        memset(&img[1000], 0xAB, len - 1000);
+        break;
+    case IMAGE_PERIODIC:
+        // Noise repeating at exactly the largest offset the window reaches
+        len = 3 << window_bits;
+        for (i = 0; i < len; i++)
+            img[i] = i < (1u << window_bits) ? (uint8_t)wave_rand(seed) : img[i - (1u << window_bits)];
+        break;
+    }
+    return len;
+}
+
+static void round_trip(enum image_kind kind, uint8_t window_bits, uint8_t lookahead_bits) {
+    static uint8_t img[IMAGE_MAX], packed[IMAGE_MAX * 9 / 8 + 16];
+    uint32_t seed = 0x5EED0035 + kind * 131 + window_bits * 17 + lookahead_bits;
+    uint32_t len, plen, refs, in, out, i;
+
+    len = make_image(img, kind, window_bits, &seed);
+    plen = encode(img, len, packed, window_bits, lookahead_bits, &refs);
+
+    flashed_len = 0;
+    CHECK(unpack_start(window_bits, lookahead_bits));
+    CHECK(unpack_feed(packed, plen, &seed));
+    unpack_status(&in, &out);
+    CHECK_EQ(in, plen);
+    CHECK_EQ(out, len);
+    CHECK_EQ(flashed_len, len);
+    for (i = 0; i < len && i < flashed_len; i++) {
+        if (flashed[i] != img[i]) {
+            printf("image %d, window %u lookahead %u: first difference at %u\n",
+                   kind, window_bits, lookahead_bits, i);
+            CHECK_EQ(flashed[i], img[i]);
+            break;
+        }
+    }
+    if (kind != IMAGE_RANDOM)
+        CHECK(refs > 0);
+}
+
+// Hand-assembled stream, independent of the reference encoder
+static void test_known_stream(void) {
+    // window 8, lookahead 4: literals 'a' 'b' 'c', then offset 3 count 6
+    // 1 01100001 1 01100010 1 01100011 0 00000010 0101
+    static const uint8_t packed[] = { 0xB0, 0xD8, 0xAC, 0x60, 0x25 };
+    static const char expect[] = "abcabcabc";
+    uint32_t seed = 1;
+
+    flashed_len = 0;
+    CHECK(unpack_start(8, 4));
+    CHECK(unpack_feed(packed, sizeof(packed), &seed));
+    CHECK_EQ(flashed_len, 9);
+    CHECK(memcmp(flashed, expect, 9) == 0);
+}
+
+static void test_round_trips(void) {
+    static const uint8_t params[][2] = {
+        { 4, 3 }, { 8, 4 }, { 10, 4 }, { 11, 8 }, { FLASH_UNPACK_MAX_WINDOW, 4 },
+    };
+    unsigned int i;
+    int kind;
+
+    for (kind = IMAGE_FIRMWARE; kind <= IMAGE_PERIODIC; kind++) {
+        for (i = 0; i < sizeof(params) / sizeof(params[0]); i++)
+            round_trip(kind, params[i][0], params[i][1]);
+    }
+}
+
+static void test_start_checks(void) {
+    CHECK(!unpack_start(3, 2));
+    CHECK(!unpack_start(FLASH_UNPACK_MAX_WINDOW + 1, 4));
+    CHECK(!unpack_start(8, 2));
+    CHECK(!unpack_start(8, 8));
+    exec_ready = false;
+    CHECK(!unpack_start(8, 4));
+    exec_ready = true;
+}
+
+static void test_exec_failure(void) {
+    // Literal 'A': 1 01000001
+    static const uint8_t literal[] = { 0xA0, 0x80 };
+    uint8_t packed[1024];
+    uint32_t seed = 2, refs, plen;
+    uint8_t img[1024];
+
+    // The executor refusing data fails the packet and every later one
+    memset(img, 0x41, sizeof(img));
+    plen = encode(img, sizeof(img), packed, 8, 4, &refs);
+    flashed_len = 0;
+    exec_fail_after = 100;
+    CHECK(unpack_start(8, 4));
+    CHECK(!unpack_feed(packed, plen, &seed));
+    CHECK(!unpack_feed(literal, sizeof(literal), &seed));
+    exec_fail_after = UINT32_MAX;
+}
+
+int main(void) {
+    test_known_stream();
+    test_round_trips();
+    test_start_checks();
+    test_exec_failure();
+    TEST_EXIT();
+}
@@ -0,0 +1,315 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * The ITM/DWT packet decoder in itm.c, fed through a fake SWO trace buffer
+ * and read back through its vendor command like the host would: sync
+ * detection, stimulus packets of every size and their port filtering,
+ * local and global timestamps, extension and overflow packets, malformed
+ * packets, and resynchronisation when the trace buffer lost data under
+ * the decoder.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "dap_vendor.h"
+#include "itm.h"
+#include "swo_pio.h"
+#include "test.h"
+#include "tusb.h"
+#include "tusb_stream.h"
+
+// Fake SWO trace buffer, bytes before trace_tail have been overwritten
+static uint8_t trace[4096];
+static uint32_t trace_head, trace_tail;
+
+uint32_t SWO_TraceHead(void) {
+    return trace_head;
+}
+
+uint32_t SWO_TraceRead(uint32_t *index, uint8_t *buf, uint32_t num, uint32_t *lost) {
+    uint32_t n;
+
+    if (*index < trace_tail) {
+        *lost += trace_tail - *index;
+        *index = trace_tail;
+    }
+    n = trace_head - *index;
+    if (n > num)
+        n = num;
+    memcpy(buf, &trace[*index], n);
+    *index += n;
+    return n;
+}
+
+bool tud_cdc_n_connected(uint8_t itf) {
+    return false;
+}
+
+void tud_cdc_n_read_flush(uint8_t itf) {
+}
+
+uint32_t tud_cdc_n_write(uint8_t itf, const void *buffer, uint32_t bufsize) {
+    return 0;
+}
+
+uint32_t tud_cdc_n_write_flush(uint8_t itf) {
+    return 0;
+}
+
+bool stream_attach(struct ringbuf *source) {
+    return false;
+}
+
+void stream_detach(struct ringbuf *source) {
+}
+
+static void feed(const uint8_t *data, uint32_t len) {
+    memcpy(&trace[trace_head], data, len);
+    trace_head += len;
+    itm_task();
+}
+
+#define FEED(...) do { \
+        static const uint8_t bytes_[] = { __VA_ARGS__ }; \
+        feed(bytes_, sizeof(bytes_)); \
+    } while (0)
+
+// Overwrite everything the decoder has not read yet
+static void lose(uint32_t len) {
+    memset(&trace[trace_head], 0xA5, len);
+    trace_head += len;
+    trace_tail = trace_head;
+}
+
+static void itm_config(bool enable, uint32_t port_mask) {
+    uint8_t req[6] = { ITM_CONFIG, enable }, resp[64];
+
+    put_u32(&req[2], port_mask);
+    CHECK_EQ(itm_command(req, resp), (6u << 16) | 1);
+    CHECK_EQ(resp[0], DAP_OK);
+    // The decoder picks the new configuration up on its next run
+    trace_head = trace_tail = 0;
+    itm_task();
+}
+
+// Read everything queued on a port, return its length
+static int itm_read(uint8_t port, uint8_t *out) {
+    uint8_t req[3] = { ITM_READ, port, 255 }, resp[64];
+    int len = 0;
+
+    do {
+        itm_command(req, resp);
+        CHECK_EQ(resp[0], DAP_OK);
+        memcpy(&out[len], &resp[2], resp[1]);
+        len += resp[1];
+    } while (resp[1]);
+    return len;
+}
+
+#define CHECK_READ(port, ...) do { \
+        static const uint8_t expect_[] = { __VA_ARGS__ }; \
+        uint8_t got_[512]; \
+        int len_ = itm_read(port, got_); \
+        CHECK_EQ(len_, sizeof(expect_)); \
+        CHECK(len_ != sizeof(expect_) || memcmp(got_, expect_, len_) == 0); \
+    } while (0)
+
+#define CHECK_EMPTY(port) do { \
+        uint8_t got_[512]; \
+        CHECK_EQ(itm_read(port, got_), 0); \
+    } while (0)
+
+struct itm_status {
+    uint32_t sync, overflow, error, lost, event_dropped;
+    uint32_t dropped[ITM_PORT_COUNT];
+};
+
+static struct itm_status itm_status(void) {
+    uint8_t req[1] = { ITM_STATUS }, resp[64];
+    struct itm_status s;
+    int i;
+
+    itm_command(req, resp);
+    s.sync = get_u32(&resp[6]);
+    s.overflow = get_u32(&resp[10]);
+    s.error = get_u32(&resp[14]);
+    s.lost = get_u32(&resp[18]);
+    s.event_dropped = get_u32(&resp[22]);
+    for (i = 0; i < ITM_PORT_COUNT; i++)
+        s.dropped[i] = get_u32(&resp[26 + i * 4]);
+    return s;
+}
+
+static void test_sync(void) {
+    uint8_t zeros[260] = { 0 };
+    uint32_t n;
+
+    itm_config(true, 0xFF);
+    // 47 zero bits and a one, then a longer run
+    FEED(0x00, 0x00, 0x00, 0x00, 0x00, 0x80);
+    FEED(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80);
+    CHECK_EQ(itm_status().sync, 2);
+    CHECK_EQ(itm_status().error, 0);
+
+    // Too short for a sync, the 0x80 is then a bad header
+    FEED(0x00, 0x00, 0x00, 0x00, 0x80);
+    CHECK_EQ(itm_status().sync, 2);
+    CHECK_EQ(itm_status().error, 1);
+
+    // A sync split across two reads of the trace buffer
+    FEED(0x00, 0x00, 0x00);
+    FEED(0x00, 0x00, 0x80);
+    CHECK_EQ(itm_status().sync, 3);
+
+    // Runs of zeros long enough to wrap a byte counter
+    for (n = 256; n <= sizeof(zeros); n++) {
+        feed(zeros, n);
+        FEED(0x80);
+    }
+    CHECK_EQ(itm_status().sync, 8);
+    CHECK_EQ(itm_status().error, 1);
+
+    // Packets straight after a sync
+    FEED(0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x01, 'x');
+    CHECK_READ(0, 'x');
+    CHECK_EMPTY(ITM_EVENT_PORT);
+}
+
+static void test_stimulus(void) {
+    itm_config(true, (1u << 0) | (1u << 1) | (1u << 7));
+    // Port 0, 1 byte
+    FEED(0x01, 'a');
+    // Port 1, 2 bytes
+    FEED(0x0A, 'b', 'c');
+    // Port 7, 4 bytes
+    FEED(0x3B, 'd', 'e', 'f', 'g');
+    // Port 2 is masked off, port 31 has no ring
+    FEED(0x11, 'n', 0xFB, 'n', 'n', 'n', 'n');
+    // Payload bytes that look like headers, split over reads
+    FEED(0x03, 0x00, 0x80);
+    FEED(0x70, 0x01);
+    FEED(0x01, 'z');
+
+    CHECK_READ(0, 'a', 0x00, 0x80, 0x70, 0x01, 'z');
+    CHECK_READ(1, 'b', 'c');
+    CHECK_READ(7, 'd', 'e', 'f', 'g');
+    CHECK_EMPTY(2);
+    CHECK_EMPTY(ITM_EVENT_PORT);
+    CHECK_EQ(itm_status().error, 0);
+    CHECK_EQ(itm_status().overflow, 0);
+
+    // Hardware source packets go to the event ring verbatim
+    FEED(0x05, 0x21, 0x47, 0x10, 0x00, 0x00, 0x00);
+    CHECK_READ(ITM_EVENT_PORT, 0x05, 0x21, 0x47, 0x10, 0x00, 0x00, 0x00);
+}
+
+static void test_timestamps(void) {
+    itm_config(true, 0x01);
+    // Local timestamp format 1, two continuation bytes
+    FEED(0xC0, 0x81, 0x02);
+    // Local timestamp format 2, no payload
+    FEED(0x30);
+    // Global timestamp 1, four bytes, and global timestamp 2, six bytes
+    FEED(0x94, 0x81, 0x82, 0x83, 0x04);
+    FEED(0xB4, 0x81, 0x82, 0x83, 0x84, 0x85, 0x06);
+    // Short ones end at the first byte without a continuation bit
+    FEED(0xD0, 0x7F);
+    FEED(0x94, 0x01);
+    // Stimulus data in between stays apart
+    FEED(0x01, 'k');
+
+    CHECK_READ(ITM_EVENT_PORT,
+               0xC0, 0x81, 0x02,
+               0x30,
+               0x94, 0x81, 0x82, 0x83, 0x04,
+               0xB4, 0x81, 0x82, 0x83, 0x84, 0x85, 0x06,
+               0xD0, 0x7F,
+               0x94, 0x01);
+    CHECK_READ(0, 'k');
+    CHECK_EQ(itm_status().error, 0);
+
+    // Longer than any timestamp, dropped and counted
+    FEED(0x94, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x08);
+    CHECK_EQ(itm_status().error, 1);
+    CHECK_EMPTY(ITM_EVENT_PORT);
+}
+
+static void test_extension_overflow(void) {
+    itm_config(true, 0x01);
+    // Extension without and with continuation (stimulus port page)
+    FEED(0x08);
+    FEED(0x88, 0x81, 0x05);
+    // Overflow
+    FEED(0x70);
+    // Reserved header
+    FEED(0xF4);
+    FEED(0x01, 'q');
+
+    CHECK_READ(ITM_EVENT_PORT, 0x08, 0x88, 0x81, 0x05, 0x70);
+    CHECK_READ(0, 'q');
+    CHECK_EQ(itm_status().overflow, 1);
+    CHECK_EQ(itm_status().error, 1);
+}
+
+static void test_lost_resync(void) {
+    itm_config(true, 0x01);
+    // A 4-byte packet cut short by the trace buffer wrapping under the decoder
+    FEED(0x03, 'A', 'B');
+    lose(100);
+    // Would be taken as the rest of the payload if the decoder did not resync
+    FEED(0x01, 'Z', 0x01, 'Y');
+    CHECK_READ(0, 'Z', 'Y');
+    CHECK_EQ(itm_status().lost, 100);
+
+    // The same inside a timestamp
+    FEED(0xC0, 0x81);
+    lose(10);
+    FEED(0x30, 0x01, 'W');
+    CHECK_READ(ITM_EVENT_PORT, 0x30);
+    CHECK_READ(0, 'W');
+    CHECK_EQ(itm_status().lost, 110);
+    CHECK_EQ(itm_status().error, 0);
+}
+
+static void test_disabled(void) {
+    itm_config(false, 0xFF);
+    FEED(0x01, 'a', 0x70);
+    CHECK_EMPTY(0);
+    CHECK_EMPTY(ITM_EVENT_PORT);
+    CHECK_EQ(itm_status().overflow, 0);
+}
+
+int main(void) {
+    test_sync();
+    test_stimulus();
+    test_timestamps();
+    test_extension_overflow();
+    test_lost_resync();
+    test_disabled();
+    TEST_EXIT();
+}
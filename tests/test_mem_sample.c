@@ -0,0 +1,359 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * The live variable logger in mem_sample.c against a simulated target. The
+ * DAP job is run by hand, one call per sample period, and the records are
+ * taken off the ring the stream endpoint would drain: their layout, values
+ * of every width, the error flag, sequence numbering across overflows and
+ * 16-bit wraparound, and the vendor command's checks.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "dap_job.h"
+#include "dap_mem.h"
+#include "dap_vendor.h"
+#include "mem_sample.h"
+#include "ringbuf.h"
+#include "test.h"
+#include "tusb_stream.h"
+
+#define TARGET_BASE     0x20000000u
+#define TARGET_SIZE     256
+// Reads from here on fault
+#define TARGET_FAULT    0x30000000u
+
+#define PERIOD_US       1000
+
+static uint8_t target[TARGET_SIZE];
+static bool target_up = true;
+static uint32_t now_us = 12345;
+static dap_job_fn job;
+static struct ringbuf *stream;
+
+uint32_t time_us_32(void) {
+    return now_us;
+}
+
+bool dap_mem_acquire(uint8_t ap) {
+    return target_up;
+}
+
+bool dap_mem_read(uint32_t addr, uint8_t size, uint32_t *val) {
+    int i;
+
+    if (addr < TARGET_BASE || addr + size > TARGET_BASE + TARGET_SIZE)
+        return false;
+    *val = 0;
+    for (i = 0; i < size; i++)
+        *val |= (uint32_t)target[addr - TARGET_BASE + i] << (i * 8);
+    return true;
+}
+
+bool dap_job_start(dap_job_fn fn, uint32_t period_us) {
+    CHECK(period_us >= DAP_JOB_MIN_PERIOD_US);
+    job = fn;
+    return true;
+}
+
+void dap_job_stop(dap_job_fn fn) {
+    if (job == fn)
+        job = NULL;
+}
+
+bool stream_attach(struct ringbuf *source) {
+    if (stream && stream != source)
+        return false;
+    stream = source;
+    return true;
+}
+
+void stream_detach(struct ringbuf *source) {
+    if (stream == source)
+        stream = NULL;
+}
+
+static void config(uint32_t period) {
+    uint8_t req[6] = { MEM_SAMPLE_CONFIG, 0 }, resp[64];
+
+    put_u32(&req[2], period);
+    CHECK_EQ(mem_sample_command(req, resp), (6u << 16) | 5);
+    CHECK_EQ(resp[0], DAP_OK);
+}
+
+// Add one variable, return the record length or -1 when refused
+static int add(uint32_t addr, uint8_t size) {
+    uint8_t req[7] = { MEM_SAMPLE_ADD, 1 }, resp[64];
+
+    put_u32(&req[2], addr);
+    req[6] = size;
+    CHECK_EQ(mem_sample_command(req, resp), (7u << 16) | 3);
+    return resp[0] == DAP_OK ? resp[2] : -1;
+}
+
+static bool start(void) {
+    uint8_t req[1] = { MEM_SAMPLE_START }, resp[64];
+
+    mem_sample_command(req, resp);
+    return resp[0] == DAP_OK;
+}
+
+struct status {
+    bool running;
+    uint8_t count, record_len;
+    uint32_t period, records, overflow, errors;
+};
+
+static struct status status(void) {
+    uint8_t req[1] = { MEM_SAMPLE_STATUS }, resp[64];
+    struct status s;
+
+    mem_sample_command(req, resp);
+    s.running = resp[1];
+    s.count = resp[2];
+    s.record_len = resp[3];
+    s.period = get_u32(&resp[4]);
+    s.records = get_u32(&resp[8]);
+    s.overflow = get_u32(&resp[12]);
+    s.errors = get_u32(&resp[16]);
+    return s;
+}
+
+// One sample period
+static void tick(void) {
+    now_us += PERIOD_US;
+    CHECK(job != NULL);
+    if (job)
+        job();
+}
+
+static void put_target(uint32_t addr, uint32_t val, int size) {
+    int i;
+
+    for (i = 0; i < size; i++)
+        target[addr - TARGET_BASE + i] = val >> (i * 8);
+}
+
+struct record {
+    uint8_t sync, flags;
+    uint16_t seq;
+    uint32_t time;
+    uint8_t values[MEM_SAMPLE_MAX_VARS * 4];
+};
+
+static bool next_record(int len, struct record *r) {
+    uint8_t buf[MEM_SAMPLE_HDR_LEN + MEM_SAMPLE_MAX_VARS * 4];
+
+    if (!stream || ringbuf_elements(stream) < len)
+        return false;
+    ringbuf_gets(stream, (char *)buf, len);
+    r->sync = buf[0];
+    r->flags = buf[1];
+    r->seq = get_u16(&buf[2]);
+    r->time = get_u32(&buf[4]);
+    memcpy(r->values, &buf[MEM_SAMPLE_HDR_LEN], len - MEM_SAMPLE_HDR_LEN);
+    return true;
+}
+
+static void test_record_format(void) {
+    struct record r;
+    int len, i;
+
+    config(PERIOD_US);
+    CHECK_EQ(add(TARGET_BASE + 0x10, 4), MEM_SAMPLE_HDR_LEN + 4);
+    CHECK_EQ(add(TARGET_BASE + 0x22, 2), MEM_SAMPLE_HDR_LEN + 6);
+    CHECK_EQ(add(TARGET_BASE + 0x33, 1), MEM_SAMPLE_HDR_LEN + 7);
+    len = add(TARGET_BASE + 0x40, 4);
+    CHECK_EQ(len, MEM_SAMPLE_HDR_LEN + 11);
+    CHECK(start());
+    CHECK(status().running);
+
+    for (i = 0; i < 10; i++) {
+        put_target(TARGET_BASE + 0x10, 0x11223344u + i, 4);
+        put_target(TARGET_BASE + 0x22, 0xA000 + i, 2);
+        put_target(TARGET_BASE + 0x33, i, 1);
+        put_target(TARGET_BASE + 0x40, ~(uint32_t)i, 4);
+        tick();
+    }
+
+    for (i = 0; i < 10; i++) {
+        CHECK(next_record(len, &r));
+        CHECK_EQ(r.sync, MEM_SAMPLE_SYNC);
+        CHECK_EQ(r.flags, 0);
+        CHECK_EQ(r.seq, i);
+        CHECK_EQ(r.time, 12345 + (i + 1) * PERIOD_US);
+        // Values in the order they were added, little endian at their own width
+        CHECK_EQ(get_u32(&r.values[0]), 0x11223344u + i);
+        CHECK_EQ(get_u16(&r.values[4]), 0xA000 + i);
+        CHECK_EQ(r.values[6], i);
+        CHECK_EQ(get_u32(&r.values[7]), ~(uint32_t)i);
+    }
+    CHECK(!next_record(1, &r));
+    CHECK_EQ(status().records, 10);
+    CHECK_EQ(status().errors, 0);
+}
+
+static void test_errors(void) {
+    struct record r;
+    int len;
+
+    config(PERIOD_US);
+    add(TARGET_BASE, 4);
+    len = add(TARGET_FAULT, 2);
+    CHECK(start());
+    put_target(TARGET_BASE, 0xCAFEF00D, 4);
+    tick();
+    target_up = false;
+    tick();
+    target_up = true;
+    tick();
+
+    // A failed read is zero and flags the record, the others are still read
+    CHECK(next_record(len, &r));
+    CHECK_EQ(r.flags, MEM_SAMPLE_FLAG_ERROR);
+    CHECK_EQ(get_u32(&r.values[0]), 0xCAFEF00D);
+    CHECK_EQ(get_u16(&r.values[4]), 0);
+    // Nothing can be read with the AP gone
+    CHECK(next_record(len, &r));
+    CHECK_EQ(r.flags, MEM_SAMPLE_FLAG_ERROR);
+    CHECK_EQ(get_u32(&r.values[0]), 0);
+    CHECK_EQ(r.seq, 1);
+    CHECK(next_record(len, &r));
+    CHECK_EQ(r.seq, 2);
+    CHECK_EQ(status().errors, 3);
+}
+
+static void test_overflow_gap(void) {
+    struct record r;
+    uint32_t fit, dropped = 5, i;
+    int len;
+
+    config(PERIOD_US);
+    len = add(TARGET_BASE, 4);
+    CHECK(start());
+
+    // Nobody drains the stream: whole records fit until the ring is full
+    fit = (MEM_SAMPLE_BUF_SIZE - 1) / len;
+    for (i = 0; i < fit + dropped; i++)
+        tick();
+    CHECK_EQ(status().records, fit);
+    CHECK_EQ(status().overflow, dropped);
+
+    for (i = 0; i < fit; i++) {
+        CHECK(next_record(len, &r));
+        CHECK_EQ(r.seq, i);
+        CHECK_EQ(r.flags, 0);
+    }
+    CHECK(!next_record(len, &r));
+
+    // The dropped records used up sequence numbers, the next one says so
+    tick();
+    tick();
+    CHECK(next_record(len, &r));
+    CHECK_EQ(r.seq, fit + dropped);
+    CHECK_EQ(r.flags, MEM_SAMPLE_FLAG_GAP);
+    CHECK(next_record(len, &r));
+    CHECK_EQ(r.seq, fit + dropped + 1);
+    CHECK_EQ(r.flags, 0);
+}
+
+static void test_seq_wrap(void) {
+    struct record r;
+    uint32_t i;
+    int len;
+
+    config(PERIOD_US);
+    len = add(TARGET_BASE, 1);
+    CHECK(start());
+    for (i = 0; i < 0x10000 + 10; i++) {
+        tick();
+        if (!next_record(len, &r) || r.seq != (uint16_t)i) {
+            CHECK_EQ(r.seq, (uint16_t)i);
+            break;
+        }
+    }
+    CHECK_EQ(status().records, 0x10000 + 10);
+
+    // A restart begins again at zero on a record boundary
+    tick();
+    CHECK(start());
+    tick();
+    CHECK(next_record(len, &r));
+    CHECK_EQ(r.sync, MEM_SAMPLE_SYNC);
+    CHECK_EQ(r.seq, 0);
+    CHECK(!next_record(len, &r));
+}
+
+static void test_commands(void) {
+    uint8_t req[64], resp[64];
+    int i;
+
+    // Periods below the job minimum are raised to it
+    req[0] = MEM_SAMPLE_CONFIG;
+    req[1] = 0;
+    put_u32(&req[2], 1);
+    mem_sample_command(req, resp);
+    CHECK_EQ(get_u32(&resp[1]), DAP_JOB_MIN_PERIOD_US);
+    CHECK_EQ(status().period, DAP_JOB_MIN_PERIOD_US);
+    CHECK(!status().running);
+
+    // Nothing to sample
+    CHECK(!start());
+    // Bad sizes and misaligned addresses
+    CHECK_EQ(add(TARGET_BASE, 3), -1);
+    CHECK_EQ(add(TARGET_BASE + 2, 4), -1);
+    CHECK_EQ(add(TARGET_BASE + 1, 2), -1);
+    for (i = 0; i < MEM_SAMPLE_MAX_VARS; i++)
+        CHECK_EQ(add(TARGET_BASE + i * 4, 4), MEM_SAMPLE_HDR_LEN + (i + 1) * 4);
+    CHECK_EQ(add(TARGET_BASE, 4), -1);
+    CHECK_EQ(status().count, MEM_SAMPLE_MAX_VARS);
+
+    // The list is fixed while sampling
+    CHECK(start());
+    config(PERIOD_US);
+    add(TARGET_BASE, 4);
+    CHECK(start());
+    CHECK_EQ(add(TARGET_BASE + 4, 4), -1);
+
+    // More entries than a packet can hold are refused as a whole
+    req[0] = MEM_SAMPLE_ADD;
+    req[1] = (DAP_PACKET_SIZE - 2) / 5 + 1;
+    config(PERIOD_US);
+    mem_sample_command(req, resp);
+    CHECK_EQ(resp[0], DAP_ERROR);
+    CHECK_EQ(status().count, 0);
+}
+
+int main(void) {
+    test_record_format();
+    test_errors();
+    test_overflow_gap();
+    test_seq_wrap();
+    test_commands();
+    TEST_EXIT();
+}
@@ -0,0 +1,265 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * pio_uart_tx (pio_uart.pio) as the PIO bridged ports run it: the line is
+ * recorded cycle by cycle and compared with ideal 8N1 frames at 8 SM cycles
+ * per bit, for bytes queued back to back and for bytes trickling in at
+ * arbitrary times, and is then fed to the ports' receiver, swo_uart, which
+ * runs at the same clock divider and has to get every byte back. The round
+ * trip is repeated at rates where pio_uart_set_baud() needs a fractional
+ * divider, so the SM clocks come one or two system clocks apart.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "pio_sim.h"
+#include "test.h"
+#include "wave.h"
+
+#define BIT_CYCLES      8
+#define FRAME_CYCLES    (10 * BIT_CYCLES)
+// From the data reaching an idle SM to the start bit: the pull and its delay
+#define START_LATENCY   BIT_CYCLES
+
+#define BYTES           512
+#define CLK_SYS         125000000u
+
+static struct pio_sim tx, rx;
+// Both SMs' divider, 1 unless a test sets a baud rate
+static uint16_t div_int = 1;
+static uint8_t div_frac;
+
+static void line_output(void *ctx, uint64_t cycle, int level) {
+    struct wave *w = ctx;
+
+    // Only called on a change, so the level up to now was the other one
+    wave_hold(w, !level, (double)cycle - w->now);
+}
+
+static uint32_t line_input(void *ctx, uint64_t cycle) {
+    return wave_level(ctx, (double)cycle);
+}
+
+static void tx_load(struct wave *line) {
+    if (!pio_sim_load(&tx, PROBE_SRC_DIR "/pio_uart.pio", "pio_uart_tx"))
+        exit(1);
+    // As pio_uart_tx_program_init(): shift right, no autopull, line driven idle
+    tx.out_shift_right = true;
+    tx.out_level = 1;
+    tx.clkdiv_int = div_int;
+    tx.clkdiv_frac = div_frac;
+    tx.output = line_output;
+    tx.ctx = line;
+    wave_init(line, 1);
+}
+
+static void tx_finish(struct wave *line, uint64_t end) {
+    pio_sim_run_until(&tx, end);
+    wave_hold(line, tx.out_level, (double)end - line->now);
+}
+
+// Cycles where the line differs from frames starting at start[]
+static unsigned int line_mismatches(struct wave *line, const uint8_t *bytes,
+                                    const uint64_t *start, size_t n, uint64_t end) {
+    struct wave ideal;
+    unsigned int bad = 0;
+    uint64_t t;
+    size_t i;
+
+    wave_init(&ideal, 1);
+    for (i = 0; i < n; i++) {
+        wave_hold(&ideal, 1, (double)start[i] - ideal.now);
+        wave_uart_byte(&ideal, bytes[i], BIT_CYCLES);
+    }
+    wave_hold(&ideal, 1, (double)end - ideal.now);
+
+    line->pos = 0;
+    for (t = 0; t < end; t++)
+        bad += wave_level(line, t + 0.5) != wave_level(&ideal, t + 0.5);
+    wave_free(&ideal);
+    return bad;
+}
+
+// What the port's receiver makes of the line, with its clock phase offset
+static size_t rx_decode_phase(struct wave *line, uint8_t *out, size_t max,
+                              unsigned int phase) {
+    size_t i;
+
+    if (!pio_sim_load(&rx, PROBE_SRC_DIR "/swo.pio", "swo_uart"))
+        exit(1);
+    rx.in_shift_right = true;
+    rx.jmp_pin = 0;
+    rx.clkdiv_int = div_int;
+    rx.clkdiv_frac = div_frac;
+    rx.cycle = phase % 3;
+    rx.clkdiv_acc = phase % 256;
+    rx.input = line_input;
+    line->pos = 0;
+    rx.ctx = line;
+    pio_sim_run_until(&rx, (uint64_t)line->now);
+    for (i = 0; i < rx.rx_count && i < max; i++)
+        out[i] = rx.rx[i] >> 24;
+    return rx.rx_count;
+}
+
+static void check_loopback_phase(struct wave *line, const uint8_t *bytes, size_t n,
+                                 unsigned int phase) {
+    static uint8_t out[BYTES];
+    unsigned int bad = 0;
+    size_t got, i;
+
+    got = rx_decode_phase(line, out, sizeof(out), phase);
+    CHECK_EQ(got, n);
+    for (i = 0; i < n && i < got; i++)
+        bad += out[i] != bytes[i];
+    CHECK_EQ(bad, 0);
+}
+
+static void check_loopback(struct wave *line, const uint8_t *bytes, size_t n) {
+    check_loopback_phase(line, bytes, n, 0);
+}
+
+// As pio_uart_set_baud() and pio_sm_set_clkdiv() work the divider out
+static void set_baud(uint32_t baud) {
+    float div = (float)CLK_SYS / (8.0f * baud);
+
+    div_int = (uint16_t)div;
+    div_frac = (uint8_t)((div - div_int) * 256);
+}
+
+static void test_back_to_back(void) {
+    static uint8_t bytes[BYTES];
+    static uint64_t start[BYTES];
+    const uint64_t queued = 100;
+    uint64_t end;
+    struct wave line;
+    size_t i;
+
+    tx_load(&line);
+    pio_sim_run_until(&tx, queued);
+    // Idle and stalled on the pull with the line high
+    CHECK(tx.stalled);
+    CHECK_EQ(tx.out_level, 1);
+    for (i = 0; i < BYTES; i++) {
+        bytes[i] = i;
+        start[i] = queued + START_LATENCY + i * FRAME_CYCLES;
+        // Only the low 8 bits of each FIFO word go out
+        CHECK(pio_sim_tx_put(&tx, 0xA5C3F000u | bytes[i]));
+    }
+    end = start[BYTES - 1] + FRAME_CYCLES + 5 * BIT_CYCLES;
+    tx_finish(&line, end);
+
+    CHECK(tx.stalled);
+    CHECK_EQ(line_mismatches(&line, bytes, start, BYTES, end), 0);
+    check_loopback(&line, bytes, BYTES);
+    wave_free(&line);
+}
+
+static void test_trickle(void) {
+    static uint8_t bytes[BYTES];
+    static uint64_t start[BYTES];
+    uint32_t seed = 0x5EED0043;
+    uint64_t now = 50, prev = 0, end;
+    struct wave line;
+    size_t i;
+
+    tx_load(&line);
+    for (i = 0; i < BYTES; i++) {
+        // Anything from mid-frame, queued behind the byte on the line, to a long idle
+        now += wave_rand(&seed) % (2 * FRAME_CYCLES);
+        pio_sim_run_until(&tx, now);
+        bytes[i] = wave_rand(&seed);
+        CHECK(pio_sim_tx_put(&tx, bytes[i]));
+        start[i] = now + START_LATENCY;
+        if (i && start[i] < prev + FRAME_CYCLES)
+            start[i] = prev + FRAME_CYCLES;
+        prev = start[i];
+        // Don't let a backlog build up, this is about bytes arriving one by one
+        if (start[i] > now + FRAME_CYCLES)
+            now = start[i] - FRAME_CYCLES;
+    }
+    end = prev + FRAME_CYCLES + 5 * BIT_CYCLES;
+    tx_finish(&line, end);
+
+    CHECK_EQ(line_mismatches(&line, bytes, start, BYTES, end), 0);
+    check_loopback(&line, bytes, BYTES);
+    wave_free(&line);
+}
+
+static void test_divided(uint32_t baud) {
+    static uint8_t bytes[BYTES];
+    uint32_t seed = 0x5EED0043 ^ baud;
+    double bit, pos, err, worst = 0;
+    uint64_t end;
+    struct wave line;
+    size_t i;
+
+    set_baud(baud);
+    bit = BIT_CYCLES * (div_int + div_frac / 256.0);
+    // What the divider gives is within a percent of what was asked for
+    CHECK(fabs(CLK_SYS / bit / baud - 1) < 0.01);
+
+    tx_load(&line);
+    pio_sim_run_until(&tx, 100);
+    for (i = 0; i < BYTES; i++) {
+        bytes[i] = wave_rand(&seed);
+        CHECK(pio_sim_tx_put(&tx, bytes[i]));
+    }
+    end = 100 + (uint64_t)((START_LATENCY + BYTES * FRAME_CYCLES + 5 * BIT_CYCLES) * bit / BIT_CYCLES) + 2;
+    tx_finish(&line, end);
+    CHECK(tx.stalled);
+
+    // Every edge lands within a system clock of a bit boundary at the divided rate
+    CHECK(line.n > BYTES);
+    for (i = 0; i < line.n; i++) {
+        pos = (line.t[i] - line.t[0]) / bit;
+        err = fabs(pos - round(pos)) * bit;
+        if (err > worst)
+            worst = err;
+    }
+    if (worst > 1.0)
+        printf("%u baud: edge %.2f system clocks off\n", baud, worst);
+    CHECK(worst <= 1.0);
+
+    // The receiver gets everything back whatever phase its divider runs at
+    check_loopback_phase(&line, bytes, BYTES, 0);
+    check_loopback_phase(&line, bytes, BYTES, 101);
+    check_loopback_phase(&line, bytes, BYTES, 202);
+    wave_free(&line);
+    div_int = 1;
+    div_frac = 0;
+}
+
+int main(void) {
+    test_back_to_back();
+    test_trickle();
+    // The fastest standard rate, SM clocks 1 or 2 system clocks apart
+    test_divided(12000000);
+    test_divided(2718281);
+    TEST_EXIT();
+}
@@ -0,0 +1,165 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * The index arithmetic behind the free-running RX DMA rings of the UART
+ * bridges against a model of the RP2040 DMA channel: the write address
+ * wrapping in ring mode, the transfer count running out and being reloaded
+ * by the control channel, and a reader that is lapped now and then. Every
+ * sync has to publish exactly the bytes written since the previous one, and
+ * the reader has to see them in order, skipping only what was overwritten.
+ */
+
+#include <stdbool.h>
+
+#include "ringbuf.h"
+#include "test.h"
+#include "wave.h"
+
+#define RING_MAX    4096
+#define SYNCS       20000
+
+// Small enough that the count runs out many times per run, above the longest burst
+#define RELOAD      (1u << 15)
+
+static uint32_t rng = 0x2545F491u;
+static char ring_data[RING_MAX];
+// The sequence number of the byte at each ring position
+static uint32_t ring_seq[RING_MAX];
+
+static struct {
+    uintptr_t write_addr;
+    uint32_t count;
+    uint32_t written;
+    uint32_t reloads;
+} ch;
+
+static void dma_write(const struct ringbuf *r) {
+    uint32_t pos;
+
+    // Chained control channel: the count trigger alias restarts the channel
+    if (ch.count == 0) {
+        ch.count = RELOAD;
+        ch.reloads++;
+    }
+    pos = ringbuf_dma_put(r, ch.write_addr);
+    r->data[pos] = (char)ch.written;
+    ring_seq[pos] = ch.written++;
+    // Ring mode wraps the low address bits only
+    ch.write_addr = (uintptr_t)r->data + ((pos + 1) & r->mask);
+    ch.count--;
+}
+
+static uint32_t burst(uint32_t size) {
+    uint32_t r = wave_rand(&rng);
+
+    switch (r & 7) {
+    case 0:
+        return 0;
+    case 1:
+        // Laps the reader, now and then several times
+        return size + (r >> 8) % (3 * size);
+    default:
+        return (r >> 8) % (size / 3);
+    }
+}
+
+static void test_ring(uint32_t size) {
+    struct ringbuf r;
+    uint32_t last_count, since, before, received, put, next, seq;
+    uint32_t overruns = 0, expect_overruns = 0, total = 0;
+    int i, n, c, avail;
+
+    ringbuf_init(&r, ring_data, size);
+    ch.write_addr = (uintptr_t)r.data;
+    ch.count = RELOAD;
+    ch.written = 0;
+    ch.reloads = 0;
+    last_count = RELOAD;
+    next = 0;
+
+    for (i = 0; i < SYNCS; i++) {
+        since = burst(size);
+        before = ringbuf_free(&r);
+        while (since--)
+            dma_write(&r);
+
+        put = ringbuf_dma_put(&r, ch.write_addr);
+        received = ringbuf_dma_received(last_count, ch.count, RELOAD);
+        last_count = ch.count;
+        CHECK_EQ(received, ch.written - total);
+        total += received;
+
+        if (ringbuf_dma_produce(&r, put, received)) {
+            overruns++;
+            // The reader restarts from the oldest byte still intact
+            CHECK_EQ(ringbuf_elements(&r), size - 1);
+            next = ch.written - (size - 1);
+        }
+        if (received > before)
+            expect_overruns++;
+        CHECK_EQ(r.put_ptr, ch.written & (size - 1));
+        CHECK_EQ(ringbuf_elements(&r), ch.written - next);
+
+        // Drain part or all of what is there, in order and without gaps
+        avail = ringbuf_elements(&r);
+        n = (wave_rand(&rng) & 1) ? avail : (int)(wave_rand(&rng) % (avail + 1));
+        while (n--) {
+            seq = ring_seq[r.get_ptr];
+            c = ringbuf_get(&r);
+            CHECK_EQ(seq, next);
+            CHECK_EQ(c & 0xFF, next & 0xFF);
+            if (seq != next)
+                return;
+            next++;
+        }
+    }
+
+    printf("ring %u: %u bytes, %u count reloads, %u overruns\n",
+           size, ch.written, ch.reloads, overruns);
+    CHECK_EQ(overruns, expect_overruns);
+    CHECK(overruns > 0);
+    CHECK(ch.reloads > 10);
+}
+
+// The count read exactly as it runs out, and again just after the reload
+static void test_reload_edges(void) {
+    CHECK_EQ(ringbuf_dma_received(5, 0, RELOAD), 5);
+    CHECK_EQ(ringbuf_dma_received(0, RELOAD, RELOAD), 0);
+    CHECK_EQ(ringbuf_dma_received(0, RELOAD - 3, RELOAD), 3);
+    CHECK_EQ(ringbuf_dma_received(5, RELOAD - 3, RELOAD), 8);
+    CHECK_EQ(ringbuf_dma_received(RELOAD, RELOAD, RELOAD), 0);
+    // The firmware's reload
+    CHECK_EQ(ringbuf_dma_received(2, (1u << 31) - 7, 1u << 31), 9);
+}
+
+int main(void) {
+    test_reload_edges();
+    test_ring(256);
+    test_ring(1024);
+    test_ring(RING_MAX);
+    TEST_EXIT();
+}
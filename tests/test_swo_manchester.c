@@ -0,0 +1,196 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * swo_manchester (swo.pio) against generated Manchester packets with edge
+ * jitter. The decoder takes T/4 from the high half of each start bit and
+ * times the rest of the packet from it, so the test checks that
+ * measurement directly and then decodes packet streams across bit periods,
+ * jitter levels and rate changes between packets.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "pio_sim.h"
+#include "test.h"
+#include "wave.h"
+
+// Fastest rate Manchester_SWO_Baudrate() allows is clk_sys / 40
+#define MIN_BIT_CYCLES  40.0
+
+#define PACKETS         400
+
+static struct pio_sim sm;
+
+static uint32_t line_input(void *ctx, uint64_t cycle) {
+    return wave_level(ctx, (double)cycle);
+}
+
+static void swo_manchester_load(struct wave *w) {
+    if (!pio_sim_load(&sm, PROBE_SRC_DIR "/swo.pio", "swo_manchester"))
+        exit(1);
+    // As swo_manchester_program_init(): shift right, autopush every byte
+    sm.in_shift_right = true;
+    sm.autopush = true;
+    sm.push_thresh = 8;
+    sm.jmp_pin = 0;
+    sm.input = line_input;
+    sm.ctx = w;
+}
+
+/*
+ * Append one packet, a start bit and then the bytes LSB first, followed by
+ * idle. Every edge, and every half-bit boundary that could hold one, is
+ * moved by up to +/- jitter * period.
+ */
+static void manchester_packet(struct wave *w, const uint8_t *data, size_t len,
+                              double period, double jitter, double idle, uint32_t *seed) {
+    double start = w->now, t = w->now, next;
+    size_t halves = 2 + len * 16, i;
+    int level, bit;
+
+    for (i = 0; i < halves; i++) {
+        bit = i < 2 ? 1 : (data[(i - 2) / 16] >> (((i - 2) / 2) % 8)) & 1;
+        // A 1 is high then low, a 0 low then high
+        level = (i & 1) ? !bit : bit;
+        next = start + (i + 1) * period / 2;
+        if (i + 1 < halves)
+            next += wave_rand_unit(seed) * jitter * period;
+        wave_hold(w, level, next - t);
+        t = next;
+    }
+    w->now = t;
+    wave_hold(w, 0, idle * period);
+}
+
+static void test_quarter_period(void) {
+    static const double periods[] = { MIN_BIT_CYCLES, 48, 64, 125, 250, 1250 };
+    static const uint8_t byte = 0x5A;
+    uint32_t seed = 0x5EED0028;
+    unsigned int i, first_in;
+    struct wave w;
+    double quarter;
+
+    for (i = 0; i < sizeof(periods) / sizeof(periods[0]); i++) {
+        wave_init(&w, 0);
+        wave_hold(&w, 0, 10.3);
+        manchester_packet(&w, &byte, 1, periods[i], 0.0, 4, &seed);
+        swo_manchester_load(&w);
+
+        // Y holds the measurement by the time the first bit is sampled, it
+        // is meant to come out about 1.5 short of T/4
+        for (first_in = 0; first_in < sm.len; first_in++) {
+            if (sm.insn[first_in].op == PIO_SIM_IN)
+                break;
+        }
+        while (sm.pc != first_in && sm.cycle < (uint64_t)w.now)
+            pio_sim_step(&sm);
+        quarter = periods[i] / 4 - 1.5;
+        if (fabs(sm.y - quarter) > 1.0)
+            printf("period %.0f: Y = %u, expected %.2f\n", periods[i], sm.y, quarter);
+        CHECK(fabs(sm.y - quarter) <= 1.0);
+
+        pio_sim_run_until(&sm, (uint64_t)w.now);
+        CHECK_EQ(sm.rx_count, 1);
+        CHECK_EQ(sm.rx[0] >> 24, byte);
+        wave_free(&w);
+    }
+}
+
+// Decode a stream of random packets, return how many came out wrong
+static unsigned int decode_stream(double period, double jitter, double rate_step, uint32_t seed) {
+    static uint8_t data[PACKETS][8];
+    static size_t len[PACKETS];
+    static double end[PACKETS];
+    unsigned int i, bad = 0;
+    struct wave w;
+    double p = period;
+    size_t j, got;
+
+    wave_init(&w, 0);
+    wave_hold(&w, 0, 7.7);
+    for (i = 0; i < PACKETS; i++) {
+        len[i] = 1 + wave_rand(&seed) % sizeof(data[i]);
+        for (j = 0; j < len[i]; j++)
+            data[i][j] = wave_rand(&seed);
+        // Optionally move the rate between packets, the decoder re-measures it
+        if (rate_step != 0.0)
+            p = period * (1.0 + rate_step * wave_rand_unit(&seed));
+        manchester_packet(&w, data[i], len[i], p, jitter, 2 + (wave_rand(&seed) % 30) / 10.0, &seed);
+        end[i] = w.now;
+    }
+
+    swo_manchester_load(&w);
+    got = 0;
+    for (i = 0; i < PACKETS; i++) {
+        pio_sim_run_until(&sm, (uint64_t)end[i]);
+        if (sm.rx_count - got != len[i]) {
+            bad++;
+        } else {
+            for (j = 0; j < len[i]; j++) {
+                if ((sm.rx[got + j] >> 24) != data[i][j]) {
+                    bad++;
+                    break;
+                }
+            }
+        }
+        got = sm.rx_count;
+    }
+    wave_free(&w);
+    return bad;
+}
+
+static void test_jitter_sweep(void) {
+    static const double periods[] = { MIN_BIT_CYCLES, 48, 56, 64, 80, 100, 125, 250, 1000 };
+    static const double jitters[] = { 0.0, 0.01, 0.02, 0.03 };
+    unsigned int i, j, bad;
+
+    for (i = 0; i < sizeof(periods) / sizeof(periods[0]); i++) {
+        for (j = 0; j < sizeof(jitters) / sizeof(jitters[0]); j++) {
+            bad = decode_stream(periods[i], jitters[j], 0.0, 0x5EED0028 + i * 16 + j);
+            if (bad)
+                printf("period %.0f jitter %.0f%%: %u of %u packets bad\n",
+                       periods[i], jitters[j] * 100, bad, PACKETS);
+            CHECK_EQ(bad, 0);
+        }
+    }
+}
+
+static void test_rate_changes(void) {
+    unsigned int bad;
+
+    // Every packet at its own rate, up to a factor of two apart
+    bad = decode_stream(96, 0.03, 0.33, 0xC0FFEE);
+    CHECK_EQ(bad, 0);
+}
+
+int main(void) {
+    test_quarter_period();
+    test_jitter_sweep();
+    test_rate_changes();
+    TEST_EXIT();
+}
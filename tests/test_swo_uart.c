@@ -0,0 +1,236 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * swo_uart (swo.pio) against generated NRZ bit streams: every byte value at
+ * the edges of the baud rate tolerance and with arbitrary start phases,
+ * irregular idle gaps, and frames with a bad stop bit or a break, which
+ * must be dropped without losing the bytes around them. Then every byte
+ * again at the baud rates a host would ask for, up to SWO_UART_MAX_BAUDRATE,
+ * with the SM behind the fractional divider UART_SWO_Baudrate() sets.
+ */
+
+#include <stdlib.h>
+
+#include "pio_sim.h"
+#include "test.h"
+#include "wave.h"
+
+// UART_SWO_Baudrate() clocks the SM at 8x the baud rate
+#define BIT_CYCLES  8.0
+#define CLK_SYS     125000000u
+#define SWO_UART_MAX_BAUDRATE   10000000u
+
+static struct pio_sim sm;
+// The SM's divider, 1 unless a test sets a baud rate
+static uint16_t div_int = 1;
+static uint8_t div_frac;
+
+static uint32_t line_input(void *ctx, uint64_t cycle) {
+    return wave_level(ctx, (double)cycle);
+}
+
+// Run the program over the whole wave, return the bytes it pushed
+static size_t swo_uart_run(struct wave *w, uint8_t *out, size_t max) {
+    size_t i;
+
+    if (!pio_sim_load(&sm, PROBE_SRC_DIR "/swo.pio", "swo_uart"))
+        exit(1);
+    // As swo_uart_program_init(): shift right, no autopush, jmp pin = in pin
+    sm.in_shift_right = true;
+    sm.jmp_pin = 0;
+    sm.input = line_input;
+    sm.ctx = w;
+    sm.clkdiv_int = div_int;
+    sm.clkdiv_frac = div_frac;
+    pio_sim_run_until(&sm, (uint64_t)(w->now + 20 * BIT_CYCLES * (div_int + div_frac / 256.0)));
+
+    // The byte is left in the top 8 bits for the DMA's RXF + 3 read
+    for (i = 0; i < sm.rx_count && i < max; i++)
+        out[i] = sm.rx[i] >> 24;
+    return sm.rx_count;
+}
+
+static void test_all_bytes(void) {
+    static const double errors[] = { -0.025, -0.01, 0.0, 0.01, 0.025 };
+    static const double phases[] = { 0.0, 0.25, 0.5, 0.75 };
+    uint8_t out[256];
+    struct wave w;
+    unsigned int e, p, i, bad;
+    size_t n;
+
+    for (e = 0; e < sizeof(errors) / sizeof(errors[0]); e++) {
+        for (p = 0; p < sizeof(phases) / sizeof(phases[0]); p++) {
+            double period = BIT_CYCLES * (1.0 + errors[e]);
+
+            wave_init(&w, 1);
+            wave_hold(&w, 1, 3 * BIT_CYCLES + phases[p]);
+            // Back to back, one stop bit between frames
+            for (i = 0; i < 256; i++)
+                wave_uart_byte(&w, i, period);
+            wave_hold(&w, 1, 4 * BIT_CYCLES);
+
+            n = swo_uart_run(&w, out, sizeof(out));
+            bad = 0;
+            for (i = 0; i < 256 && i < n; i++)
+                bad += out[i] != i;
+            if (n != 256 || bad)
+                printf("rate error %+.1f%% phase %.2f: %zu bytes, %u wrong\n",
+                       errors[e] * 100, phases[p], n, bad);
+            CHECK_EQ(n, 256);
+            CHECK_EQ(bad, 0);
+            wave_free(&w);
+        }
+    }
+}
+
+static void test_idle_gaps(void) {
+    static uint8_t in[1000], out[1000];
+    uint32_t seed = 0x5EED0027;
+    struct wave w;
+    size_t n, i;
+
+    wave_init(&w, 1);
+    wave_hold(&w, 1, 2 * BIT_CYCLES);
+    for (i = 0; i < sizeof(in); i++) {
+        in[i] = wave_rand(&seed);
+        wave_uart_byte(&w, in[i], BIT_CYCLES);
+        // Anything from no gap to a few bits, at any phase of the SM clock
+        wave_hold(&w, 1, (wave_rand_unit(&seed) + 1.0) * 1.5 * BIT_CYCLES);
+    }
+    wave_hold(&w, 1, 4 * BIT_CYCLES);
+
+    n = swo_uart_run(&w, out, sizeof(out));
+    CHECK_EQ(n, sizeof(in));
+    for (i = 0; i < n && i < sizeof(in); i++)
+        CHECK_EQ(out[i], in[i]);
+    wave_free(&w);
+}
+
+static void test_framing_error(void) {
+    uint8_t out[8];
+    struct wave w;
+    size_t n;
+    int i;
+
+    wave_init(&w, 1);
+    wave_hold(&w, 1, 2 * BIT_CYCLES);
+    wave_uart_byte(&w, 0x12, BIT_CYCLES);
+    // 0x55 with the stop bit low for a while
+    wave_hold(&w, 0, BIT_CYCLES);
+    for (i = 0; i < 8; i++)
+        wave_hold(&w, (0x55 >> i) & 1, BIT_CYCLES);
+    wave_hold(&w, 0, 2.5 * BIT_CYCLES);
+    wave_hold(&w, 1, 2 * BIT_CYCLES);
+    // 0x00 with the stop bit low, straight back to idle afterwards
+    wave_hold(&w, 0, 10 * BIT_CYCLES);
+    wave_hold(&w, 1, 1.3 * BIT_CYCLES);
+    wave_uart_byte(&w, 0xA5, BIT_CYCLES);
+    wave_hold(&w, 1, 4 * BIT_CYCLES);
+
+    n = swo_uart_run(&w, out, sizeof(out));
+    CHECK_EQ(n, 2);
+    CHECK_EQ(out[0], 0x12);
+    CHECK_EQ(out[1], 0xA5);
+    wave_free(&w);
+}
+
+static void test_break(void) {
+    uint8_t out[8];
+    struct wave w;
+    size_t n;
+
+    wave_init(&w, 1);
+    wave_hold(&w, 1, 2 * BIT_CYCLES);
+    wave_hold(&w, 0, 40 * BIT_CYCLES);
+    wave_hold(&w, 1, 2 * BIT_CYCLES);
+    wave_uart_byte(&w, 0x3C, BIT_CYCLES);
+    wave_uart_byte(&w, 0xC3, BIT_CYCLES);
+    wave_hold(&w, 1, 4 * BIT_CYCLES);
+
+    n = swo_uart_run(&w, out, sizeof(out));
+    CHECK_EQ(n, 2);
+    CHECK_EQ(out[0], 0x3C);
+    CHECK_EQ(out[1], 0xC3);
+    wave_free(&w);
+}
+
+// As UART_SWO_Baudrate() and pio_calculate_clkdiv_from_float() work it out
+static void set_baud(uint32_t baud) {
+    float div = (float)CLK_SYS / (baud * 8u);
+
+    if (div < 1.0f)
+        div = 1.0f;
+    div_int = (uint16_t)div;
+    div_frac = (uint8_t)((div - div_int) * 256);
+}
+
+static void test_rates(void) {
+    static const uint32_t rates[] = {
+        9600, 57600, 115200, 460800, 921600, 1000000, 2000000, 3000000,
+        4000000, 6000000, 8000000, SWO_UART_MAX_BAUDRATE,
+    };
+    static const double phases[] = { 0.0, 0.3, 0.6 };
+    uint8_t out[256];
+    struct wave w;
+    unsigned int r, p, i, bad;
+    double period;
+    size_t n;
+
+    for (r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        set_baud(rates[r]);
+        // The line runs at the rate asked for, the SM at what the divider gives
+        period = (double)CLK_SYS / rates[r];
+        for (p = 0; p < sizeof(phases) / sizeof(phases[0]); p++) {
+            wave_init(&w, 1);
+            wave_hold(&w, 1, (3 + phases[p]) * period);
+            for (i = 0; i < 256; i++)
+                wave_uart_byte(&w, i, period);
+            wave_hold(&w, 1, 4 * period);
+
+            n = swo_uart_run(&w, out, sizeof(out));
+            bad = 0;
+            for (i = 0; i < 256 && i < n; i++)
+                bad += out[i] != i;
+            if (n != 256 || bad)
+                printf("%u baud phase %.1f: %zu bytes, %u wrong\n", rates[r], phases[p], n, bad);
+            CHECK_EQ(n, 256);
+            CHECK_EQ(bad, 0);
+            wave_free(&w);
+        }
+    }
+    div_int = 1;
+    div_frac = 0;
+}
+
+int main(void) {
+    test_all_bytes();
+    test_idle_gaps();
+    test_framing_error();
+    test_break();
+    test_rates();
+    TEST_EXIT();
+}
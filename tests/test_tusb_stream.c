@@ -0,0 +1,241 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Ownership of the stream endpoint in tusb_stream.c against a fake endpoint
+ * that completes transfers when the test says so: draining a ring in
+ * transfers of at most STREAM_XFER_MAX, one producer at a time, and a ring
+ * detached, reset and attached again while a transfer was still in flight,
+ * which must not lose the new data to the old transfer's completion.
+ */
+
+#include <string.h>
+
+#include "ringbuf.h"
+#include "test.h"
+#include "tusb_stream.h"
+
+#define EP_IN       0x85
+#define XFER_MAX    4096
+
+RINGBUF_STATIC_ALLOC(ring_a, 8192);
+RINGBUF_STATIC_ALLOC(ring_b, 256);
+
+static struct {
+    bool busy;
+    bool fail;
+    const uint8_t *buf;
+    uint16_t len;
+    uint32_t xfers;
+} ep;
+
+bool usbd_edpt_open(uint8_t rhport, tusb_desc_endpoint_t const *desc_ep) {
+    return true;
+}
+
+bool usbd_edpt_xfer(uint8_t rhport, uint8_t ep_addr, uint8_t *buffer, uint16_t total_bytes) {
+    CHECK_EQ(ep_addr, EP_IN);
+    CHECK(!ep.busy);
+    if (ep.fail)
+        return false;
+    ep.busy = true;
+    ep.buf = buffer;
+    ep.len = total_bytes;
+    ep.xfers++;
+    return true;
+}
+
+static void open_endpoint(void) {
+    static const struct __attribute__((packed)) {
+        tusb_desc_interface_t itf;
+        tusb_desc_endpoint_t ep;
+    } desc = {
+        .itf = {
+            .bLength = sizeof(tusb_desc_interface_t),
+            .bNumEndpoints = 1,
+            .bInterfaceClass = TUSB_CLASS_VENDOR_SPECIFIC,
+            .bInterfaceSubClass = STREAM_INTERFACE_SUBCLASS,
+            .bInterfaceProtocol = STREAM_INTERFACE_PROTOCOL,
+        },
+        .ep = {
+            .bLength = sizeof(tusb_desc_endpoint_t),
+            .bEndpointAddress = EP_IN,
+        },
+    };
+
+    CHECK_EQ(stream_edpt_open(0, &desc.itf, sizeof(desc)), TUD_STREAM_DESC_LEN);
+}
+
+// The host takes the transfer, its data is copied out before the completion runs
+static uint16_t complete(uint8_t *out) {
+    uint16_t len = ep.len;
+
+    CHECK(ep.busy);
+    if (out)
+        memcpy(out, ep.buf, len);
+    ep.busy = false;
+    stream_edpt_xfer_cb(0, EP_IN, 0, len);
+    return len;
+}
+
+static void fill(struct ringbuf *r, uint8_t first, int len) {
+    int i;
+
+    for (i = 0; i < len; i++)
+        CHECK_EQ(ringbuf_put(r, (char)(uint8_t)(first + i)), 0);
+}
+
+static void test_drain(void) {
+    static uint8_t out[XFER_MAX];
+    uint32_t total = 0, i;
+    bool ordered = true;
+    uint16_t len;
+
+    ringbuf_reset(&ring_a);
+    // Start off the middle so the data wraps round the end
+    ringbuf_produce(&ring_a, 6000);
+    ringbuf_consume(&ring_a, 6000);
+    fill(&ring_a, 0, 7000);
+
+    CHECK(stream_attach(&ring_a));
+    stream_task();
+    CHECK(stream_inflight(&ring_a));
+    // Nothing more while the endpoint is busy
+    stream_task();
+    CHECK_EQ(ep.xfers, 1);
+
+    while (ep.busy) {
+        len = complete(out);
+        CHECK(len > 0 && len <= XFER_MAX);
+        for (i = 0; i < len; i++)
+            ordered &= out[i] == (uint8_t)(total + i);
+        total += len;
+    }
+    CHECK(ordered);
+    CHECK_EQ(total, 7000);
+    CHECK_EQ(ringbuf_elements(&ring_a), 0);
+    CHECK(!stream_inflight(&ring_a));
+    // The ring wraps after 2192 bytes: 2192, then 4096 and the last 712
+    CHECK_EQ(ep.xfers, 3);
+
+    // A transfer the stack refuses leaves the data where it was
+    fill(&ring_a, 0, 10);
+    ep.fail = true;
+    stream_task();
+    CHECK(!stream_inflight(&ring_a));
+    ep.fail = false;
+    stream_task();
+    CHECK_EQ(complete(NULL), 10);
+    stream_detach(&ring_a);
+}
+
+static void test_owner(void) {
+    ringbuf_reset(&ring_a);
+    ringbuf_reset(&ring_b);
+
+    CHECK(!stream_busy());
+    CHECK(stream_attach(&ring_a));
+    CHECK(stream_attach(&ring_a));
+    CHECK(stream_busy());
+    CHECK(!stream_attach(&ring_b));
+    // Only the owner can let go
+    stream_detach(&ring_b);
+    CHECK(!stream_attach(&ring_b));
+    stream_detach(&ring_a);
+    CHECK(!stream_busy());
+    CHECK(stream_attach(&ring_b));
+
+    // The ring that lost the endpoint is not drained
+    fill(&ring_a, 0, 10);
+    stream_task();
+    CHECK(!ep.busy);
+    stream_detach(&ring_b);
+}
+
+static void test_reset_in_flight(void) {
+    uint8_t out[64];
+
+    ringbuf_reset(&ring_b);
+    fill(&ring_b, 0, 100);
+    CHECK(stream_attach(&ring_b));
+    stream_task();
+    CHECK_EQ(ep.len, 100);
+
+    // Restarted by its producer while the 100 bytes are still going out
+    stream_detach(&ring_b);
+    ringbuf_reset(&ring_b);
+    fill(&ring_b, 0xA0, 20);
+    CHECK(stream_attach(&ring_b));
+    CHECK(stream_inflight(&ring_b));
+
+    // The old transfer finishes without touching the new data, which goes out next
+    complete(NULL);
+    CHECK_EQ(ringbuf_elements(&ring_b), 20);
+    CHECK_EQ(complete(out), 20);
+    CHECK_EQ(out[0], 0xA0);
+    CHECK_EQ(out[19], 0xB3);
+    CHECK_EQ(ringbuf_elements(&ring_b), 0);
+    CHECK(!ep.busy);
+
+    // Detached for good: the completion releases the memory without consuming
+    fill(&ring_b, 0, 30);
+    stream_task();
+    stream_detach(&ring_b);
+    CHECK(stream_inflight(&ring_b));
+    complete(NULL);
+    CHECK(!stream_inflight(&ring_b));
+    CHECK_EQ(ringbuf_elements(&ring_b), 30);
+    stream_task();
+    CHECK(!ep.busy);
+}
+
+static void test_usb_reset(void) {
+    ringbuf_reset(&ring_b);
+    fill(&ring_b, 0, 10);
+    CHECK(stream_attach(&ring_b));
+    stream_task();
+    CHECK(ep.busy);
+
+    // The bus reset drops the transfer, nothing goes out until the endpoint is opened again
+    ep.busy = false;
+    stream_edpt_reset(0);
+    CHECK(!stream_inflight(&ring_b));
+    stream_task();
+    CHECK(!ep.busy);
+    open_endpoint();
+    stream_task();
+    CHECK_EQ(complete(NULL), 10);
+    stream_detach(&ring_b);
+}
+
+int main(void) {
+    open_endpoint();
+    test_drain();
+    test_owner();
+    test_reset_in_flight();
+    test_usb_reset();
+    TEST_EXIT();
+}
@@ -0,0 +1,465 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * UART auto-baud (uart_autobaud.c) from the pulse widths up. The real PIO
+ * program times UART traffic at the standard rates, which checks the width
+ * formula the estimator relies on as well as the estimate. Synthetic widths
+ * then add edge jitter, inter-character gaps and glitches, and the widths
+ * that must not lock are checked, as are the snapping to standard rates and
+ * the poll and command flow around it.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pio_sim.h"
+#include "test.h"
+#include "wave.h"
+
+// The estimator and the state are static, build the source into this file
+#include "uart_autobaud.c"
+
+#define CLK_SYS     125000000u
+#define WIDTHS_MAX  256
+
+pio_hw_t pio_stub_hw[2];
+const pio_program_t uart_autobaud_program;
+TaskHandle_t uart_taskhandle;
+
+static dma_channel_hw_t dma_stub;
+static int sm_claims, dma_claims, programs;
+// Free SMs per PIO, and what holding the SWD engine's pio0 space returns
+static int sms_free[2] = { 4, 4 }, pio0_hold = PROBE_PIO0_LOADED, holds;
+static PIO claimed;
+
+uint32_t clock_get_hz(enum clock_index clk_index) {
+    return CLK_SYS;
+}
+
+bool pio_can_add_program(PIO pio, const pio_program_t *program) {
+    return true;
+}
+
+uint pio_add_program(PIO pio, const pio_program_t *program) {
+    programs++;
+    return 0;
+}
+
+void pio_remove_program(PIO pio, const pio_program_t *program, uint loaded_offset) {
+    programs--;
+}
+
+int pio_claim_unused_sm(PIO pio, bool required) {
+    if (!sms_free[pio - pio0])
+        return -1;
+    sm_claims++;
+    claimed = pio;
+    return 3;
+}
+
+void pio_sm_unclaim(PIO pio, uint sm) {
+    sm_claims--;
+}
+
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled) {
+}
+
+int probe_pio0_hold(void) {
+    if (pio0_hold >= 0)
+        holds++;
+    return pio0_hold;
+}
+
+void probe_pio0_release(int hold) {
+    if (hold >= 0)
+        holds--;
+}
+
+void uart_autobaud_sm_init(PIO pio, uint sm, uint offset, uint pin) {
+}
+
+int dma_claim_unused_channel(bool required) {
+    dma_claims++;
+    return 7;
+}
+
+void dma_channel_unclaim(uint channel) {
+    dma_claims--;
+}
+
+void dma_channel_abort(uint channel) {
+}
+
+dma_channel_hw_t *dma_channel_hw_addr(uint channel) {
+    return &dma_stub;
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger) {
+    CHECK(write_addr == samples);
+    dma_stub.transfer_count = transfer_count;
+}
+
+static const char text[] = "debugprobe: hello\r\n";
+
+static uint32_t line_input(void *ctx, uint64_t cycle) {
+    return wave_level(ctx, (double)cycle);
+}
+
+// The program against real frames: every width it reports is the pulse, give or take its resolution
+static void test_pio_widths(void) {
+    static const uint32_t rates[] = { 9600, 19200, 57600, 115200, 250000, 921600, 1000000, 3000000 };
+    static struct pio_sim sm;
+    struct wave w;
+    double period, width, sum[2], count[2];
+    uint32_t n, i, r, measured, bad;
+
+    for (r = 0; r < count_of(rates); r++) {
+        sum[0] = sum[1] = count[0] = count[1] = 0;
+        period = (double)CLK_SYS / rates[r];
+        wave_init(&w, 1);
+        wave_hold(&w, 1, 5.3 * period);
+        for (i = 0; i < 12; i++)
+            wave_uart_byte(&w, text[i], period);
+        wave_hold(&w, 1, 2 * period);
+
+        if (!pio_sim_load(&sm, PROBE_SRC_DIR "/uart_autobaud.pio", "uart_autobaud"))
+            exit(1);
+        // As uart_autobaud_sm_init(): jmp pin = RX, shift left, autopush 32
+        sm.jmp_pin = 0;
+        sm.autopush = true;
+        sm.push_thresh = 32;
+        sm.input = line_input;
+        sm.ctx = &w;
+        pio_sim_run_until(&sm, (uint64_t)w.now);
+
+        n = MIN(sm.rx_count, AUTOBAUD_SAMPLES);
+        CHECK(n >= AUTOBAUD_MIN_SAMPLES);
+        // The first widths are the SM starting up and the idle line, then one per edge
+        bad = 0;
+        for (i = 2; i < n && i <= w.n; i++) {
+            width = w.t[i - 1] - w.t[i - 2];
+            // 3 cycle steps, and the SM only sees an edge at the next whole cycle
+            if (fabs((double)autobaud_cycles(sm.rx[i], !(i & 1)) - width) >= 4.0)
+                bad++;
+            sum[i & 1] += autobaud_cycles(sm.rx[i], !(i & 1)) - width;
+            count[i & 1]++;
+        }
+        CHECK_EQ(bad, 0);
+        // Neither polarity reads long or short on average
+        CHECK(fabs(sum[0] / count[0]) < 0.5 && fabs(sum[1] / count[1]) < 0.5);
+
+        measured = autobaud_estimate(&sm.rx[1], n - 1);
+        if (autobaud_snap(measured) != rates[r])
+            printf("  %u baud: measured %u\n", rates[r], measured);
+        CHECK_EQ(autobaud_snap(measured), rates[r]);
+        wave_free(&w);
+    }
+}
+
+/*
+ * Widths of the text sent at the given period, every edge moved by up to
+ * jitter bits, idle gaps of up to gap bits between characters and, with
+ * glitches set, a spike a tenth of a bit long in one pulse out of that many.
+ * Each width comes out of the SM's 3 cycle loop rounded up or down, at
+ * random, in the proportion that keeps it right on average.
+ */
+static uint32_t synth_widths(uint32_t *w, double period, double jitter, double gap,
+                             uint32_t glitches, uint32_t *seed) {
+    double edges[WIDTHS_MAX + 1], t = 0, spike, prev, cycles;
+    int level = 1, bit, i, j, ne = 0;
+    uint32_t n = 0;
+
+    for (i = 0; ne < WIDTHS_MAX - 2; i = (i + 1) % (int)(sizeof(text) - 1)) {
+        for (j = 0; j < 10 && ne < WIDTHS_MAX - 2; j++) {
+            bit = j == 0 ? 0 : j == 9 ? 1 : (text[i] >> (j - 1)) & 1;
+            if (bit != level) {
+                edges[ne++] = t + jitter * period * wave_rand_unit(seed);
+                level = bit;
+            }
+            t += period;
+        }
+        t += gap * period * (wave_rand_unit(seed) + 1) / 2;
+    }
+    // Two extra edges a third of the way into a pulse
+    if (glitches) {
+        for (i = ne - 1; i > 0 && ne < WIDTHS_MAX - 1; i--) {
+            if (wave_rand(seed) % glitches)
+                continue;
+            spike = edges[i - 1] + (edges[i] - edges[i - 1]) / 3;
+            memmove(&edges[i + 2], &edges[i], (ne - i) * sizeof(edges[0]));
+            edges[i] = spike;
+            edges[i + 1] = spike + period / 10;
+            ne += 2;
+        }
+    }
+
+    // As the SM reports them: the idle line first, then low and high in turn
+    prev = edges[0] - 5.3 * period;
+    for (i = 0; i < ne; i++) {
+        cycles = (edges[i] - prev - (i & 1 ? 4 : 3)) / 3;
+        w[n++] = ~(uint32_t)floor(cycles + (wave_rand_unit(seed) + 1) / 2);
+        prev = edges[i];
+    }
+    return n;
+}
+
+// The rate uart_autobaud_poll() would measure, trying after every new width
+static uint32_t first_estimate(const uint32_t *w) {
+    uint32_t n, measured;
+
+    for (n = AUTOBAUD_MIN_SAMPLES - 1; n < AUTOBAUD_SAMPLES; n++) {
+        measured = autobaud_estimate(w, n);
+        if (measured)
+            return measured;
+    }
+    return 0;
+}
+
+/*
+ * Every trial has to lock within the sample buffer and land within 3% of the
+ * rate, inside what a UART receiver copes with. Clean lines must snap to the
+ * rate every time. With jitter most trials should: at 5% on every edge, or
+ * at 3 Mbaud where the 3 cycle resolution is already 3.6% of a bit, the
+ * average of a few characters can still miss the 1.5% window now and then.
+ */
+static void test_noisy(void) {
+    static const uint32_t rates[] = {
+        1200, 9600, 38400, 115200, 230400, 460800, 921600, 1000000, 2000000, 3000000,
+    };
+    static const struct {
+        double jitter, gap;
+        uint32_t glitches;
+    } cases[] = {
+        { 0.0, 0.0, 0 },
+        { 0.0, 3.0, 0 },
+        { 0.02, 1.0, 0 },
+        { 0.05, 1.0, 0 },
+        { 0.05, 5.0, 0 },
+        { 0.02, 1.0, 20 },
+        { 0.05, 2.0, 10 },
+    };
+    uint32_t w[WIDTHS_MAX];
+    uint32_t seed = 0x5EED0050, r, c, k, measured, off, missed;
+    double worst;
+
+    for (r = 0; r < count_of(rates); r++) {
+        for (c = 0; c < count_of(cases); c++) {
+            off = missed = 0;
+            worst = 0;
+            for (k = 0; k < 50; k++) {
+                synth_widths(w, (double)CLK_SYS / rates[r], cases[c].jitter, cases[c].gap,
+                             cases[c].glitches, &seed);
+                measured = first_estimate(w);
+                worst = MAX(worst, fabs((double)measured / rates[r] - 1));
+                off += autobaud_snap(measured) != rates[r];
+                missed += !measured;
+            }
+            if (worst > 0.03 || off > (cases[c].jitter ? 5 : 0))
+                printf("  %u baud, jitter %.0f%%, gaps %.0f bits, glitches 1/%u: worst %.1f%%, %u of 50 not snapped\n",
+                       rates[r], cases[c].jitter * 100, cases[c].gap, cases[c].glitches, worst * 100, off);
+            CHECK_EQ(missed, 0);
+            CHECK(worst <= 0.03);
+            CHECK(off <= (cases[c].jitter ? 5 : 0));
+        }
+    }
+}
+
+// Width samples for the given cycles, alternating high and low from the first
+static void widths_from_cycles(uint32_t *w, const double *cycles, uint32_t n) {
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+        w[i] = ~(uint32_t)floor((cycles[i] - (i & 1 ? 4 : 3)) / 3 + 0.5);
+}
+
+static void test_rejects(void) {
+    uint32_t w[WIDTHS_MAX], seed = 0x5EED0051, i;
+    double cycles[AUTOBAUD_SAMPLES];
+
+    // Clean traffic, but too few bits yet for the average
+    synth_widths(w, (double)CLK_SYS / 115200, 0, 0, 0, &seed);
+    CHECK_EQ(autobaud_estimate(w, AUTOBAUD_MIN_SAMPLES - 1), 0);
+    CHECK(first_estimate(w) != 0);
+
+    // Widths that all differ, no two within 1/8 of each other
+    for (i = 0; i < count_of(cycles); i++)
+        cycles[i] = 100 * pow(1.3, i % 24);
+    widths_from_cycles(w, cycles, count_of(cycles));
+    CHECK_EQ(autobaud_estimate(w, count_of(cycles)), 0);
+
+    // An idle line with the odd glitch, too short to be a bit at any rate looked for
+    for (i = 0; i < count_of(cycles); i++)
+        cycles[i] = i & 1 ? 12 : 100000;
+    widths_from_cycles(w, cycles, count_of(cycles));
+    CHECK_EQ(autobaud_estimate(w, count_of(cycles)), 0);
+}
+
+static void test_snap(void) {
+    uint32_t i, rate;
+
+    for (i = 0; i < count_of(autobaud_rates); i++) {
+        rate = autobaud_rates[i];
+        CHECK_EQ(autobaud_snap(rate), rate);
+        CHECK_EQ(autobaud_snap(rate + rate * 14 / 1000), rate);
+        CHECK_EQ(autobaud_snap(rate - rate * 14 / 1000), rate);
+        CHECK_EQ(autobaud_snap(rate + rate * 2 / 100), rate + rate * 2 / 100);
+    }
+    // MIDI is not in the table and stays as measured
+    CHECK_EQ(autobaud_snap(31250), 31250);
+}
+
+struct status {
+    uint8_t state, pending, collected;
+    uint32_t rate, measured;
+};
+
+static bool command(uint8_t sub) {
+    uint8_t resp[DAP_PACKET_SIZE];
+
+    CHECK_EQ(uart_autobaud_command(&sub, resp), (1u << 16) | 1);
+    return resp[0] == DAP_OK;
+}
+
+static struct status status(void) {
+    uint8_t req = UART_AUTOBAUD_STATUS, resp[DAP_PACKET_SIZE];
+    struct status s;
+
+    CHECK_EQ(uart_autobaud_command(&req, resp), (1u << 16) | 12);
+    CHECK_EQ(resp[0], DAP_OK);
+    s.state = resp[1];
+    s.pending = resp[2];
+    s.collected = resp[3];
+    s.rate = get_u32(&resp[4]);
+    s.measured = get_u32(&resp[8]);
+    return s;
+}
+
+// The PIO pushes n widths behind the SM's first one, as the DMA would write them
+static void dma_writes(const uint32_t *w, uint32_t n) {
+    samples[0] = ~0u;
+    memcpy(&samples[1], w, n * sizeof(w[0]));
+    dma_stub.transfer_count = AUTOBAUD_SAMPLES - 1 - n;
+}
+
+static void test_poll(void) {
+    uint32_t w[WIDTHS_MAX], seed = 0x5EED0052, n, rate = 0;
+    double cycles[AUTOBAUD_SAMPLES];
+    struct status s;
+    uint8_t bad = 0x55;
+
+    CHECK(!command(bad));
+    CHECK_EQ(status().state, AUTOBAUD_IDLE);
+
+    // Started from the command, carried out by the next poll
+    CHECK(command(UART_AUTOBAUD_START));
+    CHECK_EQ(status().pending, 1);
+    CHECK_EQ(uart_autobaud_poll(), 0);
+    s = status();
+    CHECK_EQ(s.state, AUTOBAUD_RUNNING);
+    CHECK_EQ(s.pending, 0);
+    CHECK(sm_claims == 1 && dma_claims == 1 && programs == 1);
+
+    // Locks on the first poll with enough widths, and hands the resources back
+    synth_widths(w, (double)CLK_SYS / 460800, 0.02, 1, 0, &seed);
+    for (n = 0; n < AUTOBAUD_SAMPLES - 1 && !rate; n++) {
+        dma_writes(w, n);
+        rate = uart_autobaud_poll();
+        CHECK_EQ(autobaud_estimate(w, n) != 0, rate != 0);
+    }
+    CHECK_EQ(rate, 460800);
+    s = status();
+    CHECK_EQ(s.state, AUTOBAUD_LOCKED);
+    // n went one past the widths it locked on
+    CHECK_EQ(s.collected, n);
+    CHECK_EQ(s.rate, 460800);
+    CHECK(s.measured != 0 && autobaud_snap(s.measured) == 460800);
+    CHECK(sm_claims == 0 && dma_claims == 0 && programs == 0);
+    CHECK_EQ(uart_autobaud_poll(), 0);
+
+    // Nothing to agree on by the time the buffer is full
+    CHECK(command(UART_AUTOBAUD_START));
+    CHECK_EQ(uart_autobaud_poll(), 0);
+    CHECK_EQ(status().rate, 0);
+    for (n = 0; n < count_of(cycles); n++)
+        cycles[n] = 100 * pow(1.3, n % 24);
+    widths_from_cycles(w, cycles, count_of(cycles));
+    dma_writes(w, AUTOBAUD_SAMPLES - 2);
+    CHECK_EQ(uart_autobaud_poll(), 0);
+    CHECK_EQ(status().state, AUTOBAUD_RUNNING);
+    dma_writes(w, AUTOBAUD_SAMPLES - 1);
+    CHECK_EQ(uart_autobaud_poll(), 0);
+    s = status();
+    CHECK_EQ(s.state, AUTOBAUD_FAILED);
+    CHECK_EQ(s.collected, AUTOBAUD_SAMPLES);
+    CHECK(sm_claims == 0 && dma_claims == 0 && programs == 0);
+
+    // Stopped while running
+    CHECK(command(UART_AUTOBAUD_START));
+    CHECK_EQ(uart_autobaud_poll(), 0);
+    CHECK_EQ(status().state, AUTOBAUD_RUNNING);
+    CHECK(command(UART_AUTOBAUD_STOP));
+    CHECK_EQ(uart_autobaud_poll(), 0);
+    CHECK_EQ(status().state, AUTOBAUD_IDLE);
+    CHECK(sm_claims == 0 && dma_claims == 0 && programs == 0);
+}
+
+// pio1 first, pio0 only while the SWD engine still fits next to the program
+static void test_claim(void) {
+    CHECK(autobaud_start());
+    CHECK(claimed == pio1);
+    autobaud_release();
+
+    sms_free[1] = 0;
+    pio0_hold = 5;
+    CHECK(autobaud_start());
+    CHECK(claimed == pio0);
+    CHECK_EQ(holds, 0);
+    autobaud_release();
+
+    pio0_hold = PROBE_PIO0_FULL;
+    CHECK(!autobaud_start());
+    sms_free[0] = 0;
+    pio0_hold = 5;
+    CHECK(!autobaud_start());
+    CHECK_EQ(holds, 0);
+    CHECK(sm_claims == 0 && dma_claims == 0 && programs == 0);
+
+    sms_free[0] = sms_free[1] = 4;
+    pio0_hold = PROBE_PIO0_LOADED;
+}
+
+int main(void) {
+    test_pio_widths();
+    test_noisy();
+    test_rejects();
+    test_snap();
+    test_poll();
+    test_claim();
+    TEST_EXIT();
+}
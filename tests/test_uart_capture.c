@@ -0,0 +1,430 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * The timestamped UART capture record stream (uart_capture.c), fed the way
+ * the bridge feeds it and parsed the way a host would: varint framing of the
+ * delta and length, arrival times rebuilt from the deltas across the 32-bit
+ * microsecond wrap, where records are split, and the gap records that stand
+ * for bytes the host or the bridge lost.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "buf_pool.h"
+#include "dap_vendor.h"
+#include "ringbuf.h"
+#include "test.h"
+#include "tusb_stream.h"
+#include "uart_capture.h"
+#include "wave.h"
+
+#define RECORD_MAX      128
+#define WINDOW_US       64
+// 100 kbaud
+#define CHAR_NS         10000
+#define FED_MAX         100000
+
+static uint32_t now_us;
+static char pool[4096];
+static bool pool_used, pool_empty;
+static struct ringbuf *stream;
+// A transfer the endpoint still has going out of this ring
+static const struct ringbuf *inflight;
+
+// The bytes as they came off the line, and when they arrived
+static uint8_t fed[FED_MAX];
+static uint32_t fed_ts[FED_MAX];
+static uint32_t fed_count;
+static uint32_t last_sync;
+/* Closing points the stream can't show: flushes, and polls with the time
+ * they ran at. A record may end at byte index i if one of these happened
+ * there, besides when it is full or the next byte is out of its window. */
+static bool flushed_at[FED_MAX + 1];
+static bool polled_at[FED_MAX + 1];
+static uint32_t poll_time[FED_MAX + 1];
+
+// The bridge's RX ring
+static char rx_data[256];
+static struct ringbuf rx = { rx_data, sizeof(rx_data) - 1, 0, 0 };
+
+uint32_t time_us_32(void) {
+    return now_us;
+}
+
+void *buf_pool_alloc(uint32_t size) {
+    if (pool_used || pool_empty || size > sizeof(pool))
+        return NULL;
+    pool_used = true;
+    return pool;
+}
+
+void buf_pool_free(void *block, uint32_t size) {
+    CHECK(block == pool && pool_used);
+    pool_used = false;
+}
+
+bool stream_attach(struct ringbuf *source) {
+    if (stream && stream != source)
+        return false;
+    stream = source;
+    return true;
+}
+
+void stream_detach(struct ringbuf *source) {
+    if (stream == source)
+        stream = NULL;
+}
+
+bool stream_inflight(const struct ringbuf *source) {
+    return inflight == source;
+}
+
+struct status {
+    bool running, failed;
+    uint32_t records, lost;
+};
+
+static struct status status(void) {
+    uint8_t resp[64], *p;
+    struct status s;
+
+    p = uart_capture_status(resp);
+    CHECK_EQ(p - resp, 10);
+    s.running = resp[0];
+    s.failed = resp[1];
+    s.records = get_u32(&resp[2]);
+    s.lost = get_u32(&resp[6]);
+    return s;
+}
+
+static bool start(uint32_t at) {
+    now_us = at;
+    uart_capture_set_char_time(CHAR_NS);
+    uart_capture_request(true);
+    CHECK(uart_capture_pending());
+    uart_capture_apply();
+    CHECK(!uart_capture_pending());
+    last_sync = at;
+    fed_count = 0;
+    memset(flushed_at, 0, sizeof(flushed_at));
+    memset(polled_at, 0, sizeof(polled_at));
+    return status().running;
+}
+
+static void stop(void) {
+    flushed_at[fed_count] = true;
+    uart_capture_request(false);
+    uart_capture_apply();
+    CHECK(!status().running);
+}
+
+/* n bytes found by a sync at now, after lost bytes that were overwritten in
+ * the RX ring. Arrival times count back one character per byte, but never
+ * before the previous sync. */
+static void feed(uint32_t n, uint32_t lost, uint32_t now, uint32_t *seed) {
+    uint32_t i, t, at = fed_count + lost, from = rx.put_ptr;
+
+    CHECK(at + n <= FED_MAX);
+    now_us = now;
+    for (i = 0; i < n; i++) {
+        fed[at + i] = wave_rand(seed);
+        rx.data[(from + i) & rx.mask] = fed[at + i];
+        t = now - (uint32_t)((uint64_t)(n - 1 - i) * CHAR_NS / 1000);
+        if ((int32_t)(t - last_sync) < 0)
+            t = last_sync;
+        fed_ts[at + i] = t;
+    }
+    rx.put_ptr = (from + n) & rx.mask;
+    uart_capture_feed(&rx, from, n, lost, now);
+    last_sync = now;
+    fed_count = at + n;
+}
+
+static void poll(uint32_t now) {
+    polled_at[fed_count] = true;
+    poll_time[fed_count] = now;
+    now_us = now;
+    uart_capture_poll(now);
+}
+
+static void flush(void) {
+    flushed_at[fed_count] = true;
+    uart_capture_flush();
+}
+
+static bool get_varint(uint32_t *v) {
+    int c, shift;
+
+    *v = 0;
+    for (shift = 0; shift < 35; shift += 7) {
+        // ringbuf_get() returns a char, -1 is a valid byte
+        if (ringbuf_elements(stream) == 0)
+            return false;
+        c = ringbuf_get(stream) & 0xFF;
+        *v |= (uint32_t)(c & 0x7F) << shift;
+        if (!(c & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// The host's side of the stream
+static struct host {
+    uint32_t t;             // start of the last record
+    uint32_t pos;           // index in fed[] of the next byte expected
+    bool open;              // a record ended at pos, so its end can be checked
+    uint32_t open_ts, open_len;
+    uint32_t records, gaps, lost, last_lost, bytes, long_deltas;
+} host;
+
+static void host_start(uint32_t at) {
+    memset(&host, 0, sizeof(host));
+    host.t = at;
+}
+
+// Takes everything off the stream and checks it against what was fed
+static void host_parse(void) {
+    uint32_t delta, len, lost, i, end;
+    int c;
+
+    while (ringbuf_elements(stream) > 0) {
+        CHECK(get_varint(&delta));
+        CHECK(get_varint(&len));
+        host.long_deltas += delta >= 0x80;
+        host.t += delta;
+        if (len == 0) {
+            // Gap: the bytes before the next record that never made it
+            CHECK(get_varint(&lost));
+            CHECK(lost > 0);
+            host.gaps++;
+            host.lost += lost;
+            host.last_lost = lost;
+            host.pos += lost;
+            host.open = false;
+            continue;
+        }
+        CHECK(len <= RECORD_MAX);
+        CHECK(host.pos + len <= fed_count);
+        if (host.pos + len > fed_count)
+            return;
+        if (host.open) {
+            // The previous record had to be full, out of window, flushed or stale at a poll
+            end = host.pos;
+            CHECK(host.open_len == RECORD_MAX || fed_ts[end] - host.open_ts >= WINDOW_US ||
+                  flushed_at[end] || (polled_at[end] && poll_time[end] - host.open_ts >= WINDOW_US));
+        }
+        // The delta gives the arrival of the record's first byte
+        CHECK_EQ(host.t, fed_ts[host.pos]);
+        for (i = 0; i < len; i++) {
+            c = ringbuf_get(stream);
+            CHECK_EQ(c & 0xFF, fed[host.pos + i]);
+            CHECK(fed_ts[host.pos + i] - host.t < WINDOW_US);
+        }
+        host.open = true;
+        host.open_ts = host.t;
+        host.open_len = len;
+        host.records++;
+        host.bytes += len;
+        host.pos += len;
+    }
+}
+
+static void test_framing(void) {
+    static const uint32_t gaps[] = { 0, 3, 40, 63, 64, 200, 20000, 1000000, 300000000 };
+    // Starts just before the microsecond counter wraps
+    const uint32_t t0 = 0xFFFFF000u;
+    uint32_t seed = 0x5EED0048, now = t0, n, i;
+    struct status s;
+
+    CHECK(start(t0));
+    CHECK(stream != NULL);
+    host_start(t0);
+    for (i = 0; i < 3000; i++) {
+        n = 1 + wave_rand(&seed) % 40;
+        now += gaps[wave_rand(&seed) % (sizeof(gaps) / sizeof(gaps[0]))] + n * CHAR_NS / 1000;
+        feed(n, 0, now, &seed);
+        if (wave_rand(&seed) & 1)
+            poll(now + wave_rand(&seed) % 100);
+        if ((wave_rand(&seed) & 15) == 0)
+            flush();
+        // The host keeps up
+        if (wave_rand(&seed) & 1)
+            host_parse();
+    }
+    flush();
+    host_parse();
+
+    s = status();
+    CHECK(s.running);
+    CHECK_EQ(s.lost, 0);
+    CHECK_EQ(host.gaps, 0);
+    CHECK_EQ(host.records, s.records);
+    CHECK_EQ(host.bytes, fed_count);
+    CHECK_EQ(host.pos, fed_count);
+    // One and several byte deltas both turned up
+    CHECK(host.long_deltas > 100 && host.long_deltas < host.records);
+    stop();
+    CHECK(stream == NULL);
+    CHECK(!pool_used);
+}
+
+// Records that don't fit the stream ring, and bytes the bridge lost itself
+static void test_gaps(void) {
+    uint32_t seed = 0x5EED0049, now = 1000, i;
+    struct status s;
+
+    CHECK(start(now));
+    host_start(now);
+    // The host stalls: the 4096 byte ring fills, the rest is counted lost
+    for (i = 0; i < 200; i++) {
+        now += 100;
+        feed(40, 0, now, &seed);
+    }
+    flush();
+    CHECK(ringbuf_elements(stream) > 4000);
+    s = status();
+    CHECK(s.lost > 0);
+
+    // The host catches up, the next record is preceded by the gap
+    host_parse();
+    now += 100;
+    feed(10, 0, now, &seed);
+    flush();
+    // The RX ring lapped the bridge
+    now += 100;
+    feed(10, 77, now, &seed);
+    flush();
+    host_parse();
+
+    s = status();
+    // Gap records still fit while the ring is too full for data
+    CHECK(host.gaps >= 2);
+    CHECK_EQ(host.last_lost, 77);
+    CHECK_EQ(host.lost, s.lost);
+    CHECK_EQ(host.bytes + host.lost, fed_count);
+    CHECK_EQ(host.pos, fed_count);
+    CHECK_EQ(host.records, s.records);
+    stop();
+}
+
+// The exact edges of the record window and size
+static void test_record_limits(void) {
+    uint32_t seed = 0x5EED004B;
+
+    CHECK(start(0));
+    host_start(0);
+    feed(1, 0, 1000, &seed);
+    feed(1, 0, 1000 + WINDOW_US - 1, &seed);
+    feed(1, 0, 1000 + WINDOW_US, &seed);
+    flush();
+    host_parse();
+    CHECK_EQ(host.records, 2);
+    CHECK_EQ(host.open_len, 1);
+
+    // One byte more than a record holds, found soon after the previous sync
+    // so most are stamped with that sync's time, well within the window
+    feed(RECORD_MAX + 1, 0, 1000 + WINDOW_US + 20, &seed);
+    flush();
+    host_parse();
+    CHECK_EQ(host.records, 4);
+    CHECK_EQ(host.open_len, 1);
+    stop();
+}
+
+static void test_start_stop(void) {
+    uint32_t seed = 0x5EED004A;
+    struct ringbuf *ring;
+    struct status s;
+
+    // No memory: the request is dropped and reported
+    pool_empty = true;
+    CHECK(!start(0));
+    s = status();
+    CHECK(s.failed);
+    CHECK(!uart_capture_pending());
+    pool_empty = false;
+
+    // The stream endpoint is taken: the block goes back to the pool
+    stream = &rx;
+    CHECK(!start(0));
+    CHECK(status().failed);
+    CHECK(!pool_used);
+    stream = NULL;
+
+    // Stopping closes the open record
+    CHECK(start(500));
+    CHECK(!status().failed);
+    host_start(500);
+    feed(5, 0, 600, &seed);
+    CHECK_EQ(ringbuf_elements(stream), 0);
+    ring = stream;
+    stop();
+    CHECK(stream == NULL);
+    CHECK(!pool_used);
+    // The freed block isn't reused here, so the last record can still be read
+    stream = ring;
+    host_parse();
+    stream = NULL;
+    CHECK_EQ(host.records, 1);
+    CHECK_EQ(host.bytes, 5);
+
+    // Feeding a stopped capture does nothing
+    feed(5, 3, 700, &seed);
+    CHECK_EQ(status().lost, 0);
+
+    // Stopped while a transfer still reads the block: it is kept until the endpoint lets go
+    CHECK(start(800));
+    ring = stream;
+    inflight = ring;
+    stop();
+    CHECK(pool_used);
+    CHECK(uart_capture_pending());
+    // Nor can a new capture reuse the ring meanwhile
+    uart_capture_request(true);
+    uart_capture_apply();
+    CHECK(!status().running);
+    CHECK(stream == NULL);
+    uart_capture_request(false);
+    uart_capture_apply();
+    CHECK(pool_used);
+    inflight = NULL;
+    uart_capture_apply();
+    CHECK(!pool_used);
+    CHECK(!uart_capture_pending());
+    CHECK(start(900));
+    stop();
+    CHECK(!pool_used);
+}
+
+int main(void) {
+    test_framing();
+    test_gaps();
+    test_record_limits();
+    test_start_stop();
+    TEST_EXIT();
+}
@@ -0,0 +1,98 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "wave.h"
+
+void wave_init(struct wave *w, int idle) {
+    w->t = NULL;
+    w->level = NULL;
+    w->n = w->cap = 0;
+    w->pos = 0;
+    w->idle = idle;
+    w->now = 0.0;
+}
+
+void wave_free(struct wave *w) {
+    free(w->t);
+    free(w->level);
+    wave_init(w, w->idle);
+}
+
+static int wave_last(const struct wave *w) {
+    return w->n ? w->level[w->n - 1] : w->idle;
+}
+
+void wave_hold(struct wave *w, int level, double duration) {
+    level = !!level;
+    if (level != wave_last(w)) {
+        if (w->n == w->cap) {
+            w->cap = w->cap ? w->cap * 2 : 1024;
+            w->t = realloc(w->t, w->cap * sizeof(*w->t));
+            w->level = realloc(w->level, w->cap * sizeof(*w->level));
+            if (!w->t || !w->level) {
+                fprintf(stderr, "wave: out of memory\n");
+                exit(1);
+            }
+        }
+        w->t[w->n] = w->now;
+        w->level[w->n++] = level;
+    }
+    w->now += duration;
+}
+
+int wave_level(struct wave *w, double t) {
+    if (w->pos && w->t[w->pos - 1] > t)
+        w->pos = 0;
+    while (w->pos < w->n && w->t[w->pos] <= t)
+        w->pos++;
+    return w->pos ? w->level[w->pos - 1] : w->idle;
+}
+
+void wave_uart_byte(struct wave *w, uint8_t byte, double period) {
+    int i;
+
+    wave_hold(w, 0, period);
+    for (i = 0; i < 8; i++)
+        wave_hold(w, (byte >> i) & 1, period);
+    wave_hold(w, 1, period);
+}
+
+uint32_t wave_rand(uint32_t *state) {
+    uint32_t x = *state;
+
+    // xorshift32
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+double wave_rand_unit(uint32_t *state) {
+    return wave_rand(state) / 2147483647.5 - 1.0;
+}
@@ -0,0 +1,64 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2024 DazzlingOkami
+ * Written by DazzlingOkami <kinghd1912@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef WAVE_H_
+#define WAVE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A single logic line built up as a list of levels and how long each is
+ * held, with edges at arbitrary (fractional) times. Lookups are expected to
+ * move forwards, as a simulated SM samples the line.
+ */
+struct wave {
+    double *t;          // time of each edge
+    uint8_t *level;     // level from that edge on
+    size_t n, cap;
+    size_t pos;         // lookup cursor
+    int idle;           // level before the first edge
+    double now;         // end of what has been appended so far
+};
+
+void wave_init(struct wave *w, int idle);
+void wave_free(struct wave *w);
+
+// Hold the line at level for duration, starting where the wave ends now
+void wave_hold(struct wave *w, int level, double duration);
+
+// Level of the line at time t
+int wave_level(struct wave *w, double t);
+
+// Append an 8N1 frame, LSB first, with the given bit period
+void wave_uart_byte(struct wave *w, uint8_t byte, double period);
+
+// Deterministic pseudo-random numbers for reproducible runs
+uint32_t wave_rand(uint32_t *state);
+// Uniform in [-1, 1]
+double wave_rand_unit(uint32_t *state);
+
+#endif